@@ -0,0 +1,311 @@
+/*
+ * Autoscaler.c
+ *
+ * Autoscaling consumer pool implementation, with a monitor thread sampling the queue's occupancy and rates.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Autoscaler.h"
+
+#define MICROSECONDS_PER_MILLISECOND 1000
+#define NANOSECONDS_PER_SECOND 1e9
+
+/*
+ * A consumer that dequeues this token exits, as in a Pipeline. Only Autoscaler_stop sends them, to wake the consumers
+ * waiting for an element once the queue is drained: the monitor retires consumers through retiring instead, so that
+ * the queue's overflow policy can never reject or drop one of its retirements.
+ */
+static char retire_token;
+#define RETIRE ((void*) &retire_token)
+
+/*
+ * Terminates the code and prints out an error message if an error is detected.
+ */
+static void exit_autoscaler_error(char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+/*
+ * Locks the mutex protecting workers, running and stats, and checks that it has been done.
+ */
+static void lock_pool(Autoscaler* this) {
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_autoscaler_error("Mutex 'mutex' not locked!");
+    }
+}
+
+/*
+ * Unlocks the mutex protecting workers, running and stats, and checks that it has been done.
+ */
+static void unlock_pool(Autoscaler* this) {
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_autoscaler_error("Mutex 'mutex' not unlocked!");
+    }
+}
+
+
+/*
+ * Lets Autoscaler_stop know that one more consumer has exited. The mutex must be locked.
+ */
+static void count_exit(Autoscaler* this) {
+    (*this).running--;
+    if (pthread_cond_broadcast(&(*this).cond_running)) {
+        exit_autoscaler_error("Condition 'cond_running' not signalled!");
+    }
+}
+
+/*
+ * Returns whether the calling consumer should exit, taking one of the retirements the monitor asked for.
+ * The consumer leaves running under the same lock, so that Autoscaler_stop never sends it a token.
+ */
+static bool take_retirement(Autoscaler* this) {
+    if (atomic_load_explicit(&(*this).retiring, memory_order_relaxed) == ZERO) {
+        return false;
+    }
+    lock_pool(this);
+    bool retire = atomic_load_explicit(&(*this).retiring, memory_order_relaxed) > ZERO;
+    if (retire) {
+        atomic_fetch_sub_explicit(&(*this).retiring, ONE, memory_order_relaxed);
+        count_exit(this);
+    }
+    unlock_pool(this);
+    return retire;
+}
+
+static void* consumer(void* arg) {
+    Autoscaler* this = arg;
+    for (;;) {
+        if (take_retirement(this)) {
+            return NULL;
+        }
+        // Wait for at most one interval, so that an idle consumer still sees the retirements the monitor asks for
+        atomic_fetch_add(&(*this).idle, ONE);
+        void* element = BlockingQueue_deqTimed((*this).queue, AUTOSCALER_INTERVAL_MS*MICROSECONDS_PER_MILLISECOND);
+        atomic_fetch_sub(&(*this).idle, ONE);
+        if (element == NULL) {
+            continue;
+        }
+        if (element == RETIRE) {
+            break;
+        }
+        (*this).function(element, (*this).context);
+        atomic_fetch_add_explicit(&(*this).processed, ONE, memory_order_relaxed);
+    }
+
+    lock_pool(this);
+    count_exit(this);
+    unlock_pool(this);
+    return NULL;
+}
+
+/*
+ * Starts one more consumer thread.
+ */
+static void spawn_consumer(Autoscaler* this) {
+    lock_pool(this);
+    (*this).workers++;
+    (*this).running++;
+    unlock_pool(this);
+
+    // Consumers are detached: Autoscaler_stop waits for them through running instead of joining them
+    pthread_t thread;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attributes, consumer, this)) {
+        exit_autoscaler_error("Consumer thread not created!");
+    }
+    pthread_attr_destroy(&attributes);
+}
+
+/*
+ * Retires one consumer thread: the next consumer to finish an element exits instead of waiting for another one.
+ */
+static void retire_consumer(Autoscaler* this) {
+    lock_pool(this);
+    (*this).workers--;
+    atomic_fetch_add_explicit(&(*this).retiring, ONE, memory_order_relaxed);
+    unlock_pool(this);
+}
+
+/*
+ * Enqueues a retire token for Autoscaler_stop, whatever the queue's overflow policy. No element is enqueued any more,
+ * so the token waits for the consumers to make room instead of being rejected or dropping an element. Should a policy
+ * drop one all the same, a dropped token is sent again, and a dropped element is processed here.
+ */
+static void enq_retire(Autoscaler* this) {
+    BlockingQueue* queue = (*this).queue;
+    for (;;) {
+        void* evicted = NULL;
+        if (BlockingQueue_size(queue) < BlockingQueue_capacity(queue) && BlockingQueue_enqEvict(queue, RETIRE, &evicted)) {
+            if (evicted == NULL) {
+                return;
+            }
+            if (evicted != RETIRE) {
+                (*this).function(evicted, (*this).context);
+                atomic_fetch_add_explicit(&(*this).processed, ONE, memory_order_relaxed);
+                return;
+            }
+        }
+        else {
+            usleep(AUTOSCALER_INTERVAL_MS*MICROSECONDS_PER_MILLISECOND);
+        }
+    }
+}
+
+/*
+ * The monitor thread: samples the queue once per interval, and adds or retires a consumer once the samples have
+ * agreed for long enough. Needing a few samples in a row to add a consumer, and many more to retire one, keeps the
+ * pool from flapping around a load that sits on a threshold.
+ */
+static void* monitor(void* arg) {
+    Autoscaler* this = arg;
+    int up_streak = 0;
+    int down_streak = 0;
+    long last_processed = atomic_load_explicit(&(*this).processed, memory_order_relaxed);
+    int last_size = BlockingQueue_size((*this).queue);
+    struct timespec last;
+    clock_gettime(CLOCK_MONOTONIC, &last);
+
+    while (!atomic_load(&(*this).stopping)) {
+        usleep(AUTOSCALER_INTERVAL_MS*MICROSECONDS_PER_MILLISECOND);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec)/NANOSECONDS_PER_SECOND;
+        last = now;
+
+        // Every element that arrived was either dequeued or is still in the queue, so the arrival rate follows from
+        // the dequeue rate and the change in size, whatever enqueues to the queue
+        long processed = atomic_load_explicit(&(*this).processed, memory_order_relaxed);
+        int size = BlockingQueue_size((*this).queue);
+        int idle = atomic_load(&(*this).idle);
+        double dequeue_rate = (processed - last_processed)/elapsed;
+        double arrival_rate = dequeue_rate + (size - last_size)/elapsed;
+        double occupancy = (double) size/BlockingQueue_capacity((*this).queue);
+        last_processed = processed;
+        last_size = size;
+
+        lock_pool(this);
+        int workers = (*this).workers;
+        (*this).stats.workers = workers;
+        (*this).stats.idle = idle;
+        (*this).stats.occupancy = occupancy;
+        (*this).stats.arrival_rate = arrival_rate;
+        (*this).stats.dequeue_rate = dequeue_rate;
+        unlock_pool(this);
+
+        bool needs_more = occupancy >= AUTOSCALER_HIGH_WATERMARK
+                || (arrival_rate > dequeue_rate && idle == ZERO && size > ZERO);
+        bool has_spare = occupancy <= AUTOSCALER_LOW_WATERMARK && arrival_rate <= dequeue_rate && idle > ZERO;
+        up_streak = needs_more ? up_streak + ONE : ZERO;
+        down_streak = has_spare ? down_streak + ONE : ZERO;
+
+        if (up_streak >= AUTOSCALER_UP_INTERVALS && workers < (*this).max_workers) {
+            spawn_consumer(this);
+            up_streak = ZERO;
+            down_streak = ZERO;
+        }
+        else if (down_streak >= AUTOSCALER_DOWN_INTERVALS && workers > (*this).min_workers) {
+            retire_consumer(this);
+            up_streak = ZERO;
+            down_streak = ZERO;
+        }
+    }
+    return NULL;
+}
+
+
+Autoscaler* new_Autoscaler(BlockingQueue* queue, AutoscalerFunction function, void* context,
+                           int min_workers, int max_workers) {
+    if (queue == NULL || function == NULL || min_workers < ONE || max_workers < min_workers) {
+        return NULL;
+    }
+    Autoscaler* this = calloc(ONE, sizeof(Autoscaler));
+    if (this == NULL) {
+        return NULL;
+    }
+    (*this).queue = queue;
+    (*this).function = function;
+    (*this).context = context;
+    (*this).min_workers = min_workers;
+    (*this).max_workers = max_workers;
+    atomic_init(&(*this).idle, ZERO);
+    atomic_init(&(*this).retiring, ZERO);
+    atomic_init(&(*this).processed, ZERO);
+    atomic_init(&(*this).stopping, false);
+    if (pthread_mutex_init(&(*this).mutex, NULL)) {
+        exit_autoscaler_error("Mutex 'mutex' not created!");
+    }
+    if (pthread_cond_init(&(*this).cond_running, NULL)) {
+        exit_autoscaler_error("Condition 'cond_running' not created!");
+    }
+    return this;
+}
+
+void Autoscaler_start(Autoscaler* this) {
+    if ((*this).started) {
+        return;
+    }
+    (*this).started = true;
+    for (int i = 0; i < (*this).min_workers; i++) {
+        spawn_consumer(this);
+    }
+    if (pthread_create(&(*this).monitor, NULL, monitor, this)) {
+        exit_autoscaler_error("Monitor thread not created!");
+    }
+}
+
+void Autoscaler_stats(Autoscaler* this, AutoscalerStats* stats) {
+    lock_pool(this);
+    *stats = (*this).stats;
+    (*stats).workers = (*this).workers;
+    (*stats).running = (*this).running;
+    unlock_pool(this);
+    (*stats).processed = atomic_load_explicit(&(*this).processed, memory_order_relaxed);
+}
+
+void Autoscaler_stop(Autoscaler* this) {
+    if (!(*this).started || atomic_exchange(&(*this).stopping, true)) {
+        return;
+    }
+    // Stop the monitor first, so that the pool isn't resized while it is being drained
+    pthread_join((*this).monitor, NULL);
+
+    /*
+     * Every consumer gets a retire token behind the elements already queued, and exits once they are all processed.
+     * Retirements the monitor asked for and no consumer has taken yet are cancelled, so that each running consumer
+     * exits exactly once, through its token.
+     */
+    lock_pool(this);
+    int running = (*this).running;
+    (*this).workers = ZERO;
+    atomic_store_explicit(&(*this).retiring, ZERO, memory_order_relaxed);
+    unlock_pool(this);
+    for (int i = 0; i < running; i++) {
+        enq_retire(this);
+    }
+
+    lock_pool(this);
+    while ((*this).running > ZERO) {
+        if (pthread_cond_wait(&(*this).cond_running, &(*this).mutex)) {
+            exit_autoscaler_error("Condition 'cond_running' not waited on!");
+        }
+    }
+    unlock_pool(this);
+}
+
+void Autoscaler_destroy(Autoscaler* this) {
+    Autoscaler_stop(this);
+    pthread_mutex_destroy(&(*this).mutex);
+    pthread_cond_destroy(&(*this).cond_running);
+    free(this);
+}
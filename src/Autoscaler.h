@@ -0,0 +1,124 @@
+/*
+ * Autoscaler.h
+ *
+ * Module interface for a pool of consumer threads on a BlockingQueue, whose size follows the queue's load:
+ * consumers are added while the queue fills up faster than it is drained, and retired while they sit idle.
+ *
+ */
+
+#ifndef AUTOSCALER_H_
+#define AUTOSCALER_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "BlockingQueue.h"
+
+#define AUTOSCALER_INTERVAL_MS 20       // How often the monitor samples the queue
+#define AUTOSCALER_HIGH_WATERMARK 0.75  // Above this fraction of the capacity, the queue needs more consumers
+#define AUTOSCALER_LOW_WATERMARK 0.10   // Below this fraction of the capacity, the queue may do with fewer
+#define AUTOSCALER_UP_INTERVALS 2       // The number of intervals in a row the queue must need more consumers to get one
+#define AUTOSCALER_DOWN_INTERVALS 10    // The number of intervals in a row a consumer must be spare to be retired
+
+/*
+ * A consumer's function processes one element dequeued from the queue.
+ */
+typedef void (*AutoscalerFunction)(void* element, void* context);
+
+typedef struct AutoscalerStats AutoscalerStats;
+typedef struct Autoscaler Autoscaler;
+
+struct AutoscalerStats {
+    /*
+     * An AutoscalerStats struct is a snapshot of the pool's metrics, as of the monitor's last sample:
+     *      - workers: The number of consumer threads the pool should have;
+     *      - running: The number of consumer threads still running, which trails workers until retired ones exit;
+     *      - idle: The number of them waiting for an element;
+     *      - occupancy: How full the queue is, between 0 and 1;
+     *      - arrival_rate and dequeue_rate: The number of elements enqueued and dequeued per second over the last interval;
+     *      - processed: The number of elements processed so far.
+     */
+    int workers;
+    int running;
+    int idle;
+    double occupancy;
+    double arrival_rate;
+    double dequeue_rate;
+    long processed;
+};
+
+struct Autoscaler {
+    /*
+     * An Autoscaler struct has 16 attributes:
+     *      - queue: The BlockingQueue the consumers dequeue from, owned by the caller;
+     *      - function and context: The function applied to each element, and the context passed to it;
+     *      - min_workers and max_workers: The bounds on the number of consumer threads;
+     *      - workers: The number of consumer threads the pool should have;
+     *      - running: The number of consumer threads currently running;
+     *      - idle: The number of consumer threads waiting for an element;
+     *      - retiring: The number of consumer threads the monitor has retired, which have yet to exit;
+     *      - processed: The number of elements processed so far;
+     *      - stats: The monitor's last sample;
+     *      - mutex and cond_running: Protect workers, running, stats and changes to retiring, and signal when a
+     *        consumer exits;
+     *      - monitor: The thread sampling the queue and resizing the pool;
+     *      - started and stopping: The pool's state.
+     */
+    BlockingQueue* queue;
+    AutoscalerFunction function;
+    void* context;
+    int min_workers;
+    int max_workers;
+    int workers;
+    int running;
+    atomic_int idle;
+    atomic_int retiring;
+    atomic_long processed;
+    AutoscalerStats stats;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_running;
+    pthread_t monitor;
+    bool started;
+    atomic_bool stopping;
+};
+
+/*
+ * Creates a new Autoscaler running between min_workers and max_workers consumer threads on the given queue,
+ * each applying function to the elements it dequeues.
+ * Returns a pointer to a new Autoscaler on success and NULL on failure (including when the bounds are invalid).
+ */
+Autoscaler* new_Autoscaler(BlockingQueue* queue, AutoscalerFunction function, void* context,
+                           int min_workers, int max_workers);
+
+/*
+ * Starts min_workers consumer threads, and the monitor thread. Every AUTOSCALER_INTERVAL_MS, the monitor:
+ *      - adds a consumer once the queue has needed one for AUTOSCALER_UP_INTERVALS intervals in a row, because it is
+ *        above AUTOSCALER_HIGH_WATERMARK, or because elements arrive faster than they are dequeued while no consumer
+ *        is idle;
+ *      - retires a consumer once one has been spare for AUTOSCALER_DOWN_INTERVALS intervals in a row, because the
+ *        queue is below AUTOSCALER_LOW_WATERMARK, elements don't arrive faster than they are dequeued, and a consumer
+ *        is idle. The next consumer to finish an element, or to wait AUTOSCALER_INTERVAL_MS without getting one,
+ *        exits instead of waiting for another one, so no element is held up, an idle pool still shrinks, and the
+ *        queue's overflow policy never sees the retirement.
+ */
+void Autoscaler_start(Autoscaler* this);
+
+/*
+ * Stores a snapshot of the pool's metrics in stats.
+ */
+void Autoscaler_stats(Autoscaler* this, AutoscalerStats* stats);
+
+/*
+ * Stops the pool after every element already in the queue has been processed, and waits for the consumers to exit.
+ * No element may be enqueued once this has been called.
+ */
+void Autoscaler_stop(Autoscaler* this);
+
+/*
+ * Destroys this Autoscaler by freeing the memory used by the Autoscaler, stopping it first if needed.
+ * The queue is owned by the caller and isn't destroyed.
+ */
+void Autoscaler_destroy(Autoscaler* this);
+
+#endif /* AUTOSCALER_H_ */
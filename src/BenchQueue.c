@@ -0,0 +1,181 @@
+/*
+ * BenchQueue.c
+ *
+ * Benchmark for every queue engine, with hardware performance counters.
+ *
+ * Producers and consumers pass a fixed number of elements through one queue as fast as possible, while
+ * perf_event_open counters (cycles, instructions, L1d and LLC misses, HITM when BENCH_HITM_EVENT is set, and
+ * context switches) run over every thread. Each counter is reported per element passed through the queue (one
+ * enqueue plus one dequeue), which helps attribute a change in throughput to misses, false sharing or syscalls.
+ * Counters the machine or perf_event_paranoid don't allow are reported as unavailable.
+ *
+ * Usage: ./BenchQueue [-e engine] [-p producers] [-c consumers] [-n elements] [-q capacity] [-r runs]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "QueueEngine.h"
+#include "PerfCounters.h"
+
+#define DEFAULT_PRODUCERS 1
+#define DEFAULT_CONSUMERS 1
+#define DEFAULT_ELEMENTS 4000000
+#define DEFAULT_CAPACITY 1024
+#define DEFAULT_RUNS 3
+#define POISON ((void*) 1)
+
+/*
+ * The settings shared by every run
+ */
+static int producers = DEFAULT_PRODUCERS;
+static int consumers = DEFAULT_CONSUMERS;
+static long elements = DEFAULT_ELEMENTS;
+static int capacity = DEFAULT_CAPACITY;
+static int runs = DEFAULT_RUNS;
+
+/*
+ * The state of the run in progress
+ */
+static const QueueEngine* engine;
+static void* bench_queue;
+static long per_producer;
+
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec/1e9;
+}
+
+void* producer(void* arg) {
+    (void) arg;
+    // Elements are never dereferenced, they only need to be distinct from NULL and POISON
+    for (long i = 0; i < per_producer; i++) {
+        (*engine).enq(bench_queue, (void*) (uintptr_t) (i + 2));
+    }
+    return NULL;
+}
+
+void* consumer(void* arg) {
+    (void) arg;
+    while ((*engine).deq(bench_queue) != POISON) {
+        continue;
+    }
+    return NULL;
+}
+
+/*
+ * Passes the elements through one engine runs times, printing the time and counters per element of each run.
+ * Returns false if the queue couldn't be created.
+ */
+bool bench(const QueueEngine* benched) {
+    engine = benched;
+    int run_producers = producers;
+    int run_consumers = consumers;
+    if ((*engine).max_producers && run_producers > (*engine).max_producers) {
+        run_producers = (*engine).max_producers;
+    }
+    if ((*engine).max_consumers && run_consumers > (*engine).max_consumers) {
+        run_consumers = (*engine).max_consumers;
+    }
+    per_producer = elements/run_producers;
+    long total = per_producer*run_producers;
+    printf("%s: %d producers, %d consumers, capacity %d, %ld elements\n",
+           (*engine).name, run_producers, run_consumers, capacity, total);
+
+    printf("  %-6s %10s", "run", "ns");
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        printf(" %16s", PERF_COUNTER_NAMES[i]);
+    }
+    printf("   (per element)\n");
+
+    for (int run = 1; run <= runs; run++) {
+        bench_queue = (*engine).create(capacity);
+        if (bench_queue == NULL) {
+            printf("%s: could not create queue\n", (*engine).name);
+            return false;
+        }
+        pthread_t producer_threads[run_producers];
+        pthread_t consumer_threads[run_consumers];
+
+        // The counters are started first so that they are inherited by every thread of the run
+        PerfCounters counters;
+        PerfCounters_start(&counters);
+        double start = now_seconds();
+        for (int i = 0; i < run_consumers; i++) {
+            pthread_create(&consumer_threads[i], NULL, consumer, NULL);
+        }
+        for (int i = 0; i < run_producers; i++) {
+            pthread_create(&producer_threads[i], NULL, producer, NULL);
+        }
+        for (int i = 0; i < run_producers; i++) {
+            pthread_join(producer_threads[i], NULL);
+        }
+        for (int i = 0; i < run_consumers; i++) {
+            (*engine).enq(bench_queue, POISON);
+        }
+        for (int i = 0; i < run_consumers; i++) {
+            pthread_join(consumer_threads[i], NULL);
+        }
+        double elapsed = now_seconds() - start;
+        PerfCounters_stop(&counters);
+        (*engine).destroy(bench_queue);
+
+        printf("  %-6d %10.1f", run, elapsed*1e9/total);
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            if (PerfCounters_available(&counters, i)) {
+                printf(" %16.3f", counters.values[i]/total);
+            }
+            else {
+                printf(" %16s", "unavailable");
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* engine_name = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "e:p:c:n:q:r:")) != -1) {
+        switch (option) {
+            case 'e': engine_name = optarg; break;
+            case 'p': producers = atoi(optarg); break;
+            case 'c': consumers = atoi(optarg); break;
+            case 'n': elements = atol(optarg); break;
+            case 'q': capacity = atoi(optarg); break;
+            case 'r': runs = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-e engine] [-p producers] [-c consumers] [-n elements] [-q capacity] [-r runs]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (producers < 1 || consumers < 1 || elements < producers || capacity < 1 || runs < 1) {
+        fprintf(stderr, "Invalid benchmark settings\n");
+        return EXIT_FAILURE;
+    }
+    if (engine_name != NULL && QueueEngine_find(engine_name) == NULL) {
+        fprintf(stderr, "Unknown engine '%s'\n", engine_name);
+        return EXIT_FAILURE;
+    }
+
+    // Benchmark the selected engine, or every engine in turn
+    bool created = true;
+    for (int i = 0; i < QUEUE_ENGINE_COUNT; i++) {
+        if (engine_name == NULL || strcmp(engine_name, QUEUE_ENGINES[i].name) == 0) {
+            created = bench(&QUEUE_ENGINES[i]) && created;
+        }
+    }
+
+    printf("\nBenchmark complete.\n----------------\n");
+    return created ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -5,14 +5,48 @@
  *
  */
 
+#define _GNU_SOURCE
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <errno.h>
+#include <sched.h>
+#include <time.h>
 
 #include "BlockingQueue.h"
+#include "QueueProbes.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000L
+#define NANOSECONDS_PER_MICROSECOND 1000L
+#define ARRIVAL_HISTORY 8 // The weight of the previous average when averaging in a new observation of the arrival rate
+#define WAKE_LOCAL_SCAN 4 // How many of the most recently parked consumers BLOCKING_QUEUE_WAKE_LOCAL looks through
+
+struct BlockingQueueWaiter {
+    /*
+     * A BlockingQueueWaiter struct has 4 attributes, and lives on the stack of the consumer it stands for:
+     *      - next: The waiter parked just before it;
+     *      - cpu: The processor the consumer parked on;
+     *      - woken: Whether a producer has taken the waiter off the stack to wake it, only touched with mutex_wait held;
+     *      - cond: The condition variable the consumer sleeps on, with mutex_wait.
+     */
+    BlockingQueueWaiter* next;
+    int cpu;
+    bool woken;
+    pthread_cond_t cond;
+};
+
+/*
+ * The semaphores of the probes fired by this module.
+ */
+QUEUE_PROBE_SEMAPHORE(enq);
+QUEUE_PROBE_SEMAPHORE(enq_block);
+QUEUE_PROBE_SEMAPHORE(enq_wake);
+QUEUE_PROBE_SEMAPHORE(deq);
+QUEUE_PROBE_SEMAPHORE(deq_block);
+QUEUE_PROBE_SEMAPHORE(deq_wake);
 
 /*
  * The functions below all return default values and don't work.
@@ -21,12 +55,37 @@
 
 
 BlockingQueue *new_BlockingQueue(int max_size) {
-    // Initialise the blocking queue
-    BlockingQueue* this = malloc(sizeof(BlockingQueue));
+    return new_BlockingQueueWithAllocator(max_size, QueueAllocator_malloc());
+}
+
+BlockingQueue* new_BlockingQueueWithAllocator(int max_size, QueueAllocator allocator) {
+    // Initialise the blocking queue, aligned so that its producer and consumer sides sit on separate cache lines
+    BlockingQueue* this = aligned_alloc(CACHE_LINE_SIZE, sizeof(BlockingQueue));
+    if (this == NULL) {
+        return NULL;
+    }
 
     // Initialise the blocking queue's Queue object and maximum capacity
-    (*this).queue = new_Queue(max_size);
-    (*this).capacity = max_size;
+    (*this).queue = new_QueueWithAllocator(max_size, allocator);
+    if ((*this).queue == NULL) {
+        free(this);
+        return NULL;
+    }
+    atomic_init(&(*this).capacity, max_size);
+    (*this).policy = BLOCKING_QUEUE_BLOCK;
+    (*this).wakeup = BLOCKING_QUEUE_WAKE_KERNEL;
+    atomic_init(&(*this).trace, NULL);
+    atomic_init(&(*this).snapshots, ZERO);
+    atomic_init(&(*this).draining, false);
+    atomic_init(&(*this).dropped, ZERO);
+    (*this).reserved = ZERO;
+    (*this).peeked = ZERO;
+    atomic_init(&(*this).peeking, ZERO);
+    (*this).arrival_ns = ZERO;
+    (*this).sampled_ns = ZERO;
+    (*this).sampled_rear = ZERO;
+    (*this).waiters = NULL;
+    atomic_init(&(*this).parked, ZERO);
 
     // Initialise the blocking queue's mutexes, and check that they've been created properly
     if (pthread_mutex_init(&(*this).mutex_enq, NULL)) {
@@ -35,6 +94,12 @@ BlockingQueue *new_BlockingQueue(int max_size) {
     if (pthread_mutex_init(&(*this).mutex_deq, NULL)) {
         exit_error(this, "Mutex 'mutex_deq' not created!");
     }
+    if (pthread_mutex_init(&(*this).mutex_resize, NULL)) {
+        exit_error(this, "Mutex 'mutex_resize' not created!");
+    }
+    if (pthread_mutex_init(&(*this).mutex_wait, NULL)) {
+        exit_error(this, "Mutex 'mutex_wait' not created!");
+    }
 
     // Initialise the blocking queue's semaphores, and check that they've been created properly
     if (sem_init(&(*this).sem_enq, ZERO, max_size)) {
@@ -47,45 +112,478 @@ BlockingQueue *new_BlockingQueue(int max_size) {
     return this;
 }
 
-bool BlockingQueue_enq(BlockingQueue* this, void* element) {
-    // Decrement the sem_enq semaphore and check that it has been done
+/*
+ * Returns the number of elements in this blocking queue for the probes. The counters are read without ordering,
+ * which costs two plain loads: a tracer only needs a recent value.
+ */
+static inline long probe_size(BlockingQueue* this) {
+    return (long) (atomic_load_explicit(&(*(*this).queue).rear, memory_order_relaxed)
+            - atomic_load_explicit(&(*(*this).queue).front, memory_order_relaxed));
+}
+
+/*
+ * Records count events to this blocking queue's trace, if it is recording.
+ */
+static inline void trace_event(BlockingQueue* this, QueueTraceEvent event, int count) {
+    QueueTrace* trace = atomic_load_explicit(&(*this).trace, memory_order_acquire);
+    if (trace != NULL) {
+        QueueTrace_record(trace, event, count);
+    }
+}
+
+/*
+ * Decrements the sem_enq semaphore for the given element, waiting if needed, and checks that it has been done.
+ * While either probe is traced, a producer that has to wait fires enq_block before waiting and enq_wake once it has
+ * space. Otherwise it waits straight away, without first trying whether it has to.
+ */
+static void wait_space(BlockingQueue* this, void* element) {
+    if (QUEUE_PROBE_ENABLED(enq_block) || QUEUE_PROBE_ENABLED(enq_wake)) {
+        if (sem_trywait(&(*this).sem_enq) == ZERO) {
+            return;
+        }
+        QUEUE_PROBE(enq_block, this, element, probe_size(this));
+    }
     if (sem_wait(&(*this).sem_enq)) {
         exit_error(this, "Semaphore 'sem_enq' not decremented!");
     }
+    QUEUE_PROBE(enq_wake, this, element, probe_size(this));
+}
+
+/*
+ * Wakes up to count of the consumers parked on the waiter stack, once as many elements have been posted to sem_deq.
+ * Does nothing under the BLOCKING_QUEUE_WAKE_KERNEL policy, where sem_post has already woken a consumer.
+ */
+static void wake_consumers(BlockingQueue* this, int count) {
+    if ((*this).wakeup == BLOCKING_QUEUE_WAKE_KERNEL || count < ONE) {
+        return;
+    }
+    /*
+     * sem_post is only a release operation, so on its own it may become visible after this load of parked. The fence
+     * pairs with the one in park_consumer: either the consumer's sem_trywait after parking sees the element, or this
+     * load sees the consumer parked.
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(*this).parked, memory_order_relaxed) == ZERO) {
+        return;
+    }
+    int cpu = (*this).wakeup == BLOCKING_QUEUE_WAKE_LOCAL ? sched_getcpu() : -ONE;
+    // Lock the mutex_wait mutex and check that it has been done
+    if (pthread_mutex_lock(&(*this).mutex_wait)) {
+        exit_error(this, "Mutex 'mutex_wait' not locked!");
+    }
+    for (int i = 0; i < count && (*this).waiters != NULL; i++) {
+        // Take the most recently parked waiter, or under the LOCAL policy a recent one that parked on this processor
+        BlockingQueueWaiter** chosen = &(*this).waiters;
+        BlockingQueueWaiter** link = &(*this).waiters;
+        for (int j = 0; cpu >= ZERO && *link != NULL && j < WAKE_LOCAL_SCAN; j++, link = &(**link).next) {
+            if ((**link).cpu == cpu) {
+                chosen = link;
+                break;
+            }
+        }
+        BlockingQueueWaiter* waiter = *chosen;
+        *chosen = (*waiter).next;
+        atomic_fetch_sub_explicit(&(*this).parked, ONE, memory_order_relaxed);
+        (*waiter).woken = true;
+        if (pthread_cond_signal(&(*waiter).cond)) {
+            exit_error(this, "Condition 'cond' not signalled!");
+        }
+    }
+    // Unlock the mutex_wait mutex and check that it has been done
+    if (pthread_mutex_unlock(&(*this).mutex_wait)) {
+        exit_error(this, "Mutex 'mutex_wait' not unlocked!");
+    }
+}
+
+/*
+ * Takes the given waiter back off the waiter stack, with mutex_wait held.
+ */
+static void unpark(BlockingQueue* this, BlockingQueueWaiter* waiter) {
+    for (BlockingQueueWaiter** link = &(*this).waiters; *link != NULL; link = &(**link).next) {
+        if (*link == waiter) {
+            *link = (*waiter).next;
+            atomic_fetch_sub_explicit(&(*this).parked, ONE, memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+/*
+ * Parks the calling consumer on top of the waiter stack until it has claimed an element through sem_deq, for the LIFO
+ * and LOCAL wakeup policies, or until the given CLOCK_MONOTONIC deadline has passed if it isn't NULL.
+ * Returns true if an element was claimed, and false if the deadline passed first.
+ */
+static bool park_consumer(BlockingQueue* this, const struct timespec* deadline) {
+    BlockingQueueWaiter waiter;
+    waiter.cpu = sched_getcpu();
+    // The condition waits against the same clock as the deadline
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&waiter.cond, &attributes)) {
+        exit_error(this, "Condition 'cond' not created!");
+    }
+    pthread_condattr_destroy(&attributes);
+    bool claimed = false;
+    bool timed_out = false;
+    while (!claimed && !timed_out) {
+        // Push the waiter on top of the stack
+        if (pthread_mutex_lock(&(*this).mutex_wait)) {
+            exit_error(this, "Mutex 'mutex_wait' not locked!");
+        }
+        waiter.woken = false;
+        waiter.next = (*this).waiters;
+        (*this).waiters = &waiter;
+        atomic_fetch_add_explicit(&(*this).parked, ONE, memory_order_relaxed);
+        if (pthread_mutex_unlock(&(*this).mutex_wait)) {
+            exit_error(this, "Mutex 'mutex_wait' not unlocked!");
+        }
+
+        // Check again for an element posted before the producer could see this consumer parked. The fence pairs with
+        // the one in wake_consumers, keeping the increment above before sem_trywait's load
+        atomic_thread_fence(memory_order_seq_cst);
+        claimed = sem_trywait(&(*this).sem_deq) == ZERO;
+
+        if (pthread_mutex_lock(&(*this).mutex_wait)) {
+            exit_error(this, "Mutex 'mutex_wait' not locked!");
+        }
+        if (claimed && !waiter.woken) {
+            unpark(this, &waiter); // An element arrived while parking: no producer will wake the waiter any more
+        }
+        while (!claimed && !waiter.woken && !timed_out) {
+            int waited = deadline == NULL ? pthread_cond_wait(&waiter.cond, &(*this).mutex_wait)
+                    : pthread_cond_timedwait(&waiter.cond, &(*this).mutex_wait, deadline);
+            if (waited == ETIMEDOUT) {
+                timed_out = true;
+            }
+            else if (waited) {
+                exit_error(this, "Condition 'cond' not waited on!");
+            }
+        }
+        if (timed_out && !waiter.woken) {
+            unpark(this, &waiter); // Out of time: no producer may wake the waiter once it is gone
+        }
+        else {
+            timed_out = false; // Woken for an element just as the deadline passed: still try to claim it
+        }
+        if (pthread_mutex_unlock(&(*this).mutex_wait)) {
+            exit_error(this, "Mutex 'mutex_wait' not unlocked!");
+        }
+
+        // Woken for an element, or out of time: claim one, or park again if another consumer got there first
+        if (!claimed) {
+            claimed = sem_trywait(&(*this).sem_deq) == ZERO;
+        }
+    }
+    pthread_cond_destroy(&waiter.cond);
+    if (!claimed) {
+        return false;
+    }
+
+    // A consumer woken while it claimed an element by itself leaves the element it was woken for: pass the wakeup on
+    int available;
+    if (atomic_load_explicit(&(*this).parked, memory_order_relaxed) > ZERO
+            && sem_getvalue(&(*this).sem_deq, &available) == ZERO && available > ZERO) {
+        wake_consumers(this, ONE);
+    }
+    return true;
+}
+
+/*
+ * Decrements the sem_deq semaphore, waiting if needed, and checks that it has been done. If deadline isn't NULL, waits
+ * at most until that CLOCK_MONOTONIC time, so that a wall clock change can't stretch or cut the wait.
+ * Under the LIFO and LOCAL wakeup policies, a consumer that has to wait parks on the waiter stack instead of sem_deq.
+ * While either probe is traced, a consumer that has to wait fires deq_block before waiting, and deq_wake once it has
+ * an element or its deadline has passed.
+ * Returns true if an element was claimed, and false if the deadline passed first.
+ */
+static bool wait_element(BlockingQueue* this, const struct timespec* deadline) {
+    if ((*this).wakeup != BLOCKING_QUEUE_WAKE_KERNEL) {
+        if (sem_trywait(&(*this).sem_deq) == ZERO) {
+            return true;
+        }
+        QUEUE_PROBE(deq_block, this, NULL, probe_size(this));
+        bool claimed = park_consumer(this, deadline);
+        QUEUE_PROBE(deq_wake, this, NULL, probe_size(this));
+        return claimed;
+    }
+    if (QUEUE_PROBE_ENABLED(deq_block) || QUEUE_PROBE_ENABLED(deq_wake)) {
+        if (sem_trywait(&(*this).sem_deq) == ZERO) {
+            return true;
+        }
+        QUEUE_PROBE(deq_block, this, NULL, probe_size(this));
+    }
+    bool claimed = true;
+    while (deadline == NULL ? sem_wait(&(*this).sem_deq) : sem_clockwait(&(*this).sem_deq, CLOCK_MONOTONIC, deadline)) {
+        if (errno == ETIMEDOUT) {
+            claimed = false;
+            break;
+        }
+        if (errno != EINTR) {
+            exit_error(this, "Semaphore 'sem_deq' not decremented!");
+        }
+    }
+    QUEUE_PROBE(deq_wake, this, NULL, probe_size(this));
+    return claimed;
+}
+
+/*
+ * Increments the given semaphore count times, and checks that it has been done.
+ */
+static void post_many(BlockingQueue* this, sem_t* semaphore, int count, char* msg) {
+    for (int i = 0; i < count; i++) {
+        if (sem_post(semaphore)) {
+            exit_error(this, msg);
+        }
+    }
+}
+
+/*
+ * Increments the sem_deq semaphore once per element made available to consumers, and wakes as many parked consumers.
+ */
+static void post_elements(BlockingQueue* this, int count) {
+    post_many(this, &(*this).sem_deq, count, "Semaphore 'sem_deq' not incremented!");
+    wake_consumers(this, count);
+}
+
+/*
+ * Claims one element through sem_deq, exactly as a consumer would, so that no consumer waits for it.
+ * Since consumers take elements from the front in the order they claim them, the unclaimed elements are the newest.
+ * Returns false if consumers have already claimed every element.
+ */
+static bool claim_unclaimed(BlockingQueue* this) {
+    if (sem_trywait(&(*this).sem_deq) == ZERO) {
+        return true;
+    }
+    if (errno != EAGAIN) {
+        exit_error(this, "Semaphore 'sem_deq' not decremented!");
+    }
+    return false;
+}
+
+/*
+ * Locks the mutex_deq mutex for a producer making room, waiting for ordinary consumers, which only hold it for a few
+ * instructions, but not for a peek, which may hold it for as long as its consumer processes the peeked elements.
+ * A peek announces itself in peeking before it takes mutex_deq, so the producer tries the lock again for as long as
+ * no peek is outstanding.
+ * Returns false, locking nothing, while a peek is outstanding.
+ */
+static bool lock_front(BlockingQueue* this) {
+    for (;;) {
+        if (atomic_load(&(*this).peeking) > ZERO) {
+            return false;
+        }
+        int locked = pthread_mutex_trylock(&(*this).mutex_deq);
+        if (locked == ZERO) {
+            return true;
+        }
+        if (locked != EBUSY) {
+            exit_error(this, "Mutex 'mutex_deq' not locked!");
+        }
+        sched_yield();
+    }
+}
+
+/*
+ * Makes room for a producer by dequeuing the oldest element, with an element already claimed through sem_deq.
+ * The producer then keeps the element's slot. If a peek is outstanding, the claim is handed back instead.
+ * Returns false, evicting nothing, while a peek is outstanding.
+ */
+static bool evict_oldest(BlockingQueue* this, void** evicted) {
+    if (!lock_front(this)) {
+        post_elements(this, ONE);
+        return false;
+    }
+    void* oldest = Queue_deq((*this).queue);
+    trace_event(this, QUEUE_TRACE_DROP, ONE);
+    if (pthread_mutex_unlock(&(*this).mutex_deq)) {
+        exit_error(this, "Mutex 'mutex_deq' not unlocked!");
+    }
+    atomic_fetch_add_explicit(&(*this).dropped, ONE, memory_order_relaxed);
+    if (evicted != NULL) {
+        *evicted = oldest;
+    }
+    return true;
+}
+
+/*
+ * Overwrites the oldest element with the given one, like a circular log, with an element already claimed through
+ * sem_deq. Both sides are stopped while the oldest element is dequeued and the new one enqueued, so the queue never
+ * looks to have a free slot in between: on a full array, the new element lands in the oldest element's slot.
+ * The claim is handed back afterwards, as the number of elements hasn't changed, or straight away while a peek is
+ * outstanding.
+ * Returns false, overwriting nothing, while a peek is outstanding.
+ */
+static bool overwrite_oldest(BlockingQueue* this, void* element, void** evicted) {
+    // Lock mutex_enq before mutex_deq, in the same order as BlockingQueue_resize
+    if (pthread_mutex_lock(&(*this).mutex_enq)) {
+        exit_error(this, "Mutex 'mutex_enq' not locked!");
+    }
+    bool locked = lock_front(this);
+    void* oldest = NULL;
+    if (locked) {
+        oldest = Queue_deq((*this).queue);
+        Queue_enq((*this).queue, element);
+        trace_event(this, QUEUE_TRACE_OVERWRITE, ONE);
+        if (pthread_mutex_unlock(&(*this).mutex_deq)) {
+            exit_error(this, "Mutex 'mutex_deq' not unlocked!");
+        }
+    }
+    if (pthread_mutex_unlock(&(*this).mutex_enq)) {
+        exit_error(this, "Mutex 'mutex_enq' not unlocked!");
+    }
+    post_elements(this, ONE);
+    if (!locked) {
+        return false;
+    }
+    atomic_fetch_add_explicit(&(*this).dropped, ONE, memory_order_relaxed);
+    if (evicted != NULL) {
+        *evicted = oldest;
+    }
+    return true;
+}
+
+/*
+ * Takes one slot of space in this blocking queue for a producer, following the queue's overflow policy.
+ * Stores true in stored if the policy already stored the element, by overwriting the oldest one.
+ * Returns false if the element should be rejected instead.
+ */
+static bool claim_space(BlockingQueue* this, void* element, void** evicted, bool* stored) {
+    *stored = false;
+    // Decrement the sem_enq semaphore, waiting if needed
+    if ((*this).policy == BLOCKING_QUEUE_BLOCK) {
+        wait_space(this, element);
+        return true;
+    }
+
+    for (;;) {
+        // Decrement the sem_enq semaphore without waiting if there is space
+        if (sem_trywait(&(*this).sem_enq) == ZERO) {
+            return true;
+        }
+        if (errno != EAGAIN) {
+            exit_error(this, "Semaphore 'sem_enq' not decremented!");
+        }
+
+        // The queue is full: drop the new element
+        if ((*this).policy == BLOCKING_QUEUE_REJECT_NEWEST) {
+            atomic_fetch_add_explicit(&(*this).dropped, ONE, memory_order_relaxed);
+            return false;
+        }
+
+        // The queue is full: evict or overwrite the oldest element, as long as a consumer hasn't claimed it
+        if (claim_unclaimed(this)) {
+            if ((*this).policy == BLOCKING_QUEUE_OVERWRITE) {
+                *stored = overwrite_oldest(this, element, evicted);
+                if (*stored) {
+                    return true;
+                }
+            }
+            else if (evict_oldest(this, evicted)) {
+                return true;
+            }
+            // A consumer is holding the front of the queue: drop the new element rather than wait for it
+            atomic_fetch_add_explicit(&(*this).dropped, ONE, memory_order_relaxed);
+            return false;
+        }
+
+        // Consumers have already claimed every element and are about to free a slot, so try again
+        sched_yield();
+    }
+}
+
+bool BlockingQueue_enq(BlockingQueue* this, void* element) {
+    return BlockingQueue_enqEvict(this, element, NULL);
+}
+
+bool BlockingQueue_enqEvict(BlockingQueue* this, void* element, void** evicted) {
+    if (evicted != NULL) {
+        *evicted = NULL;
+    }
+    // Return false straight away if the element is NULL, so that no space is claimed for it
+    if (element == NULL) {
+        return false;
+    }
+    // Claim a slot for the element, or return false if the overflow policy rejects it
+    bool stored;
+    if (!claim_space(this, element, evicted, &stored)) {
+        return false;
+    }
+    if (stored) {
+        return true;
+    }
     // Lock the mutex_enq mutex and check that it has been done
     if (pthread_mutex_lock(&(*this).mutex_enq)) {
         exit_error(this, "Mutex 'mutex_enq' not locked!");
     }
     // Enqueue the element using the Queue_enq function
     bool value = Queue_enq((*this).queue, element);
+    if (value) {
+        trace_event(this, QUEUE_TRACE_ENQ, ONE);
+    }
     // Unlock the mutex_enq mutex and check that it has been done
     if (pthread_mutex_unlock(&(*this).mutex_enq)) {
         exit_error(this, "Mutex 'mutex_enq' not unlocked!");
     }
     // Increment the sem_deq semaphore and check that it has been done if any element has been enqueued
     if (value) {
+        QUEUE_PROBE(enq, this, element, probe_size(this));
         if (sem_post(&(*this).sem_deq)) {
             exit_error(this, "Semaphore 'sem_deq' not incremented!");
         }
+        wake_consumers(this, ONE);
     }
     return value;
 }
 
-void* BlockingQueue_deq(BlockingQueue* this) {
-    // Decrement the sem_deq semaphore and check that it has been done
-    if (sem_wait(&(*this).sem_deq)) {
-        exit_error(this, "Semaphore 'sem_deq' not decremented!");
+void BlockingQueue_setPolicy(BlockingQueue* this, BlockingQueuePolicy policy) {
+    (*this).policy = policy;
+}
+
+void BlockingQueue_setWakeup(BlockingQueue* this, BlockingQueueWakeup wakeup) {
+    (*this).wakeup = wakeup;
+}
+
+int BlockingQueue_parked(BlockingQueue* this) {
+    return atomic_load_explicit(&(*this).parked, memory_order_relaxed);
+}
+
+long BlockingQueue_dropped(BlockingQueue* this) {
+    return atomic_load_explicit(&(*this).dropped, memory_order_relaxed);
+}
+
+void BlockingQueue_record(BlockingQueue* this, QueueTrace* trace) {
+    atomic_store_explicit(&(*this).trace, trace, memory_order_release);
+}
+
+/*
+ * Adds the given number of nanoseconds to a deadline.
+ */
+static void extend_deadline(struct timespec* deadline, long ns) {
+    (*deadline).tv_sec += ns/NANOSECONDS_PER_SECOND;
+    (*deadline).tv_nsec += ns%NANOSECONDS_PER_SECOND;
+    if ((*deadline).tv_nsec >= NANOSECONDS_PER_SECOND) {
+        (*deadline).tv_sec++;
+        (*deadline).tv_nsec -= NANOSECONDS_PER_SECOND;
     }
+}
+
+/*
+ * Dequeues one element that has already been claimed through sem_deq.
+ */
+static void* take_one(BlockingQueue* this) {
     // Lock the mutex_deq mutex and check that it has been done
     if (pthread_mutex_lock(&(*this).mutex_deq)) {
         exit_error(this, "Mutex 'mutex_deq' not locked!");
     }
     // Dequeue the element using the Queue_deq function
     void* value = Queue_deq((*this).queue);
+    trace_event(this, QUEUE_TRACE_DEQ, ONE);
     // Unlock the mutex_deq mutex and check that it has been done
     if (pthread_mutex_unlock(&(*this).mutex_deq)) {
         exit_error(this, "Mutex 'mutex_deq' not unlocked!");
     }
+    QUEUE_PROBE(deq, this, value, probe_size(this));
     // Increment the sem_enq semaphore and check that it has been done
     if (sem_post(&(*this).sem_enq)) {
         exit_error(this, "Semaphore 'sem_enq' not incremented!");
@@ -93,15 +591,352 @@ void* BlockingQueue_deq(BlockingQueue* this) {
     return value;
 }
 
+void* BlockingQueue_deq(BlockingQueue* this) {
+    // Decrement the sem_deq semaphore, waiting if needed
+    wait_element(this, NULL);
+    return take_one(this);
+}
+
+void* BlockingQueue_deqTimed(BlockingQueue* this, long timeout_us) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    extend_deadline(&deadline, timeout_us > ZERO ? timeout_us*NANOSECONDS_PER_MICROSECOND : ZERO);
+    // Decrement the sem_deq semaphore, waiting until the deadline if needed
+    if (!wait_element(this, &deadline)) {
+        return NULL;
+    }
+    return take_one(this);
+}
+
+/*
+ * Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+static long monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+/*
+ * Updates the average time between arrivals from the number of elements enqueued since the last observation,
+ * with mutex_deq held. The Queue's rear already counts every element ever enqueued, so producers pay nothing for it.
+ */
+static void sample_arrivals(BlockingQueue* this) {
+    long now = monotonic_ns();
+    size_t rear = atomic_load_explicit(&(*(*this).queue).rear, memory_order_acquire);
+    if ((*this).sampled_ns != ZERO && now > (*this).sampled_ns) {
+        // A cleared queue restarts rear from 0, which counts as no arrivals
+        size_t arrived = rear > (*this).sampled_rear ? rear - (*this).sampled_rear : ZERO;
+        // Without any arrival, the time since the last observation is still a lower bound on the time between them
+        long sample = (now - (*this).sampled_ns)/(arrived > ZERO ? (long) arrived : ONE);
+        if ((*this).arrival_ns == ZERO) {
+            (*this).arrival_ns = sample;
+        }
+        else {
+            (*this).arrival_ns = ((*this).arrival_ns*(ARRIVAL_HISTORY - 1) + sample)/ARRIVAL_HISTORY;
+        }
+    }
+    (*this).sampled_ns = now;
+    (*this).sampled_rear = rear;
+}
+
+/*
+ * Dequeues count elements that have already been claimed through sem_deq into the given array.
+ * If adaptive is true, also observes the arrival rate and returns the linger (in ns) for the rest of the batch,
+ * given that it still has room for missing elements and must not linger longer than max_linger_ns.
+ */
+static long take_claimed(BlockingQueue* this, void** elements, int count, bool adaptive, int missing, long max_linger_ns) {
+    long linger_ns = ZERO;
+    // Lock the mutex_deq mutex and check that it has been done
+    if (pthread_mutex_lock(&(*this).mutex_deq)) {
+        exit_error(this, "Mutex 'mutex_deq' not locked!");
+    }
+    // Dequeue the elements using the Queue_deq function
+    for (int i = 0; i < count; i++) {
+        elements[i] = Queue_deq((*this).queue);
+        QUEUE_PROBE(deq, this, elements[i], probe_size(this));
+    }
+    trace_event(this, QUEUE_TRACE_DEQ, count);
+    if (adaptive) {
+        sample_arrivals(this);
+        long fill_ns = (*this).arrival_ns*missing;
+        if (fill_ns <= max_linger_ns) {
+            linger_ns = fill_ns; // Under load: wait just long enough to fill the batch
+        }
+        else if ((*this).arrival_ns <= max_linger_ns) {
+            linger_ns = max_linger_ns; // Moderate load: the batch won't fill, but is still worth growing
+        }
+        // Otherwise idle: don't add any latency waiting for elements that aren't coming
+    }
+    // Unlock the mutex_deq mutex and check that it has been done
+    if (pthread_mutex_unlock(&(*this).mutex_deq)) {
+        exit_error(this, "Mutex 'mutex_deq' not unlocked!");
+    }
+    // Increment the sem_enq semaphore once per element and check that it has been done
+    for (int i = 0; i < count; i++) {
+        if (sem_post(&(*this).sem_enq)) {
+            exit_error(this, "Semaphore 'sem_enq' not incremented!");
+        }
+    }
+    return linger_ns;
+}
+
+/*
+ * Claims as many more elements as are available right now through sem_deq, up to max_claims.
+ * Returns the number of claimed elements.
+ */
+static int claim_available(BlockingQueue* this, int max_claims) {
+    int claimed = ZERO;
+    while (claimed < max_claims && sem_trywait(&(*this).sem_deq) == ZERO) {
+        claimed++;
+    }
+    return claimed;
+}
+
+static int deq_batch(BlockingQueue* this, void** elements, int max_elements, long linger_ns, bool adaptive) {
+    if (max_elements <= ZERO) {
+        return ZERO;
+    }
+    // Decrement the sem_deq semaphore for the first element, waiting if needed
+    wait_element(this, NULL);
+
+    // The linger starts now: take the first element along with everything else that is already there
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    int count = ONE + claim_available(this, max_elements - ONE);
+    long tuned_ns = take_claimed(this, elements, count, adaptive, max_elements - count, linger_ns);
+    if (adaptive) {
+        linger_ns = tuned_ns;
+    }
+    extend_deadline(&deadline, linger_ns);
+
+    // Keep collecting elements as they arrive until the batch is full or the linger is over
+    while (count < max_elements && linger_ns > ZERO) {
+        if (!wait_element(this, &deadline)) {
+            break;
+        }
+        int claimed = ONE + claim_available(this, max_elements - count - ONE);
+        take_claimed(this, elements + count, claimed, false, ZERO, ZERO);
+        count += claimed;
+    }
+    return count;
+}
+
+int BlockingQueue_deqBatch(BlockingQueue* this, void** elements, int max_elements, long linger_us) {
+    return deq_batch(this, elements, max_elements, linger_us*NANOSECONDS_PER_MICROSECOND, false);
+}
+
+int BlockingQueue_deqBatchAdaptive(BlockingQueue* this, void** elements, int max_elements, long max_linger_us) {
+    return deq_batch(this, elements, max_elements, max_linger_us*NANOSECONDS_PER_MICROSECOND, true);
+}
+
+void* _Atomic* BlockingQueue_reserve(BlockingQueue* this, int n, int* count) {
+    *count = ZERO;
+    if (n < ONE) {
+        return NULL;
+    }
+    // Claim one slot, waiting if needed, along with as many more as are free right now
+    wait_space(this, NULL);
+    int claimed = ONE;
+    while (claimed < n && sem_trywait(&(*this).sem_enq) == ZERO) {
+        claimed++;
+    }
+    // Lock the mutex_enq mutex until the reservation is committed, and check that it has been done
+    if (pthread_mutex_lock(&(*this).mutex_enq)) {
+        exit_error(this, "Mutex 'mutex_enq' not locked!");
+    }
+    void* _Atomic* slots = Queue_reserve((*this).queue, claimed, count);
+    (*this).reserved = *count;
+    // The span stops at the end of the array: hand back the slots beyond it
+    post_many(this, &(*this).sem_enq, claimed - *count, "Semaphore 'sem_enq' not incremented!");
+    return slots;
+}
+
+bool BlockingQueue_commit(BlockingQueue* this, int n) {
+    int reserved = (*this).reserved;
+    if (n < ZERO || n > reserved || !Queue_commit((*this).queue, n)) {
+        return false;
+    }
+    trace_event(this, QUEUE_TRACE_ENQ, n);
+    (*this).reserved = ZERO;
+    // Unlock the mutex_enq mutex and check that it has been done
+    if (pthread_mutex_unlock(&(*this).mutex_enq)) {
+        exit_error(this, "Mutex 'mutex_enq' not unlocked!");
+    }
+    // Increment sem_deq once per committed element, and sem_enq once per reserved slot left unused
+    post_elements(this, n);
+    post_many(this, &(*this).sem_enq, reserved - n, "Semaphore 'sem_enq' not incremented!");
+    return true;
+}
+
+void** BlockingQueue_peek(BlockingQueue* this, int n, int* count) {
+    *count = ZERO;
+    if (n < ONE) {
+        return NULL;
+    }
+    // Claim one element, waiting if needed, along with as many more as are available right now
+    wait_element(this, NULL);
+    int claimed = ONE + claim_available(this, n - ONE);
+    // Announce the peek before taking mutex_deq, so that evicting producers stop waiting for it
+    atomic_fetch_add(&(*this).peeking, ONE);
+    // Lock the mutex_deq mutex until the elements are released, and check that it has been done
+    if (pthread_mutex_lock(&(*this).mutex_deq)) {
+        exit_error(this, "Mutex 'mutex_deq' not locked!");
+    }
+    void** elements = Queue_peek((*this).queue, claimed, count);
+    (*this).peeked = *count;
+    // The span stops at the end of the array: hand back the elements beyond it
+    post_elements(this, claimed - *count);
+    return elements;
+}
+
+bool BlockingQueue_release(BlockingQueue* this, int n) {
+    int peeked = (*this).peeked;
+    if (n < ZERO || n > peeked || !Queue_release((*this).queue, n)) {
+        return false;
+    }
+    trace_event(this, QUEUE_TRACE_DEQ, n);
+    (*this).peeked = ZERO;
+    // Unlock the mutex_deq mutex and check that it has been done
+    if (pthread_mutex_unlock(&(*this).mutex_deq)) {
+        exit_error(this, "Mutex 'mutex_deq' not unlocked!");
+    }
+    atomic_fetch_sub(&(*this).peeking, ONE);
+    // Increment sem_enq once per released slot, and sem_deq once per peeked element left in the queue
+    post_many(this, &(*this).sem_enq, n, "Semaphore 'sem_enq' not incremented!");
+    post_elements(this, peeked - n);
+    return true;
+}
+
+bool BlockingQueue_resize(BlockingQueue* this, int new_capacity) {
+    if (new_capacity < ONE) {
+        return false;
+    }
+    // Lock the mutex_resize mutex, so that concurrent resizes don't both compute from the same old capacity
+    if (pthread_mutex_lock(&(*this).mutex_resize)) {
+        exit_error(this, "Mutex 'mutex_resize' not locked!");
+    }
+    int old_capacity = atomic_load_explicit(&(*this).capacity, memory_order_relaxed); // Only resizes write it
+
+    /*
+     * When shrinking, first take away the space that is going: decrement sem_enq once per removed slot, waiting for
+     * consumers to free slots if needed. Producers keep using the remaining space in the meantime, and once this is
+     * done at most new_capacity elements can be in the queue.
+     */
+    for (int i = new_capacity; i < old_capacity; i++) {
+        if (sem_wait(&(*this).sem_enq)) {
+            exit_error(this, "Semaphore 'sem_enq' not decremented!");
+        }
+    }
+
+    // Obtain the new array before stopping anyone, so that the allocator isn't called with both sides stopped
+    void* _Atomic* arr = Queue_allocateArray((*this).queue, new_capacity);
+    int arr_capacity = new_capacity;
+    bool resized = false;
+    if (arr != NULL) {
+        // Stop both sides just long enough to move the elements into the new array
+        if (pthread_mutex_lock(&(*this).mutex_enq)) {
+            exit_error(this, "Mutex 'mutex_enq' not locked!");
+        }
+        if (pthread_mutex_lock(&(*this).mutex_deq)) {
+            exit_error(this, "Mutex 'mutex_deq' not locked!");
+        }
+        resized = Queue_swapArray((*this).queue, &arr, &arr_capacity);
+        if (resized) {
+            atomic_store_explicit(&(*this).capacity, new_capacity, memory_order_relaxed);
+        }
+        if (pthread_mutex_unlock(&(*this).mutex_deq)) {
+            exit_error(this, "Mutex 'mutex_deq' not unlocked!");
+        }
+        if (pthread_mutex_unlock(&(*this).mutex_enq)) {
+            exit_error(this, "Mutex 'mutex_enq' not unlocked!");
+        }
+
+        /*
+         * Snapshots don't lock anything, so one may still be reading the old array: wait for those in progress to
+         * finish before giving it back. The swap published the new array with a sequentially consistent store, and
+         * snapshots register with a sequentially consistent increment before loading it, so any snapshot this load
+         * misses reads the new array. Snapshots that start in the meantime back off until draining is cleared, so
+         * the count only falls.
+         */
+        atomic_store(&(*this).draining, true);
+        while (atomic_load(&(*this).snapshots) > ZERO) {
+            sched_yield();
+        }
+        atomic_store(&(*this).draining, false);
+        Queue_releaseArray((*this).queue, arr, arr_capacity); // The old array, or the new one if the swap failed
+    }
+
+    /*
+     * Hand space to the producers by incrementing sem_enq once per slot:
+     *      - When growing, once per added slot;
+     *      - When shrinking failed, once per slot taken away above.
+     */
+    int added = resized ? new_capacity - old_capacity : ZERO;
+    int restored = resized ? ZERO : old_capacity - new_capacity;
+    for (int i = 0; i < added || i < restored; i++) {
+        if (sem_post(&(*this).sem_enq)) {
+            exit_error(this, "Semaphore 'sem_enq' not incremented!");
+        }
+    }
+
+    if (pthread_mutex_unlock(&(*this).mutex_resize)) {
+        exit_error(this, "Mutex 'mutex_resize' not unlocked!");
+    }
+    return resized;
+}
+
 int BlockingQueue_size(BlockingQueue* this) {
     return Queue_size((*this).queue); // Queue_size returns the number of elements currently in this blocking queue
 }
 
+int BlockingQueue_capacity(BlockingQueue* this) {
+    return atomic_load_explicit(&(*this).capacity, memory_order_relaxed);
+}
+
+void* BlockingQueue_front(BlockingQueue* this) {
+    void* element = NULL;
+    BlockingQueue_snapshot(this, &element, ONE);
+    return element;
+}
+
+int BlockingQueue_snapshot(BlockingQueue* this, void** elements, int max_elements) {
+    /*
+     * Register the snapshot, so that a resize keeps the array it may read until it is over. While a resize waits for
+     * the snapshots already registered, back off instead: registering would only keep it waiting longer. The check
+     * comes after registering, so a resize that starts waiting in between still sees this snapshot, which is then
+     * quickly withdrawn.
+     */
+    for (;;) {
+        atomic_fetch_add(&(*this).snapshots, ONE);
+        if (!atomic_load(&(*this).draining)) {
+            break;
+        }
+        atomic_fetch_sub(&(*this).snapshots, ONE);
+        while (atomic_load(&(*this).draining)) {
+            sched_yield();
+        }
+    }
+    QueueIterator iterator;
+    int count;
+    do {
+        // Walk again from the new array if the queue was resized or cleared during the walk
+        Queue_iterate((*this).queue, &iterator);
+        count = ZERO;
+        while (count < max_elements && QueueIterator_next(&iterator, &elements[count])) {
+            count++;
+        }
+    } while (!QueueIterator_valid(&iterator));
+    atomic_fetch_sub(&(*this).snapshots, ONE);
+    return count;
+}
+
 bool BlockingQueue_isEmpty(BlockingQueue* this) {
     return Queue_isEmpty((*this).queue); // Queue_isEmpty returns true if this blocking queue is empty, false otherwise
 }
 
 void BlockingQueue_clear(BlockingQueue* this) {
+    trace_event(this, QUEUE_TRACE_DROP, Queue_size((*this).queue)); // Every element still there is dropped
     Queue_clear((*this).queue); // Queue_clear clears this blocking queue returning it to an empty state
 
     // Access the semaphores' current values, and check that they've been accessed properly
@@ -115,7 +950,8 @@ void BlockingQueue_clear(BlockingQueue* this) {
     }
 
     // Reset the blocking queue's semaphores to their original values, and check that they've been reset properly
-    for (int i = value_enq; i < (*this).capacity; i++) {
+    int capacity = BlockingQueue_capacity(this);
+    for (int i = value_enq; i < capacity; i++) {
         if (sem_post(&(*this).sem_enq)) {
             exit_error(this, "Semaphore 'sem_enq' not reset!");
         }
@@ -129,9 +965,11 @@ void BlockingQueue_clear(BlockingQueue* this) {
 }
 
 void BlockingQueue_destroy(BlockingQueue* this) {
-    // Destroy both mutexes
+    // Destroy all four mutexes
     pthread_mutex_destroy(&(*this).mutex_enq);
     pthread_mutex_destroy(&(*this).mutex_deq);
+    pthread_mutex_destroy(&(*this).mutex_resize);
+    pthread_mutex_destroy(&(*this).mutex_wait);
 
     // Destroy both semaphores
     sem_destroy(&(*this).sem_enq);
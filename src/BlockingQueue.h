@@ -13,22 +13,101 @@
 #include <semaphore.h>
 
 #include "Queue.h"
+#include "QueueTrace.h"
 
 typedef struct BlockingQueue BlockingQueue;
+typedef struct BlockingQueueWaiter BlockingQueueWaiter;
+
+/*
+ * What BlockingQueue_enq does when the queue is full:
+ *      - BLOCKING_QUEUE_BLOCK: Wait until a consumer frees a slot (the default);
+ *      - BLOCKING_QUEUE_REJECT_NEWEST: Drop the new element and return false straight away;
+ *      - BLOCKING_QUEUE_EVICT_OLDEST: Dequeue the oldest element to make room and hand it back to the producer;
+ *      - BLOCKING_QUEUE_OVERWRITE: Overwrite the oldest element with the new one, like a circular log, handing the
+ *        overwritten one back to the producer. Unlike an eviction, the queue never looks to have a free slot between
+ *        dropping the oldest element and storing the new one.
+ * The last two policies wait for consumers that are dequeuing, which only takes them a few instructions, but not
+ * for a consumer holding the front of the queue between BlockingQueue_peek and BlockingQueue_release: while a peek is
+ * outstanding, the new element is rejected as under BLOCKING_QUEUE_REJECT_NEWEST instead.
+ * The producer never waits for a consumer to free a slot under the last three policies. Dropped elements, evicted or
+ * overwritten, are only handed back by BlockingQueue_enqEvict, so producers that own their elements should use it.
+ */
+typedef enum BlockingQueuePolicy {
+    BLOCKING_QUEUE_BLOCK,
+    BLOCKING_QUEUE_REJECT_NEWEST,
+    BLOCKING_QUEUE_EVICT_OLDEST,
+    BLOCKING_QUEUE_OVERWRITE
+} BlockingQueuePolicy;
+
+/*
+ * Which consumer an element wakes when consumers are waiting for one:
+ *      - BLOCKING_QUEUE_WAKE_KERNEL: Whichever consumer the kernel picks among those waiting on sem_deq (the default);
+ *      - BLOCKING_QUEUE_WAKE_LIFO: The consumer that started waiting most recently, whose cache is the warmest, so that
+ *        under light load a few consumers handle every element while the others stay asleep;
+ *      - BLOCKING_QUEUE_WAKE_LOCAL: Like BLOCKING_QUEUE_WAKE_LIFO, but preferring one of the most recent few that
+ *        started waiting on the producer's processor, which then shares the element's cache lines.
+ */
+typedef enum BlockingQueueWakeup {
+    BLOCKING_QUEUE_WAKE_KERNEL,
+    BLOCKING_QUEUE_WAKE_LIFO,
+    BLOCKING_QUEUE_WAKE_LOCAL
+} BlockingQueueWakeup;
 
 /* You should define your struct BlockingQueue here */
 struct BlockingQueue {
     /*
-     * A BlockingQueue struct has 6 attributes:
+     * A BlockingQueue struct has 22 attributes:
      *      - queue: The blocking queue, represented as a Queue object;
      *      - capacity: The blocking queue's maximum capacity;
+     *      - policy: What to do when enqueueing to a full queue;
+     *      - wakeup: Which waiting consumer an element wakes;
+     *      - mutex_resize: The mutex serialising calls to BlockingQueue_resize;
+     *      - snapshots: The number of snapshots in progress, which a resize waits for before releasing the old array;
+     *      - draining: Whether a resize is waiting for snapshots, in which case new snapshots wait for it to finish;
+     *      - trace: The trace the queue's enqueues and dequeues are recorded to, or NULL when not recording;
      *      - mutex_enq and mutex_deq: The mutexes used to enqueue and dequeue elements respectively;
      *      - sem_enq and sem_deq: The semaphores used before enqueueing and dequeuing elements respectively;
+     *      - dropped: The number of elements rejected, evicted or overwritten because the queue was full;
+     *      - reserved: The number of slots held by the producer between BlockingQueue_reserve and BlockingQueue_commit;
+     *      - peeked: The number of elements held by the consumer between BlockingQueue_peek and BlockingQueue_release;
+     *      - peeking: The number of consumers holding or about to take mutex_deq for a peek, which producers making
+     *        room check without taking mutex_deq;
+     *      - arrival_ns: The average time between two enqueues, as observed by adaptive batching consumers (0 if unknown);
+     *      - sampled_ns and sampled_rear: The time and the number of elements ever enqueued at the last observation;
+     *      - mutex_wait: The mutex protecting the waiter stack;
+     *      - waiters: The waiter stack, holding the consumers parked by the LIFO and LOCAL wakeup policies, most recent first;
+     *      - parked: The number of consumers on the waiter stack, which producers check without taking mutex_wait.
+     *
+     * The producer side (mutex_enq, sem_enq, dropped, reserved) and the consumer side (mutex_deq, sem_deq, peeked and
+     * the arrival statistics, which are only touched with mutex_deq held) each get their own cache line, so that producers
+     * serialising on mutex_enq don't invalidate the line consumers are spinning on, and vice versa. The waiter stack
+     * gets a third one, which producers only ever read while no consumer parks.
      */
     Queue* queue;
-    int capacity;
-    pthread_mutex_t mutex_enq, mutex_deq;
-    sem_t sem_enq, sem_deq;
+    atomic_int capacity;
+    BlockingQueuePolicy policy;
+    BlockingQueueWakeup wakeup;
+    pthread_mutex_t mutex_resize;
+    atomic_int snapshots;
+    atomic_bool draining;
+    QueueTrace* _Atomic trace;
+
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex_enq;
+    sem_t sem_enq;
+    atomic_long dropped;
+    int reserved;
+
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex_deq;
+    sem_t sem_deq;
+    int peeked;
+    atomic_int peeking;
+    long arrival_ns;
+    long sampled_ns;
+    size_t sampled_rear;
+
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex_wait;
+    BlockingQueueWaiter* waiters;
+    atomic_int parked;
 };
 
 /*
@@ -37,13 +116,60 @@ struct BlockingQueue {
  */
 BlockingQueue* new_BlockingQueue(int max_size);
 
+/*
+ * Creates a new BlockingQueue for at most max_size void* elements, whose array is obtained from the given allocator.
+ * Returns a pointer to a new BlockingQueue on success and NULL on failure.
+ */
+BlockingQueue* new_BlockingQueueWithAllocator(int max_size, QueueAllocator allocator);
+
 /*
  * Enqueues the given void* element at the back of this Queue.
- * If the queue is full, the function will block the calling thread until there is space in the queue.
- * Returns false when element is NULL and true on success.
+ * If the queue is full, the function will follow the queue's overflow policy, by default blocking the calling thread
+ * until there is space in the queue. Elements evicted or replaced by the policy are lost: a producer that owns its
+ * elements (e.g. frees them once consumed) must use BlockingQueue_enqEvict instead, or they leak.
+ * Returns false when element is NULL or rejected by the overflow policy, and true on success.
  */
 bool BlockingQueue_enq(BlockingQueue* this, void* element);
 
+/*
+ * Enqueues the given void* element like BlockingQueue_enq.
+ * If the BLOCKING_QUEUE_EVICT_OLDEST policy had to dequeue the oldest element to make room, or the
+ * BLOCKING_QUEUE_OVERWRITE policy overwrote it, that element is stored in *evicted so that the caller can
+ * dispose of it; otherwise *evicted is set to NULL.
+ */
+bool BlockingQueue_enqEvict(BlockingQueue* this, void* element, void** evicted);
+
+/*
+ * Sets what this Queue does when an element is enqueued while it is full.
+ */
+void BlockingQueue_setPolicy(BlockingQueue* this, BlockingQueuePolicy policy);
+
+/*
+ * Sets which waiting consumer an element wakes. Consumers that have to wait for an element under the LIFO and LOCAL
+ * policies park on the queue's waiter stack instead of sem_deq, so the policy must not be changed while consumers may
+ * be waiting.
+ */
+void BlockingQueue_setWakeup(BlockingQueue* this, BlockingQueueWakeup wakeup);
+
+/*
+ * Returns the number of consumers currently parked on this Queue's waiter stack.
+ */
+int BlockingQueue_parked(BlockingQueue* this);
+
+/*
+ * Returns the number of elements rejected, evicted or overwritten so far because this Queue was full.
+ */
+long BlockingQueue_dropped(BlockingQueue* this);
+
+/*
+ * Starts recording every element enqueued to, dequeued from or dropped by this Queue to the given trace, or stops
+ * recording if trace is NULL. Each event is recorded while the side's mutex is held, so the trace keeps the queue's
+ * order of enqueues and of dequeues; recording is best started while the queue is empty, so that every dequeued
+ * element's enqueue is in the trace. Costs a single load per operation while not recording.
+ * The trace must not be destroyed while it may still be recorded to.
+ */
+void BlockingQueue_record(BlockingQueue* this, QueueTrace* trace);
+
 /*
  * Dequeues an element from the front of this Queue.
  * If the queue is empty, the function will block until an element can be dequeued.
@@ -52,10 +178,96 @@ bool BlockingQueue_enq(BlockingQueue* this, void* element);
 void* BlockingQueue_deq(BlockingQueue* this);
 
 /*
- * Returns the number of elements currently in this Queue.
+ * Dequeues an element from the front of this Queue like BlockingQueue_deq, waiting at most timeout_us microseconds
+ * for one, under any wakeup policy.
+ * Returns the dequeued void* element, or NULL if the queue stayed empty until the timeout.
+ */
+void* BlockingQueue_deqTimed(BlockingQueue* this, long timeout_us);
+
+/*
+ * Dequeues up to max_elements elements from the front of this Queue into the given array, oldest first.
+ * If the queue is empty, the function will block until an element can be dequeued, and then keep collecting elements
+ * for up to linger_us microseconds from that moment, returning as soon as max_elements have been dequeued.
+ * Returns the number of dequeued elements.
+ */
+int BlockingQueue_deqBatch(BlockingQueue* this, void** elements, int max_elements, long linger_us);
+
+/*
+ * Dequeues a batch like BlockingQueue_deqBatch, but tunes the linger from the observed arrival rate:
+ * it lingers just long enough to fill the batch at that rate, or for max_linger_us if that is too short to fill it,
+ * and not at all if not even one more element is expected within max_linger_us.
+ * Returns the number of dequeued elements.
+ */
+int BlockingQueue_deqBatchAdaptive(BlockingQueue* this, void** elements, int max_elements, long max_linger_us);
+
+/*
+ * Reserves up to n free slots at the back of this Queue, for the calling producer to write elements into directly
+ * with relaxed atomic stores (see Queue_reserve). If the queue is full, the function will block until there is space,
+ * whatever the overflow policy. Other producers wait until the reservation is committed.
+ * Stores the number of reserved slots (at least 1 if n >= 1) in count, and returns a pointer to the first one,
+ * or NULL if n < 1.
+ */
+void* _Atomic* BlockingQueue_reserve(BlockingQueue* this, int n, int* count);
+
+/*
+ * Publishes the first n slots of the calling producer's reservation, which must all hold non-NULL elements,
+ * and ends the reservation, handing the slots that weren't used back to the producers.
+ * Returns false if n is negative or more than the number of reserved slots, in which case the reservation stays open.
+ */
+bool BlockingQueue_commit(BlockingQueue* this, int n);
+
+/*
+ * Gives the calling consumer access to up to n elements at the front of this Queue, to read them in place
+ * (see Queue_peek). If the queue is empty, the function will block until an element is available.
+ * Other consumers wait until the elements are released.
+ * Stores the number of elements (at least 1 if n >= 1) in count, and returns a pointer to the first one,
+ * or NULL if n < 1.
+ */
+void** BlockingQueue_peek(BlockingQueue* this, int n, int* count);
+
+/*
+ * Dequeues the first n elements of the calling consumer's peek, and ends the peek, leaving the other elements
+ * at the front of the queue for the next consumer.
+ * Returns false if n is negative or more than the number of peeked elements, in which case the peek stays open.
+ */
+bool BlockingQueue_release(BlockingQueue* this, int n);
+
+/*
+ * Changes the maximum capacity of this Queue to new_capacity while producers and consumers keep running.
+ * Elements keep their FIFO order. When shrinking, the function will block until consumers have made enough room
+ * for the remaining elements to fit.
+ * Returns true on success and false if new_capacity is not positive or the new array cannot be allocated.
+ */
+bool BlockingQueue_resize(BlockingQueue* this, int new_capacity);
+
+/*
+ * Returns the number of elements currently in this Queue, without taking any lock (see Queue_size).
  */
 int BlockingQueue_size(BlockingQueue* this);
 
+/*
+ * Returns the maximum capacity of this Queue, which a concurrent BlockingQueue_resize may change at any time.
+ */
+int BlockingQueue_capacity(BlockingQueue* this);
+
+/*
+ * Returns the element at the front of this Queue without dequeuing it, or NULL if the queue is empty.
+ * Like BlockingQueue_snapshot, it doesn't take any lock.
+ */
+void* BlockingQueue_front(BlockingQueue* this);
+
+/*
+ * Copies up to max_elements of the elements currently in this Queue into the given array, oldest first, without
+ * dequeuing them (see QueueIterator_next). It doesn't take any lock, so that a monitoring thread can inspect the
+ * queue while producers and consumers keep running. It doesn't wait for a resize moving the elements: if one does
+ * during the copy, the copy starts again from the new array, while the resize keeps the old one until the copy is
+ * over. Only once the resize waits for such copies does a new snapshot wait, until they are over, so that snapshots
+ * taken back to back can't keep the resize waiting forever.
+ * Reserved slots only show up once they are committed.
+ * Returns the number of copied elements.
+ */
+int BlockingQueue_snapshot(BlockingQueue* this, void** elements, int max_elements);
+
 /*
  * Returns true if this Queue is empty, false otherwise.
  */
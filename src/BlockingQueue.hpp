@@ -0,0 +1,279 @@
+/*
+ * BlockingQueue.hpp
+ *
+ * Header-only C++ counterparts of Queue and BlockingQueue, storing elements of any type T directly in the ring
+ * instead of as void* pointers, so that no element is allocated or boxed and any value (nullptr included) can be
+ * enqueued. They live in the typed namespace, so that they can be used next to the C modules.
+ *
+ */
+
+#ifndef BLOCKING_QUEUE_HPP_
+#define BLOCKING_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <semaphore>
+#include <stdexcept>
+#include <utility>
+
+namespace typed {
+
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+/*
+ * A fixed-size ring of T elements, laid out and synchronised like the C Queue: rear and front count the elements ever
+ * enqueued and dequeued, each on its own cache line with a stale copy of the other one. One producer thread and one
+ * consumer thread may use it at the same time without locking; any other concurrent use must be serialised.
+ */
+template <typename T>
+class Queue {
+public:
+    /*
+     * Creates a new Queue for at most capacity elements.
+     * Throws std::invalid_argument if capacity is less than 1.
+     */
+    explicit Queue(int capacity)
+            : capacity_(capacity > 0 ? capacity : throw std::invalid_argument("Queue capacity must be positive")),
+              slots_(std::make_unique<Slot[]>(capacity)) {}
+
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
+    /*
+     * Destroys the elements still in the queue.
+     */
+    ~Queue() {
+        while (try_pop()) {
+        }
+    }
+
+    /*
+     * Constructs an element at the back of this Queue from the given arguments, in place.
+     * Returns false, constructing nothing, if the queue is full.
+     */
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        // Only the producer writes rear, so it can be read without synchronisation
+        std::size_t rear = rear_.load(std::memory_order_relaxed);
+        // The queue looks full from the cached front: re-read the real front, and return false if it is still full
+        if (rear - front_cache_ == static_cast<std::size_t>(capacity_)) {
+            front_cache_ = front_.load(std::memory_order_acquire);
+            if (rear - front_cache_ == static_cast<std::size_t>(capacity_)) {
+                return false;
+            }
+        }
+        // Construct the element in its slot, then publish it to the consumer
+        ::new (slot(rear)) T(std::forward<Args>(args)...);
+        rear_.store(rear + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * Enqueues a copy of (or moves) the given element at the back of this Queue.
+     * Returns false if the queue is full.
+     */
+    bool try_push(const T& element) { return try_emplace(element); }
+    bool try_push(T&& element) { return try_emplace(std::move(element)); }
+
+    /*
+     * Dequeues the element at the front of this Queue, moving it out of its slot.
+     * Returns the element, or std::nullopt if the queue is empty.
+     */
+    std::optional<T> try_pop() {
+        // Only the consumer writes front, so it can be read without synchronisation
+        std::size_t front = front_.load(std::memory_order_relaxed);
+        // The queue looks empty from the cached rear: re-read the real rear, and return nothing if it is still empty
+        if (front == rear_cache_) {
+            rear_cache_ = rear_.load(std::memory_order_acquire);
+            if (front == rear_cache_) {
+                return std::nullopt;
+            }
+        }
+        // Move the element out and destroy what is left of it, then hand its slot back to the producer
+        T* element = std::launder(slot(front));
+        std::optional<T> popped(std::move(*element));
+        element->~T();
+        front_.store(front + 1, std::memory_order_release);
+        return popped;
+    }
+
+    /*
+     * Returns the number of elements currently in this Queue.
+     */
+    int size() const {
+        // Read front before rear, so that rear can only be newer and the difference is never negative
+        std::size_t front = front_.load(std::memory_order_acquire);
+        std::size_t rear = rear_.load(std::memory_order_acquire);
+        return rear - front > static_cast<std::size_t>(capacity_) ? capacity_ : static_cast<int>(rear - front);
+    }
+
+    /*
+     * Returns true if this Queue is empty, false otherwise.
+     */
+    bool empty() const { return size() == 0; }
+
+    /*
+     * Returns the maximum number of elements this Queue can hold.
+     */
+    int capacity() const { return capacity_; }
+
+private:
+    /*
+     * Uninitialised storage for one element, constructed on enqueue and destroyed on dequeue.
+     */
+    struct Slot {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    T* slot(std::size_t position) {
+        return reinterpret_cast<T*>(slots_[position % capacity_].bytes);
+    }
+
+    // Cold attributes, only written when the queue is created
+    const int capacity_;
+    const std::unique_ptr<Slot[]> slots_;
+
+    // Producer-owned cache line
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> rear_{0};
+    std::size_t front_cache_ = 0;
+
+    // Consumer-owned cache line
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> front_{0};
+    std::size_t rear_cache_ = 0;
+};
+
+/*
+ * A fixed-size blocking queue of T elements, with the same blocking semantics as the C BlockingQueue: sem_enq counts
+ * the free slots and sem_deq the elements, mutex_enq serialises producers and mutex_deq consumers, and the ring
+ * underneath is a Queue<T> that sees a single producer and a single consumer at a time.
+ */
+template <typename T>
+class BlockingQueue {
+public:
+    /*
+     * Creates a new BlockingQueue for at most capacity elements.
+     * Throws std::invalid_argument if capacity is less than 1.
+     */
+    explicit BlockingQueue(int capacity) : queue_(capacity), sem_enq_(capacity), sem_deq_(0) {}
+
+    BlockingQueue(const BlockingQueue&) = delete;
+    BlockingQueue& operator=(const BlockingQueue&) = delete;
+
+    /*
+     * Constructs an element at the back of this Queue from the given arguments, in place.
+     * If the queue is full, the function will block the calling thread until there is space in the queue.
+     */
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        sem_enq_.acquire();
+        enq_claimed(std::forward<Args>(args)...);
+    }
+
+    /*
+     * Enqueues a copy of (or moves) the given element at the back of this Queue, blocking while the queue is full.
+     */
+    void push(const T& element) { emplace(element); }
+    void push(T&& element) { emplace(std::move(element)); }
+
+    /*
+     * Constructs an element at the back of this Queue from the given arguments, in place, without blocking.
+     * Returns false, constructing nothing, if the queue is full.
+     */
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        if (!sem_enq_.try_acquire()) {
+            return false;
+        }
+        enq_claimed(std::forward<Args>(args)...);
+        return true;
+    }
+
+    /*
+     * Enqueues a copy of (or moves) the given element at the back of this Queue without blocking.
+     * Returns false if the queue is full.
+     */
+    bool try_push(const T& element) { return try_emplace(element); }
+    bool try_push(T&& element) { return try_emplace(std::move(element)); }
+
+    /*
+     * Dequeues the element at the front of this Queue.
+     * If the queue is empty, the function will block until an element can be dequeued.
+     */
+    T pop() {
+        sem_deq_.acquire();
+        return deq_claimed();
+    }
+
+    /*
+     * Dequeues the element at the front of this Queue without blocking.
+     * Returns the element, or std::nullopt if the queue is empty.
+     */
+    std::optional<T> try_pop() {
+        if (!sem_deq_.try_acquire()) {
+            return std::nullopt;
+        }
+        return deq_claimed();
+    }
+
+    /*
+     * Returns the number of elements currently in this Queue.
+     */
+    int size() const { return queue_.size(); }
+
+    /*
+     * Returns true if this Queue is empty, false otherwise.
+     */
+    bool empty() const { return queue_.empty(); }
+
+    /*
+     * Returns the maximum number of elements this Queue can hold.
+     */
+    int capacity() const { return queue_.capacity(); }
+
+private:
+    /*
+     * Enqueues an element into a slot already claimed from sem_enq, and hands it to the consumers.
+     * If constructing the element throws, the slot is handed back to the producers instead.
+     */
+    template <typename... Args>
+    void enq_claimed(Args&&... args) {
+        try {
+            std::lock_guard<std::mutex> lock(mutex_enq_);
+            queue_.try_emplace(std::forward<Args>(args)...); // Never full: the slot was claimed
+        }
+        catch (...) {
+            sem_enq_.release();
+            throw;
+        }
+        sem_deq_.release();
+    }
+
+    /*
+     * Dequeues an element already claimed from sem_deq, and hands its slot back to the producers.
+     */
+    T deq_claimed() {
+        std::unique_lock<std::mutex> lock(mutex_deq_);
+        std::optional<T> element = queue_.try_pop(); // Never empty: the element was claimed
+        lock.unlock();
+        sem_enq_.release();
+        return std::move(*element);
+    }
+
+    Queue<T> queue_;
+
+    // Producer side
+    alignas(CACHE_LINE_SIZE) std::mutex mutex_enq_;
+    std::counting_semaphore<> sem_enq_;
+
+    // Consumer side
+    alignas(CACHE_LINE_SIZE) std::mutex mutex_deq_;
+    std::counting_semaphore<> sem_deq_;
+};
+
+} // namespace typed
+
+#endif /* BLOCKING_QUEUE_HPP_ */
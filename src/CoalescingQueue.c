@@ -0,0 +1,230 @@
+/*
+ * CoalescingQueue.c
+ *
+ * Fixed-size keyed last-value queue implementation, with an open-addressing hash index over the ring.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "CoalescingQueue.h"
+
+#define ZERO 0
+#define ONE 1
+#define EMPTY -1
+
+/*
+ * Terminates the code, destroys the coalescing queue and prints out an error message if an error is detected.
+ */
+static void exit_coalescing_error(CoalescingQueue* this, char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    CoalescingQueue_destroy(this); // Destroy the coalescing queue
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+/*
+ * Returns the index entry the given key is looked up from first.
+ */
+static int home(CoalescingQueue* this, unsigned long key) {
+    // Mix the key's bits (splitmix64 finaliser), so that sequential keys don't fill up neighbouring entries
+    uint64_t hash = key;
+    hash = (hash ^ (hash >> 30))*0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27))*0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return (int) (hash & (*this).index_mask);
+}
+
+/*
+ * Returns the index entry holding the given key's ring position, or the empty entry where it would go if it isn't
+ * pending. The index is never more than half full, so there always is an empty entry to stop at.
+ */
+static int find_entry(CoalescingQueue* this, unsigned long key) {
+    int entry = home(this, key);
+    while ((*this).index[entry] != EMPTY && (*this).keys[(*this).index[entry]] != key) {
+        entry = (entry + ONE) & (*this).index_mask;
+    }
+    return entry;
+}
+
+/*
+ * Empties the given index entry, shifting back the entries after it in the same probe run so that every key can
+ * still be found from its home entry without going through an empty one (and no tombstones are needed).
+ */
+static void remove_entry(CoalescingQueue* this, int hole) {
+    int entry = hole;
+    for (;;) {
+        entry = (entry + ONE) & (*this).index_mask;
+        if ((*this).index[entry] == EMPTY) {
+            break;
+        }
+        // The entry can fill the hole unless its home lies cyclically after the hole, up to the entry itself
+        int start = home(this, (*this).keys[(*this).index[entry]]);
+        bool stays = hole < entry ? (start > hole && start <= entry) : (start > hole || start <= entry);
+        if (!stays) {
+            (*this).index[hole] = (*this).index[entry];
+            hole = entry;
+        }
+    }
+    (*this).index[hole] = EMPTY;
+}
+
+
+CoalescingQueue* new_CoalescingQueue(int max_keys) {
+    if (max_keys < ONE) {
+        return NULL;
+    }
+    CoalescingQueue* this = calloc(ONE, sizeof(CoalescingQueue));
+    if (this == NULL) {
+        return NULL;
+    }
+    // The index has a power of two size at least twice the capacity, which keeps probe runs short
+    int index_size = ONE;
+    while (index_size < 2*max_keys) {
+        index_size *= 2;
+    }
+    (*this).capacity = max_keys;
+    (*this).index_mask = index_size - ONE;
+    (*this).keys = malloc(sizeof(unsigned long)*max_keys);
+    (*this).values = malloc(sizeof(void*)*max_keys);
+    (*this).index = malloc(sizeof(int)*index_size);
+    if ((*this).keys == NULL || (*this).values == NULL || (*this).index == NULL) {
+        free((*this).keys);
+        free((*this).values);
+        free((*this).index);
+        free(this);
+        return NULL;
+    }
+    for (int i = 0; i < index_size; i++) {
+        (*this).index[i] = EMPTY;
+    }
+
+    // Initialise the mutex and the condition variables, and check that they've been created properly
+    if (pthread_mutex_init(&(*this).mutex, NULL)) {
+        exit_coalescing_error(this, "Mutex 'mutex' not created!");
+    }
+    if (pthread_cond_init(&(*this).cond_enq, NULL)) {
+        exit_coalescing_error(this, "Condition 'cond_enq' not created!");
+    }
+    if (pthread_cond_init(&(*this).cond_deq, NULL)) {
+        exit_coalescing_error(this, "Condition 'cond_deq' not created!");
+    }
+    return this;
+}
+
+bool CoalescingQueue_enq(CoalescingQueue* this, unsigned long key, void* element, void** replaced) {
+    if (replaced != NULL) {
+        *replaced = NULL;
+    }
+    if (element == NULL) {
+        return false;
+    }
+    // Lock the mutex and check that it has been done
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_coalescing_error(this, "Mutex 'mutex' not locked!");
+    }
+
+    for (;;) {
+        int entry = find_entry(this, key);
+        if ((*this).index[entry] != EMPTY) {
+            // The key is pending: replace its element where it is
+            int slot = (*this).index[entry];
+            if (replaced != NULL) {
+                *replaced = (*this).values[slot];
+            }
+            (*this).values[slot] = element;
+            (*this).coalesced++;
+            break;
+        }
+        if ((*this).size < (*this).capacity) {
+            // The key isn't pending: add it to the back of the ring, and to the index
+            int slot = ((*this).front + (*this).size) % (*this).capacity;
+            (*this).keys[slot] = key;
+            (*this).values[slot] = element;
+            (*this).index[entry] = slot;
+            (*this).size++;
+            if (pthread_cond_signal(&(*this).cond_deq)) {
+                exit_coalescing_error(this, "Condition 'cond_deq' not signalled!");
+            }
+            break;
+        }
+        // Full of other keys: wait for one to be dequeued, then look the key up again as it may be pending by now
+        if (pthread_cond_wait(&(*this).cond_enq, &(*this).mutex)) {
+            exit_coalescing_error(this, "Condition 'cond_enq' not waited on!");
+        }
+    }
+
+    // Unlock the mutex and check that it has been done
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_coalescing_error(this, "Mutex 'mutex' not unlocked!");
+    }
+    return true;
+}
+
+void* CoalescingQueue_deq(CoalescingQueue* this, unsigned long* key) {
+    // Lock the mutex and check that it has been done
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_coalescing_error(this, "Mutex 'mutex' not locked!");
+    }
+    // Wait for a key to be pending
+    while ((*this).size == ZERO) {
+        if (pthread_cond_wait(&(*this).cond_deq, &(*this).mutex)) {
+            exit_coalescing_error(this, "Condition 'cond_deq' not waited on!");
+        }
+    }
+
+    // Take the oldest key off the ring, and out of the index so that its next element goes to the back again
+    int slot = (*this).front;
+    unsigned long taken = (*this).keys[slot];
+    void* element = (*this).values[slot];
+    remove_entry(this, find_entry(this, taken));
+    (*this).front = (slot + ONE) % (*this).capacity;
+    (*this).size--;
+    if (pthread_cond_signal(&(*this).cond_enq)) {
+        exit_coalescing_error(this, "Condition 'cond_enq' not signalled!");
+    }
+
+    // Unlock the mutex and check that it has been done
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_coalescing_error(this, "Mutex 'mutex' not unlocked!");
+    }
+    if (key != NULL) {
+        *key = taken;
+    }
+    return element;
+}
+
+long CoalescingQueue_coalesced(CoalescingQueue* this) {
+    pthread_mutex_lock(&(*this).mutex);
+    long coalesced = (*this).coalesced;
+    pthread_mutex_unlock(&(*this).mutex);
+    return coalesced;
+}
+
+int CoalescingQueue_size(CoalescingQueue* this) {
+    pthread_mutex_lock(&(*this).mutex);
+    int size = (*this).size;
+    pthread_mutex_unlock(&(*this).mutex);
+    return size;
+}
+
+bool CoalescingQueue_isEmpty(CoalescingQueue* this) {
+    return CoalescingQueue_size(this) == ZERO;
+}
+
+void CoalescingQueue_destroy(CoalescingQueue* this) {
+    // Destroy the mutex and both condition variables
+    pthread_mutex_destroy(&(*this).mutex);
+    pthread_cond_destroy(&(*this).cond_enq);
+    pthread_cond_destroy(&(*this).cond_deq);
+
+    // Free the ring and the index, then the coalescing queue itself
+    free((*this).keys);
+    free((*this).values);
+    free((*this).index);
+    free(this);
+}
@@ -0,0 +1,85 @@
+/*
+ * CoalescingQueue.h
+ *
+ * Module interface for a fixed-size keyed last-value queue: enqueueing an element for a key that is already pending
+ * replaces the pending element in place, so consumers only ever see the latest element of each key.
+ *
+ */
+
+#ifndef COALESCING_QUEUE_H_
+#define COALESCING_QUEUE_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct CoalescingQueue CoalescingQueue;
+
+struct CoalescingQueue {
+    /*
+     * A CoalescingQueue struct has 12 attributes:
+     *      - capacity: The maximum number of pending keys;
+     *      - keys and values: The ring of pending keys and their latest elements, in the order the keys were enqueued;
+     *      - front and size: The ring position of the oldest pending key, and the number of pending keys;
+     *      - index and index_mask: An open-addressing hash table (linear probing, with a power of two size at least
+     *        twice the capacity) mapping each pending key to its ring position, with -1 marking an empty entry;
+     *      - coalesced: The number of elements replaced by a newer element of the same key;
+     *      - mutex: Protects every other attribute;
+     *      - cond_enq and cond_deq: Signalled when a key is dequeued and enqueued respectively.
+     */
+    int capacity;
+    unsigned long* keys;
+    void** values;
+    int front;
+    int size;
+    int* index;
+    int index_mask;
+    long coalesced;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_enq;
+    pthread_cond_t cond_deq;
+};
+
+/*
+ * Creates a new CoalescingQueue for at most max_keys pending keys.
+ * Returns a pointer to a new CoalescingQueue on success and NULL on failure.
+ */
+CoalescingQueue* new_CoalescingQueue(int max_keys);
+
+/*
+ * Enqueues the given void* element for the given key.
+ * If the key is already pending, its element is replaced, keeping the key's place in the queue, and the replaced
+ * element is stored in *replaced (if replaced isn't NULL) so that the caller can dispose of it; otherwise *replaced
+ * is set to NULL and the key goes to the back of the queue. If the key isn't pending and the queue is full,
+ * the function will block the calling thread until a key is dequeued (or the key becomes pending).
+ * Returns false when element is NULL and true on success.
+ */
+bool CoalescingQueue_enq(CoalescingQueue* this, unsigned long key, void* element, void** replaced);
+
+/*
+ * Dequeues the oldest pending key, storing it in *key (if key isn't NULL).
+ * If the queue is empty, the function will block until a key is enqueued.
+ * Returns the latest void* element enqueued for the key.
+ */
+void* CoalescingQueue_deq(CoalescingQueue* this, unsigned long* key);
+
+/*
+ * Returns the number of elements replaced so far by a newer element of the same key.
+ */
+long CoalescingQueue_coalesced(CoalescingQueue* this);
+
+/*
+ * Returns the number of keys currently pending in this CoalescingQueue.
+ */
+int CoalescingQueue_size(CoalescingQueue* this);
+
+/*
+ * Returns true if this CoalescingQueue is empty, false otherwise.
+ */
+bool CoalescingQueue_isEmpty(CoalescingQueue* this);
+
+/*
+ * Destroys this CoalescingQueue by freeing the memory used by the CoalescingQueue.
+ */
+void CoalescingQueue_destroy(CoalescingQueue* this);
+
+#endif /* COALESCING_QUEUE_H_ */
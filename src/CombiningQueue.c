@@ -0,0 +1,213 @@
+/*
+ * CombiningQueue.c
+ *
+ * Fixed-size generic flat-combining queue implementation.
+ *
+ * The semaphores claim space and elements exactly as in a BlockingQueue, so the combiner never meets a request it
+ * can't apply. What flat combining replaces is mutex_enq and mutex_deq: instead of every thread taking a mutex and
+ * touching the ring in turn, each thread writes its request to its own slot, and one thread applies them all.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "CombiningQueue.h"
+
+/*
+ * Every thread gets a number the first time it uses any CombiningQueue, which picks its home slot in every queue,
+ * so that up to COMBINING_QUEUE_SLOTS threads never compete for a slot.
+ */
+static _Thread_local int thread_number = -ONE;
+static atomic_int last_thread_number;
+
+/*
+ * Terminates the code, destroys the combining queue and prints out an error message if an error is detected.
+ */
+static void exit_combining_error(CombiningQueue* this, char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    CombiningQueue_destroy(this); // Destroy the combining queue
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+/*
+ * Applies every pending request, in slot order, with the combiner lock held.
+ */
+static void combine(CombiningQueue* this) {
+    int used = atomic_load_explicit(&(*this).used, memory_order_acquire);
+    long applied = ZERO;
+    for (int i = 0; i < used; i++) {
+        CombiningSlot* slot = &(*this).slots[i];
+        int state = atomic_load_explicit(&(*slot).state, memory_order_acquire);
+        if (state == COMBINING_ENQ) {
+            Queue_enq((*this).queue, (*slot).element); // Never full: the requester claimed a slot from sem_enq
+        }
+        else if (state == COMBINING_DEQ) {
+            (*slot).element = Queue_deq((*this).queue); // Never empty: the requester claimed an element from sem_deq
+        }
+        else {
+            continue;
+        }
+        atomic_store_explicit(&(*slot).state, COMBINING_DONE, memory_order_release);
+        applied++;
+    }
+    // Only the combiner writes the counters, so they need no read-modify-write
+    if (applied > ZERO) {
+        atomic_store_explicit(&(*this).passes, atomic_load_explicit(&(*this).passes, memory_order_relaxed) + ONE,
+                              memory_order_relaxed);
+        atomic_store_explicit(&(*this).combined, atomic_load_explicit(&(*this).combined, memory_order_relaxed) + applied,
+                              memory_order_relaxed);
+    }
+}
+
+/*
+ * Publishes a request in a free slot, starting from the calling thread's home slot.
+ * Returns the slot, which stays the calling thread's until it takes the result.
+ */
+static CombiningSlot* publish(CombiningQueue* this, CombiningState request, void* element) {
+    if (thread_number < ZERO) {
+        thread_number = atomic_fetch_add_explicit(&last_thread_number, ONE, memory_order_relaxed);
+    }
+    int home = thread_number % COMBINING_QUEUE_SLOTS;
+    for (int i = home;; i = (i + ONE) % COMBINING_QUEUE_SLOTS) {
+        CombiningSlot* slot = &(*this).slots[i];
+        int expected = COMBINING_FREE;
+        if (atomic_load_explicit(&(*slot).state, memory_order_relaxed) == COMBINING_FREE
+                && atomic_compare_exchange_strong_explicit(&(*slot).state, &expected, COMBINING_CLAIMED,
+                                                           memory_order_acquire, memory_order_relaxed)) {
+            // Make sure the combiner scans this slot
+            int used = atomic_load_explicit(&(*this).used, memory_order_relaxed);
+            while (used <= i && !atomic_compare_exchange_weak_explicit(&(*this).used, &used, i + ONE,
+                                                                      memory_order_release, memory_order_relaxed)) {
+                continue;
+            }
+            (*slot).element = element;
+            atomic_store_explicit(&(*slot).state, request, memory_order_release);
+            return slot;
+        }
+        // Every slot is taken, by more threads than there are slots: let one of them finish
+        if ((i + ONE) % COMBINING_QUEUE_SLOTS == home) {
+            sched_yield();
+        }
+    }
+}
+
+/*
+ * Waits until the request in the given slot has been applied, becoming the combiner whenever the lock is free,
+ * then frees the slot.
+ * Returns the slot's element: the dequeued element for a dequeue.
+ */
+static void* wait_done(CombiningQueue* this, CombiningSlot* slot) {
+    for (int spins = ZERO; atomic_load_explicit(&(*slot).state, memory_order_acquire) != COMBINING_DONE; spins++) {
+        if (!atomic_load_explicit(&(*this).combiner, memory_order_relaxed)
+                && !atomic_exchange_explicit(&(*this).combiner, true, memory_order_acquire)) {
+            combine(this); // Applies this thread's request too, along with any other pending one
+            atomic_store_explicit(&(*this).combiner, false, memory_order_release);
+        }
+        else if (spins >= COMBINING_QUEUE_SPINS) {
+            sched_yield(); // The combiner may be waiting for a processor
+        }
+    }
+    void* element = (*slot).element;
+    atomic_store_explicit(&(*slot).state, COMBINING_FREE, memory_order_release);
+    return element;
+}
+
+
+CombiningQueue* new_CombiningQueue(int max_size) {
+    if (max_size < ONE) {
+        return NULL;
+    }
+    // Initialise the combining queue, aligned so that the combiner lock and each slot sit on their own cache lines
+    CombiningQueue* this = aligned_alloc(CACHE_LINE_SIZE, sizeof(CombiningQueue));
+    if (this == NULL) {
+        return NULL;
+    }
+    (*this).queue = new_Queue(max_size);
+    if ((*this).queue == NULL) {
+        free(this);
+        return NULL;
+    }
+    (*this).capacity = max_size;
+    atomic_init(&(*this).combiner, false);
+    atomic_init(&(*this).used, ZERO);
+    atomic_init(&(*this).passes, ZERO);
+    atomic_init(&(*this).combined, ZERO);
+    for (int i = 0; i < COMBINING_QUEUE_SLOTS; i++) {
+        atomic_init(&(*this).slots[i].state, COMBINING_FREE);
+        (*this).slots[i].element = NULL;
+    }
+
+    // Initialise the combining queue's semaphores, and check that they've been created properly
+    if (sem_init(&(*this).sem_enq, ZERO, max_size)) {
+        exit_combining_error(this, "Semaphore 'sem_enq' not created!");
+    }
+    if (sem_init(&(*this).sem_deq, ZERO, ZERO)) {
+        exit_combining_error(this, "Semaphore 'sem_deq' not created!");
+    }
+    return this;
+}
+
+bool CombiningQueue_enq(CombiningQueue* this, void* element) {
+    // Return false straight away if the element is NULL, so that no space is claimed for it
+    if (element == NULL) {
+        return false;
+    }
+    // Decrement the sem_enq semaphore, waiting if needed, and check that it has been done
+    while (sem_wait(&(*this).sem_enq)) {
+        if (errno != EINTR) {
+            exit_combining_error(this, "Semaphore 'sem_enq' not decremented!");
+        }
+    }
+    wait_done(this, publish(this, COMBINING_ENQ, element));
+    // Increment the sem_deq semaphore and check that it has been done
+    if (sem_post(&(*this).sem_deq)) {
+        exit_combining_error(this, "Semaphore 'sem_deq' not incremented!");
+    }
+    return true;
+}
+
+void* CombiningQueue_deq(CombiningQueue* this) {
+    // Decrement the sem_deq semaphore, waiting if needed, and check that it has been done
+    while (sem_wait(&(*this).sem_deq)) {
+        if (errno != EINTR) {
+            exit_combining_error(this, "Semaphore 'sem_deq' not decremented!");
+        }
+    }
+    void* element = wait_done(this, publish(this, COMBINING_DEQ, NULL));
+    // Increment the sem_enq semaphore and check that it has been done
+    if (sem_post(&(*this).sem_enq)) {
+        exit_combining_error(this, "Semaphore 'sem_enq' not incremented!");
+    }
+    return element;
+}
+
+int CombiningQueue_size(CombiningQueue* this) {
+    return Queue_size((*this).queue);
+}
+
+bool CombiningQueue_isEmpty(CombiningQueue* this) {
+    return Queue_isEmpty((*this).queue);
+}
+
+long CombiningQueue_passes(CombiningQueue* this) {
+    return atomic_load_explicit(&(*this).passes, memory_order_relaxed);
+}
+
+long CombiningQueue_combined(CombiningQueue* this) {
+    return atomic_load_explicit(&(*this).combined, memory_order_relaxed);
+}
+
+void CombiningQueue_destroy(CombiningQueue* this) {
+    // Destroy both semaphores
+    sem_destroy(&(*this).sem_enq);
+    sem_destroy(&(*this).sem_deq);
+
+    // Free the memory used by this combining queue's Queue object, then by itself
+    Queue_destroy((*this).queue);
+    free(this);
+}
@@ -0,0 +1,122 @@
+/*
+ * CombiningQueue.h
+ *
+ * Module interface for a generic fixed-size blocking queue using flat combining: threads publish their enqueues and
+ * dequeues in per-thread request slots, and whichever thread holds the combiner lock applies every pending request
+ * to the Queue ring in one pass, so that under heavy contention the lock and the ring stay in one core's cache
+ * instead of bouncing between all of them.
+ *
+ */
+
+#ifndef COMBINING_QUEUE_H_
+#define COMBINING_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+#include "Queue.h"
+
+#define COMBINING_QUEUE_SLOTS 64    // The number of request slots: threads beyond this share slots, taking turns
+#define COMBINING_QUEUE_SPINS 64    // How many times a waiting thread checks its request before yielding the processor
+
+/*
+ * The states of a request slot:
+ *      - COMBINING_FREE: No thread is using the slot;
+ *      - COMBINING_CLAIMED: A thread is writing its request into the slot;
+ *      - COMBINING_ENQ and COMBINING_DEQ: The slot holds a pending enqueue or dequeue, for the combiner to apply;
+ *      - COMBINING_DONE: The combiner has applied the request, and the thread can take the result.
+ */
+typedef enum CombiningState {
+    COMBINING_FREE,
+    COMBINING_CLAIMED,
+    COMBINING_ENQ,
+    COMBINING_DEQ,
+    COMBINING_DONE
+} CombiningState;
+
+typedef struct CombiningSlot CombiningSlot;
+typedef struct CombiningQueue CombiningQueue;
+
+struct CombiningSlot {
+    /*
+     * A CombiningSlot struct has 2 attributes, on a cache line of its own so that requesters don't share lines:
+     *      - state: The slot's CombiningState;
+     *      - element: The element to enqueue, or the element dequeued once the request is done.
+     */
+    _Alignas(CACHE_LINE_SIZE) atomic_int state;
+    void* element;
+};
+
+struct CombiningQueue {
+    /*
+     * A CombiningQueue struct has 9 attributes:
+     *      - queue: The ring, only ever touched by the thread holding the combiner lock;
+     *      - capacity: The queue's maximum capacity;
+     *      - sem_enq and sem_deq: The semaphores counting free slots and elements, exactly as in a BlockingQueue, so
+     *        that every request reaching the combiner can be applied straight away;
+     *      - combiner: The combiner lock;
+     *      - used: The number of request slots any thread has used so far, which is all the combiner scans;
+     *      - passes and combined: The number of combining passes that applied at least one request, and of requests
+     *        they applied, whose ratio tells how much combining is happening;
+     *      - slots: The request slots.
+     */
+    Queue* queue;
+    int capacity;
+    sem_t sem_enq;
+    sem_t sem_deq;
+
+    _Alignas(CACHE_LINE_SIZE) atomic_bool combiner;
+    atomic_int used;
+    atomic_long passes;
+    atomic_long combined;
+
+    CombiningSlot slots[COMBINING_QUEUE_SLOTS];
+};
+
+/*
+ * Creates a new CombiningQueue for at most max_size void* elements.
+ * Returns a pointer to a new CombiningQueue on success and NULL on failure.
+ */
+CombiningQueue* new_CombiningQueue(int max_size);
+
+/*
+ * Enqueues the given void* element at the back of this Queue.
+ * If the queue is full, the function will block the calling thread until there is space in the queue.
+ * Returns false when element is NULL and true on success.
+ */
+bool CombiningQueue_enq(CombiningQueue* this, void* element);
+
+/*
+ * Dequeues an element from the front of this Queue.
+ * If the queue is empty, the function will block until an element can be dequeued.
+ * Returns the dequeued void* element.
+ */
+void* CombiningQueue_deq(CombiningQueue* this);
+
+/*
+ * Returns the number of elements currently in this Queue.
+ */
+int CombiningQueue_size(CombiningQueue* this);
+
+/*
+ * Returns true if this Queue is empty, false otherwise.
+ */
+bool CombiningQueue_isEmpty(CombiningQueue* this);
+
+/*
+ * Returns the number of combining passes that applied at least one request so far.
+ */
+long CombiningQueue_passes(CombiningQueue* this);
+
+/*
+ * Returns the number of requests applied by combining passes so far.
+ */
+long CombiningQueue_combined(CombiningQueue* this);
+
+/*
+ * Destroys this CombiningQueue by freeing the memory used by the CombiningQueue.
+ */
+void CombiningQueue_destroy(CombiningQueue* this);
+
+#endif /* COMBINING_QUEUE_H_ */
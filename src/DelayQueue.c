@@ -0,0 +1,380 @@
+/*
+ * DelayQueue.c
+ *
+ * Fixed-size generic DelayQueue implementation, backed by a hierarchical timing wheel.
+ *
+ * Inserting an element only appends its node to one slot of the wheel. Advancing the wheel jumps straight to the
+ * next non-empty slot using the occupied bitmaps, so the time spent expiring elements depends on the number of
+ * elements rather than the number of ticks, and each node is cascaded down at most once per level.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "DelayQueue.h"
+
+#define ZERO 0
+#define ONE 1
+#define NANOSECONDS_PER_SECOND 1000000000L
+#define NO_DEADLINE UINT64_MAX
+
+/*
+ * Terminates the code, destroys the delay queue and prints out an error message if an error is detected.
+ */
+static void exit_delay_error(DelayQueue* this, char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    DelayQueue_destroy(this); // Destroy the delay queue
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+
+static void list_append(DelayQueueList* list, DelayQueueNode* node) {
+    (*node).next = NULL;
+    if ((*list).tail == NULL) {
+        (*list).head = node;
+    }
+    else {
+        (*(*list).tail).next = node;
+    }
+    (*list).tail = node;
+}
+
+/*
+ * Empties the given list, returning its nodes as a NULL-terminated chain.
+ */
+static DelayQueueNode* list_take(DelayQueueList* list) {
+    DelayQueueNode* head = (*list).head;
+    (*list).head = NULL;
+    (*list).tail = NULL;
+    return head;
+}
+
+/*
+ * Returns the number of ticks covered by one slot of the given level.
+ */
+static uint64_t slot_ticks(int level) {
+    return ((uint64_t) ONE) << (DELAY_QUEUE_SLOT_BITS*level);
+}
+
+
+/*
+ * Places a node in the wheel relative to the current tick.
+ * A node goes to the lowest level whose window (one slot of the level above) contains both now and its deadline,
+ * which guarantees that its slot is strictly ahead of the current position of that level.
+ */
+static void wheel_insert(DelayQueue* this, DelayQueueNode* node) {
+    uint64_t deadline = (*node).deadline;
+    if (deadline <= (*this).now) {
+        list_append(&(*this).ready, node);
+        return;
+    }
+    for (int level = 0; level < DELAY_QUEUE_LEVELS; level++) {
+        int window_bits = DELAY_QUEUE_SLOT_BITS*(level + 1);
+        if ((deadline >> window_bits) == ((*this).now >> window_bits)) {
+            int slot = (deadline >> (DELAY_QUEUE_SLOT_BITS*level)) & (DELAY_QUEUE_SLOTS - 1);
+            list_append(&(*this).wheel[level][slot], node);
+            (*this).occupied[level] |= ((uint64_t) ONE) << slot;
+            return;
+        }
+    }
+    list_append(&(*this).overflow, node);
+}
+
+/*
+ * Returns the next tick at which a slot of the wheel needs to be expired or cascaded, or NO_DEADLINE if it is empty.
+ * Every slot of a level starts after every deadline held by the levels below it, so the first non-empty level wins.
+ */
+static uint64_t wheel_next_event(DelayQueue* this) {
+    for (int level = 0; level < DELAY_QUEUE_LEVELS; level++) {
+        int current = ((*this).now >> (DELAY_QUEUE_SLOT_BITS*level)) & (DELAY_QUEUE_SLOTS - 1);
+        // Only the slots strictly after the current one can be occupied
+        uint64_t later = (*this).occupied[level] & ~((((uint64_t) 2) << current) - ONE);
+        if (later != ZERO) {
+            int window_bits = DELAY_QUEUE_SLOT_BITS*(level + 1);
+            uint64_t window = ((*this).now >> window_bits) << window_bits;
+            return window | ((uint64_t) __builtin_ctzll(later) << (DELAY_QUEUE_SLOT_BITS*level));
+        }
+    }
+    if ((*this).overflow.head != NULL) {
+        int top_bits = DELAY_QUEUE_SLOT_BITS*DELAY_QUEUE_LEVELS;
+        return (((*this).now >> top_bits) + ONE) << top_bits;
+    }
+    return NO_DEADLINE;
+}
+
+/*
+ * Takes the given slot out of the wheel and re-inserts its nodes relative to the current tick.
+ */
+static void wheel_cascade(DelayQueue* this, int level, int slot) {
+    DelayQueueNode* node = list_take(&(*this).wheel[level][slot]);
+    (*this).occupied[level] &= ~(((uint64_t) ONE) << slot);
+    while (node != NULL) {
+        DelayQueueNode* next = (*node).next;
+        wheel_insert(this, node);
+        node = next;
+    }
+}
+
+/*
+ * Advances the wheel to the given tick, moving every node that has become due to the ready list.
+ */
+static void wheel_advance(DelayQueue* this, uint64_t target) {
+    while ((*this).now < target) {
+        // Jump straight to the next slot that needs attention, or to the target if nothing is due before it
+        uint64_t next = wheel_next_event(this);
+        if (next > target) {
+            (*this).now = target;
+            return;
+        }
+        (*this).now = next;
+
+        // Cascade from the top down every level whose slot starts exactly now, then expire the bottom level's slot
+        if ((next & (slot_ticks(DELAY_QUEUE_LEVELS) - ONE)) == ZERO && (*this).overflow.head != NULL) {
+            DelayQueueNode* node = list_take(&(*this).overflow);
+            while (node != NULL) {
+                DelayQueueNode* following = (*node).next;
+                wheel_insert(this, node);
+                node = following;
+            }
+        }
+        for (int level = DELAY_QUEUE_LEVELS - 1; level > ZERO; level--) {
+            if ((next & (slot_ticks(level) - ONE)) == ZERO) {
+                wheel_cascade(this, level, (next >> (DELAY_QUEUE_SLOT_BITS*level)) & (DELAY_QUEUE_SLOTS - 1));
+            }
+        }
+        wheel_cascade(this, ZERO, next & (DELAY_QUEUE_SLOTS - 1));
+    }
+}
+
+
+/*
+ * Returns the number of nanoseconds from the start of this delay queue to the given time.
+ */
+static int64_t since_start(DelayQueue* this, const struct timespec* time) {
+    return ((int64_t) (*time).tv_sec - (*this).start.tv_sec)*NANOSECONDS_PER_SECOND + ((*time).tv_nsec - (*this).start.tv_nsec);
+}
+
+/*
+ * Returns the tick the clock is currently in.
+ */
+static uint64_t current_tick(DelayQueue* this) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return since_start(this, &now)/DELAY_QUEUE_TICK_NS;
+}
+
+/*
+ * Stores the CLOCK_MONOTONIC time at which the given tick starts.
+ */
+static void tick_time(DelayQueue* this, uint64_t tick, struct timespec* time) {
+    uint64_t nanoseconds = (uint64_t) (*this).start.tv_nsec + tick*DELAY_QUEUE_TICK_NS;
+    (*time).tv_sec = (*this).start.tv_sec + nanoseconds/NANOSECONDS_PER_SECOND;
+    (*time).tv_nsec = nanoseconds%NANOSECONDS_PER_SECOND;
+}
+
+
+DelayQueue* new_DelayQueue(int max_size) {
+    // Initialise the delay queue, with every wheel slot, list and bitmap empty
+    DelayQueue* this = calloc(ONE, sizeof(DelayQueue));
+    if (this == NULL) {
+        return NULL;
+    }
+    (*this).capacity = max_size;
+    (*this).nodes = malloc(sizeof(DelayQueueNode)*(max_size > ZERO ? max_size : ONE));
+    if ((*this).nodes == NULL) {
+        free(this);
+        return NULL;
+    }
+
+    // Chain every node into the free list
+    for (int i = 0; i < max_size; i++) {
+        (*this).nodes[i].next = (*this).free;
+        (*this).free = &(*this).nodes[i];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &(*this).start);
+
+    // Initialise the mutex, and the condition variable on the same clock as the deadlines
+    if (pthread_mutex_init(&(*this).mutex, NULL)) {
+        exit_delay_error(this, "Mutex 'mutex' not created!");
+    }
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&(*this).cond_deq, &attributes)) {
+        exit_delay_error(this, "Condition 'cond_deq' not created!");
+    }
+    pthread_condattr_destroy(&attributes);
+
+    // Initialise the semaphore bounding the number of elements, as in a BlockingQueue
+    if (sem_init(&(*this).sem_enq, ZERO, max_size)) {
+        exit_delay_error(this, "Semaphore 'sem_enq' not created!");
+    }
+
+    return this;
+}
+
+bool DelayQueue_enq(DelayQueue* this, void* element, long delay_ms) {
+    struct timespec ready_at;
+    clock_gettime(CLOCK_MONOTONIC, &ready_at);
+    ready_at.tv_sec += delay_ms/1000;
+    ready_at.tv_nsec += (delay_ms%1000)*1000000L;
+    if (ready_at.tv_nsec >= NANOSECONDS_PER_SECOND) {
+        ready_at.tv_sec++;
+        ready_at.tv_nsec -= NANOSECONDS_PER_SECOND;
+    }
+    return DelayQueue_enqAt(this, element, &ready_at);
+}
+
+bool DelayQueue_enqAt(DelayQueue* this, void* element, const struct timespec* ready_at) {
+    // Return false straight away if the element is NULL, so that no space is claimed for it
+    if (element == NULL) {
+        return false;
+    }
+    // Decrement the sem_enq semaphore and check that it has been done
+    if (sem_wait(&(*this).sem_enq)) {
+        exit_delay_error(this, "Semaphore 'sem_enq' not decremented!");
+    }
+    // Lock the mutex and check that it has been done
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_delay_error(this, "Mutex 'mutex' not locked!");
+    }
+
+    /*
+     * Take a free node, and set its deadline:
+     *      - An element that is already due goes straight to the ready list (deadline 0);
+     *      - Otherwise the deadline is rounded up to a whole tick, so that the element is never dequeued early.
+     */
+    DelayQueueNode* node = (*this).free;
+    (*this).free = (*node).next;
+    (*node).element = element;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t ready = since_start(this, ready_at);
+    if (ready <= since_start(this, &now)) {
+        (*node).deadline = ZERO;
+    }
+    else {
+        (*node).deadline = (uint64_t) (ready + DELAY_QUEUE_TICK_NS - ONE)/DELAY_QUEUE_TICK_NS;
+    }
+    wheel_insert(this, node);
+    (*this).size++;
+
+    // Wake a consumer, which may have to sleep until this element's earlier deadline instead
+    if (pthread_cond_signal(&(*this).cond_deq)) {
+        exit_delay_error(this, "Condition 'cond_deq' not signalled!");
+    }
+    // Unlock the mutex and check that it has been done
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_delay_error(this, "Mutex 'mutex' not unlocked!");
+    }
+    return true;
+}
+
+/*
+ * Removes the first ready element, with the mutex held.
+ * Returns the element, or NULL if no element is due.
+ */
+static void* take_ready(DelayQueue* this) {
+    wheel_advance(this, current_tick(this));
+    DelayQueueNode* node = (*this).ready.head;
+    if (node == NULL) {
+        return NULL;
+    }
+    (*this).ready.head = (*node).next;
+    if ((*this).ready.head == NULL) {
+        (*this).ready.tail = NULL;
+    }
+    void* element = (*node).element;
+    (*node).next = (*this).free;
+    (*this).free = node;
+    (*this).size--;
+    return element;
+}
+
+/*
+ * Hands the space of a dequeued element back to the producers, with the mutex released.
+ */
+static void release_space(DelayQueue* this) {
+    if (sem_post(&(*this).sem_enq)) {
+        exit_delay_error(this, "Semaphore 'sem_enq' not incremented!");
+    }
+}
+
+void* DelayQueue_deq(DelayQueue* this) {
+    // Lock the mutex and check that it has been done
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_delay_error(this, "Mutex 'mutex' not locked!");
+    }
+
+    void* element;
+    while ((element = take_ready(this)) == NULL) {
+        // Sleep until the wheel's next deadline, or indefinitely if it is empty, unless an element is enqueued first
+        uint64_t next = wheel_next_event(this);
+        int error;
+        if (next == NO_DEADLINE) {
+            error = pthread_cond_wait(&(*this).cond_deq, &(*this).mutex);
+        }
+        else {
+            struct timespec deadline;
+            tick_time(this, next, &deadline);
+            error = pthread_cond_timedwait(&(*this).cond_deq, &(*this).mutex, &deadline);
+        }
+        if (error && error != ETIMEDOUT) {
+            exit_delay_error(this, "Condition 'cond_deq' not waited on!");
+        }
+    }
+
+    // Several elements may have become due at once: pass the wake-up on to another consumer
+    if ((*this).ready.head != NULL) {
+        if (pthread_cond_signal(&(*this).cond_deq)) {
+            exit_delay_error(this, "Condition 'cond_deq' not signalled!");
+        }
+    }
+    // Unlock the mutex and check that it has been done
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_delay_error(this, "Mutex 'mutex' not unlocked!");
+    }
+    release_space(this);
+    return element;
+}
+
+void* DelayQueue_tryDeq(DelayQueue* this) {
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_delay_error(this, "Mutex 'mutex' not locked!");
+    }
+    void* element = take_ready(this);
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_delay_error(this, "Mutex 'mutex' not unlocked!");
+    }
+    if (element != NULL) {
+        release_space(this);
+    }
+    return element;
+}
+
+int DelayQueue_size(DelayQueue* this) {
+    pthread_mutex_lock(&(*this).mutex);
+    int size = (*this).size; // The number of elements currently in this delay queue, due or not
+    pthread_mutex_unlock(&(*this).mutex);
+    return size;
+}
+
+bool DelayQueue_isEmpty(DelayQueue* this) {
+    return DelayQueue_size(this) == ZERO;
+}
+
+void DelayQueue_destroy(DelayQueue* this) {
+    // Destroy the mutex, the condition variable and the semaphore
+    pthread_mutex_destroy(&(*this).mutex);
+    pthread_cond_destroy(&(*this).cond_deq);
+    sem_destroy(&(*this).sem_enq);
+
+    // Every node lives in the single nodes array, so it is freed in one go along with the delay queue itself
+    free((*this).nodes);
+    free(this);
+}
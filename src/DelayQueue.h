@@ -0,0 +1,127 @@
+/*
+ * DelayQueue.h
+ *
+ * Module interface for a generic fixed-size Delay Queue, whose elements only become dequeuable once their delay expires.
+ *
+ */
+
+#ifndef DELAY_QUEUE_H_
+#define DELAY_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define DELAY_QUEUE_TICK_NS 1000000L    // The wheel's resolution: deadlines are rounded up to whole milliseconds
+#define DELAY_QUEUE_LEVELS 4
+#define DELAY_QUEUE_SLOT_BITS 6
+#define DELAY_QUEUE_SLOTS (1 << DELAY_QUEUE_SLOT_BITS)
+
+typedef struct DelayQueue DelayQueue;
+typedef struct DelayQueueNode DelayQueueNode;
+typedef struct DelayQueueList DelayQueueList;
+
+struct DelayQueueNode {
+    /*
+     * A DelayQueueNode struct has 3 attributes:
+     *      - element: The enqueued void* element;
+     *      - deadline: The tick at which the element becomes dequeuable;
+     *      - next: The next node in the same list.
+     */
+    void* element;
+    uint64_t deadline;
+    DelayQueueNode* next;
+};
+
+struct DelayQueueList {
+    /*
+     * A DelayQueueList is a FIFO list of nodes, with a head to remove from and a tail to append to.
+     */
+    DelayQueueNode* head;
+    DelayQueueNode* tail;
+};
+
+struct DelayQueue {
+    /*
+     * A DelayQueue struct has 13 attributes:
+     *      - capacity: The delay queue's maximum capacity;
+     *      - size: The number of elements currently enqueued, due or not;
+     *      - nodes: The capacity nodes that elements are stored in, allocated once;
+     *      - free: The nodes not currently holding an element;
+     *      - wheel: The hierarchical timing wheel of pending nodes. Level k has DELAY_QUEUE_SLOTS slots of
+     *        DELAY_QUEUE_SLOTS^k ticks each, and holds the nodes due within the current slot of level k + 1;
+     *      - occupied: One bitmap per level of the wheel, with a bit set for every non-empty slot;
+     *      - overflow: The nodes due beyond the reach of the top level, re-inserted each time it wraps around;
+     *      - ready: The nodes whose deadline has passed, in deadline order;
+     *      - now: The tick the wheel has been advanced to;
+     *      - start: The CLOCK_MONOTONIC time of tick 0;
+     *      - mutex: The mutex protecting all of the above;
+     *      - cond_deq: The condition consumers sleep on until the next deadline or a new element;
+     *      - sem_enq: The semaphore used before enqueueing elements, as in a BlockingQueue.
+     */
+    int capacity;
+    int size;
+    DelayQueueNode* nodes;
+    DelayQueueNode* free;
+    DelayQueueList wheel[DELAY_QUEUE_LEVELS][DELAY_QUEUE_SLOTS];
+    uint64_t occupied[DELAY_QUEUE_LEVELS];
+    DelayQueueList overflow;
+    DelayQueueList ready;
+    uint64_t now;
+    struct timespec start;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_deq;
+    sem_t sem_enq;
+};
+
+/*
+ * Creates a new DelayQueue for at most max_size void* elements.
+ * Returns a pointer to a new DelayQueue on success and NULL on failure.
+ */
+DelayQueue* new_DelayQueue(int max_size);
+
+/*
+ * Enqueues the given void* element, to become dequeuable after delay_ms milliseconds.
+ * If the queue is full, the function will block the calling thread until there is space in the queue.
+ * Returns false when element is NULL and true on success.
+ */
+bool DelayQueue_enq(DelayQueue* this, void* element, long delay_ms);
+
+/*
+ * Enqueues the given void* element, to become dequeuable at the given CLOCK_MONOTONIC time.
+ * If the queue is full, the function will block the calling thread until there is space in the queue.
+ * Returns false when element is NULL and true on success.
+ */
+bool DelayQueue_enqAt(DelayQueue* this, void* element, const struct timespec* ready_at);
+
+/*
+ * Dequeues the element whose deadline passed first.
+ * If no element is due, the function will block until the next deadline, or until an element is enqueued.
+ * Returns the dequeued void* element.
+ */
+void* DelayQueue_deq(DelayQueue* this);
+
+/*
+ * Dequeues the element whose deadline passed first without blocking.
+ * Returns the dequeued void* element, or NULL if no element is due.
+ */
+void* DelayQueue_tryDeq(DelayQueue* this);
+
+/*
+ * Returns the number of elements currently in this Queue, due or not.
+ */
+int DelayQueue_size(DelayQueue* this);
+
+/*
+ * Returns true if this Queue is empty, false otherwise.
+ */
+bool DelayQueue_isEmpty(DelayQueue* this);
+
+/*
+ * Destroys this Queue by freeing the memory used by the Queue.
+ */
+void DelayQueue_destroy(DelayQueue* this);
+
+#endif /* DELAY_QUEUE_H_ */
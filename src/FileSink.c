@@ -0,0 +1,532 @@
+/*
+ * FileSink.c
+ *
+ * Batched file sink implementation, writing through io_uring (driven with raw system calls, as liburing isn't needed
+ * for a single ring used by a single thread) when the kernel supports it, and with pwritev otherwise.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && defined(__has_include) && !defined(FILE_SINK_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define FILE_SINK_IO_URING
+#endif
+#endif
+
+#include "FileSink.h"
+
+#define FILE_MODE 0644
+
+/*
+ * The writer exits once it dequeues this token, which FileSink_destroy enqueues behind every submitted buffer.
+ */
+static char stop_token;
+#define STOP ((void*) &stop_token)
+
+/*
+ * Terminates the code and prints out an error message if an error is detected.
+ */
+static void exit_file_sink_error(char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+/*
+ * Records the errno of a failed write, unless an earlier one failed already.
+ */
+static void record_error(FileSink* this, int error) {
+    int none = ZERO;
+    atomic_compare_exchange_strong(&(*this).error, &none, error);
+}
+
+/*
+ * Writes what is left of the given batch with pwritev, from written bytes onwards, until all of it is written
+ * or a write fails.
+ * Returns the number of bytes of the batch written in total.
+ */
+static size_t write_rest(FileSink* this, FileSinkBatch* batch, size_t written) {
+    struct iovec* iov = (*batch).iov;
+    int count = (*batch).count;
+    size_t skip = written;
+    while (written < (*batch).length) {
+        // Step over the bytes already written, which may end part-way through a buffer
+        while (count > ZERO && skip >= (*iov).iov_len) {
+            skip -= (*iov).iov_len;
+            iov++;
+            count--;
+        }
+        (*iov).iov_base = (char*) (*iov).iov_base + skip;
+        (*iov).iov_len -= skip;
+        ssize_t result = pwritev((*this).fd, iov, count, (*batch).offset + written);
+        atomic_fetch_add_explicit(&(*this).writes, ONE, memory_order_relaxed);
+        if (result < ZERO) {
+            if (errno == EINTR) {
+                skip = ZERO;
+                continue;
+            }
+            record_error(this, errno);
+            break;
+        }
+        if (result == ZERO) {
+            record_error(this, EIO);
+            break;
+        }
+        written += result;
+        skip = result;
+    }
+    return written;
+}
+
+/*
+ * Finishes the given batch once written bytes of it have been written: counts them, and hands its buffers back to
+ * the pool for the producers to fill again.
+ */
+static void complete(FileSink* this, FileSinkBatch* batch, size_t written) {
+    atomic_fetch_add_explicit(&(*this).bytes_written, written, memory_order_relaxed);
+    // Only count the buffers FileSink_flush waits for, leaving out those enqueued straight to the input
+    int submitted = ZERO;
+    for (int i = 0; i < (*batch).count; i++) {
+        FileSinkBuffer* buffer = (*batch).buffers[i];
+        submitted += (*buffer).submitted;
+        (*buffer).length = ZERO;
+        (*buffer).submitted = false;
+        BlockingQueue_enq((*this).free_buffers, buffer); // Never full: it holds every buffer
+    }
+
+    // Let FileSink_flush know that more buffers have been written
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_file_sink_error("Mutex 'mutex' not locked!");
+    }
+    (*this).completed += submitted;
+    if (pthread_cond_broadcast(&(*this).cond_completed)) {
+        exit_file_sink_error("Condition 'cond_completed' not signalled!");
+    }
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_file_sink_error("Mutex 'mutex' not unlocked!");
+    }
+    (*batch).count = ZERO;
+    (*batch).length = ZERO;
+    (*batch).busy = false;
+}
+
+
+#ifdef FILE_SINK_IO_URING
+
+struct FileSinkRing {
+    /*
+     * A FileSinkRing struct has 15 attributes, pointing into the submission and completion rings shared with the kernel:
+     *      - fd: The io_uring's file descriptor;
+     *      - sq_head, sq_tail, sq_mask and sq_array: The submission ring's indices, and its array of entry indices;
+     *      - sqes: The submission entries;
+     *      - cq_head, cq_tail, cq_mask and cqes: The completion ring's indices and entries;
+     *      - sq_map and cq_map: The mappings holding the two rings (the same one if the kernel shares it);
+     *      - sq_map_size, cq_map_size and sqes_size: The sizes of the three mappings.
+     * Only the writer thread uses the ring, so only the indices shared with the kernel need atomic accesses.
+     */
+    int fd;
+    _Atomic unsigned* sq_head;
+    _Atomic unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    _Atomic unsigned* cq_head;
+    _Atomic unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_map;
+    void* cq_map;
+    size_t sq_map_size;
+    size_t cq_map_size;
+    size_t sqes_size;
+};
+
+/*
+ * Releases the given ring's mappings and file descriptor, and frees it.
+ */
+static void ring_destroy(FileSinkRing* ring) {
+    if ((*ring).sqes != NULL && (*ring).sqes != MAP_FAILED) {
+        munmap((*ring).sqes, (*ring).sqes_size);
+    }
+    if ((*ring).cq_map != NULL && (*ring).cq_map != MAP_FAILED && (*ring).cq_map != (*ring).sq_map) {
+        munmap((*ring).cq_map, (*ring).cq_map_size);
+    }
+    if ((*ring).sq_map != NULL && (*ring).sq_map != MAP_FAILED) {
+        munmap((*ring).sq_map, (*ring).sq_map_size);
+    }
+    close((*ring).fd);
+    free(ring);
+}
+
+/*
+ * Sets up an io_uring with room for every batch in flight.
+ * Returns the ring, or NULL if the kernel doesn't support io_uring (or forbids it).
+ */
+static FileSinkRing* ring_create() {
+    struct io_uring_params params;
+    memset(&params, ZERO, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, FILE_SINK_MAX_IN_FLIGHT, &params);
+    if (fd < ZERO) {
+        return NULL;
+    }
+    FileSinkRing* ring = calloc(ONE, sizeof(FileSinkRing));
+    if (ring == NULL) {
+        close(fd);
+        return NULL;
+    }
+    (*ring).fd = fd;
+
+    // Map the submission and completion rings, in one mapping if the kernel allows it, and the submission entries
+    (*ring).sq_map_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    (*ring).cq_map_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if ((*ring).cq_map_size > (*ring).sq_map_size) {
+            (*ring).sq_map_size = (*ring).cq_map_size;
+        }
+        (*ring).cq_map_size = (*ring).sq_map_size;
+    }
+    (*ring).sq_map = mmap(NULL, (*ring).sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_SQ_RING);
+    if ((*ring).sq_map == MAP_FAILED) {
+        ring_destroy(ring);
+        return NULL;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        (*ring).cq_map = (*ring).sq_map;
+    }
+    else {
+        (*ring).cq_map = mmap(NULL, (*ring).cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd, IORING_OFF_CQ_RING);
+        if ((*ring).cq_map == MAP_FAILED) {
+            ring_destroy(ring);
+            return NULL;
+        }
+    }
+    (*ring).sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+    (*ring).sqes = mmap(NULL, (*ring).sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQES);
+    if ((*ring).sqes == MAP_FAILED) {
+        ring_destroy(ring);
+        return NULL;
+    }
+
+    char* sq = (*ring).sq_map;
+    char* cq = (*ring).cq_map;
+    (*ring).sq_head = (_Atomic unsigned*) (sq + params.sq_off.head);
+    (*ring).sq_tail = (_Atomic unsigned*) (sq + params.sq_off.tail);
+    (*ring).sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+    (*ring).sq_array = (unsigned*) (sq + params.sq_off.array);
+    (*ring).cq_head = (_Atomic unsigned*) (cq + params.cq_off.head);
+    (*ring).cq_tail = (_Atomic unsigned*) (cq + params.cq_off.tail);
+    (*ring).cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+    (*ring).cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    return ring;
+}
+
+/*
+ * Submits the given batch as a single vectored write at its offset.
+ * Returns false if the kernel didn't take it, so that it can be written with pwritev instead.
+ */
+static bool ring_submit(FileSink* this, FileSinkBatch* batch) {
+    FileSinkRing* ring = (*this).ring;
+    // There is a submission entry per batch in flight, so one is always free
+    unsigned tail = atomic_load_explicit((*ring).sq_tail, memory_order_relaxed);
+    unsigned index = tail & *(*ring).sq_mask;
+    struct io_uring_sqe* sqe = &(*ring).sqes[index];
+    memset(sqe, ZERO, sizeof(*sqe));
+    (*sqe).opcode = IORING_OP_WRITEV;
+    (*sqe).fd = (*this).fd;
+    (*sqe).addr = (uintptr_t) (*batch).iov;
+    (*sqe).len = (*batch).count;
+    (*sqe).off = (*batch).offset;
+    (*sqe).user_data = batch - (*this).batches;
+    (*ring).sq_array[index] = index;
+    // Publish the entry to the kernel, then have it consume it
+    atomic_store_explicit((*ring).sq_tail, tail + ONE, memory_order_release);
+    int submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, (*ring).fd, ONE, ZERO, ZERO, NULL, ZERO);
+    } while (submitted < ZERO && errno == EINTR);
+    if (submitted != ONE) {
+        // Take the entry back, as the kernel hasn't consumed it
+        atomic_store_explicit((*ring).sq_tail, tail, memory_order_release);
+        return false;
+    }
+    atomic_fetch_add_explicit(&(*this).writes, ONE, memory_order_relaxed);
+    (*this).in_flight++;
+    return true;
+}
+
+/*
+ * Waits until at least one batch in flight has been written, and finishes every batch that has been.
+ * A batch only partly written (which the kernel may do, e.g. when the disk is nearly full) is finished with pwritev.
+ */
+static void ring_reap(FileSink* this) {
+    FileSinkRing* ring = (*this).ring;
+    unsigned head = atomic_load_explicit((*ring).cq_head, memory_order_relaxed);
+    if (head == atomic_load_explicit((*ring).cq_tail, memory_order_acquire)) {
+        while (syscall(__NR_io_uring_enter, (*ring).fd, ZERO, ONE, IORING_ENTER_GETEVENTS, NULL, ZERO) < ZERO) {
+            if (errno != EINTR) {
+                exit_file_sink_error("Completions not waited for!");
+            }
+        }
+    }
+    while (head != atomic_load_explicit((*ring).cq_tail, memory_order_acquire)) {
+        struct io_uring_cqe* cqe = &(*ring).cqes[head & *(*ring).cq_mask];
+        FileSinkBatch* batch = &(*this).batches[(*cqe).user_data];
+        int result = (*cqe).res;
+        head++;
+        // Hand the entry back to the kernel before finishing the batch, which may take a while
+        atomic_store_explicit((*ring).cq_head, head, memory_order_release);
+        (*this).in_flight--;
+        size_t written = ZERO;
+        if (result < ZERO) {
+            record_error(this, -result);
+        }
+        else {
+            written = write_rest(this, batch, result);
+        }
+        complete(this, batch, written);
+    }
+}
+
+#else
+
+static void ring_destroy(FileSinkRing* ring) {
+    (void) ring;
+}
+
+static FileSinkRing* ring_create() {
+    return NULL;
+}
+
+static bool ring_submit(FileSink* this, FileSinkBatch* batch) {
+    (void) this;
+    (void) batch;
+    return false;
+}
+
+static void ring_reap(FileSink* this) {
+    (void) this;
+}
+
+#endif
+
+
+/*
+ * Writes the given batch: submits it to the ring, or writes it with pwritev straight away.
+ * The batch's place in the file is reserved either way, so that it lands after every batch submitted before it.
+ * After a failed write, the batch is dropped instead.
+ */
+static void submit_batch(FileSink* this, FileSinkBatch* batch) {
+    // Once a write has failed, drop every later batch rather than write it after a hole
+    if (atomic_load(&(*this).error) != ZERO) {
+        complete(this, batch, ZERO);
+        return;
+    }
+    (*batch).offset = (*this).offset;
+    (*this).offset += (*batch).length;
+    (*batch).busy = true;
+    if ((*this).ring == NULL || !ring_submit(this, batch)) {
+        complete(this, batch, write_rest(this, batch, ZERO));
+    }
+}
+
+/*
+ * Returns a batch that isn't being written, waiting for one to be written if they all are.
+ */
+static FileSinkBatch* free_batch(FileSink* this) {
+    for (;;) {
+        for (int i = 0; i < FILE_SINK_MAX_IN_FLIGHT; i++) {
+            if (!(*this).batches[i].busy) {
+                return &(*this).batches[i];
+            }
+        }
+        ring_reap(this);
+    }
+}
+
+/*
+ * The writer thread: drains the input in batches of up to FILE_SINK_BATCH buffers, and writes each batch with a
+ * single system call, keeping up to FILE_SINK_MAX_IN_FLIGHT batches in flight through the ring.
+ */
+static void* writer(void* arg) {
+    FileSink* this = arg;
+    void* elements[FILE_SINK_BATCH];
+    bool stopping = false;
+    while (!stopping) {
+        FileSinkBatch* batch = free_batch(this);
+        // Buffers in flight only go back to the pool once their completion is reaped, so never sleep on the input
+        // while any are: producers could be waiting for them. As the writer is the input's only consumer, the input
+        // can't become empty between this check and the dequeue.
+        if ((*this).in_flight > ZERO && BlockingQueue_isEmpty((*this).input)) {
+            ring_reap(this);
+            continue;
+        }
+        int count = BlockingQueue_deqBatchAdaptive((*this).input, elements, FILE_SINK_BATCH, FILE_SINK_MAX_LINGER_US);
+        for (int i = 0; i < count; i++) {
+            if (elements[i] == STOP) {
+                stopping = true;
+                continue;
+            }
+            FileSinkBuffer* buffer = elements[i];
+            (*batch).buffers[(*batch).count] = buffer;
+            (*batch).iov[(*batch).count].iov_base = (*buffer).data;
+            (*batch).iov[(*batch).count].iov_len = (*buffer).length;
+            (*batch).length += (*buffer).length;
+            (*batch).count++;
+        }
+        if ((*batch).count > ZERO) {
+            submit_batch(this, batch);
+        }
+    }
+    // Wait for the batches still in flight
+    while ((*this).in_flight > ZERO) {
+        ring_reap(this);
+    }
+    return NULL;
+}
+
+
+FileSink* new_FileSink(const char* path, int buffer_count, size_t buffer_size, bool use_io_uring) {
+    return new_FileSinkWithInput(path, buffer_count, buffer_size, use_io_uring, NULL);
+}
+
+FileSink* new_FileSinkWithInput(const char* path, int buffer_count, size_t buffer_size, bool use_io_uring,
+                                BlockingQueue* input) {
+    if (path == NULL || buffer_count < ONE || buffer_size < ONE) {
+        return NULL;
+    }
+    FileSink* this = calloc(ONE, sizeof(FileSink));
+    if (this == NULL) {
+        return NULL;
+    }
+    (*this).fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, FILE_MODE);
+    if ((*this).fd < ZERO) {
+        free(this);
+        return NULL;
+    }
+    // Batches are written at explicit offsets, starting from the end of what the file already holds
+    (*this).offset = lseek((*this).fd, ZERO, SEEK_END);
+    if ((*this).offset < ZERO) {
+        (*this).offset = ZERO;
+    }
+
+    (*this).buffers = calloc(buffer_count, sizeof(FileSinkBuffer));
+    (*this).data = malloc(buffer_count*buffer_size);
+    (*this).free_buffers = new_BlockingQueue(buffer_count);
+    (*this).owns_input = input == NULL;
+    (*this).input = (*this).owns_input ? new_BlockingQueue(buffer_count + ONE) : input; // Room for the stop token
+    if ((*this).buffers == NULL || (*this).data == NULL || (*this).free_buffers == NULL || (*this).input == NULL) {
+        if ((*this).free_buffers != NULL) {
+            BlockingQueue_destroy((*this).free_buffers);
+        }
+        if ((*this).owns_input && (*this).input != NULL) {
+            BlockingQueue_destroy((*this).input);
+        }
+        free((*this).buffers);
+        free((*this).data);
+        close((*this).fd);
+        free(this);
+        return NULL;
+    }
+    for (int i = 0; i < buffer_count; i++) {
+        FileSinkBuffer* buffer = &(*this).buffers[i];
+        (*buffer).data = (*this).data + i*buffer_size;
+        (*buffer).capacity = buffer_size;
+        (*buffer).submitted = false;
+        BlockingQueue_enq((*this).free_buffers, buffer);
+    }
+
+    (*this).ring = use_io_uring ? ring_create() : NULL;
+    atomic_init(&(*this).bytes_written, ZERO);
+    atomic_init(&(*this).writes, ZERO);
+    atomic_init(&(*this).error, ZERO);
+    atomic_init(&(*this).submitted, ZERO);
+    if (pthread_mutex_init(&(*this).mutex, NULL)) {
+        exit_file_sink_error("Mutex 'mutex' not created!");
+    }
+    if (pthread_cond_init(&(*this).cond_completed, NULL)) {
+        exit_file_sink_error("Condition 'cond_completed' not created!");
+    }
+    if (pthread_create(&(*this).writer, NULL, writer, this)) {
+        exit_file_sink_error("Writer thread not created!");
+    }
+    return this;
+}
+
+FileSinkBuffer* FileSink_acquire(FileSink* this) {
+    return BlockingQueue_deq((*this).free_buffers);
+}
+
+bool FileSink_submit(FileSink* this, FileSinkBuffer* buffer) {
+    if (buffer == NULL || (*buffer).length > (*buffer).capacity) {
+        return false;
+    }
+    (*buffer).submitted = true;
+    atomic_fetch_add(&(*this).submitted, ONE);
+    return BlockingQueue_enq((*this).input, buffer);
+}
+
+void FileSink_flush(FileSink* this) {
+    long submitted = atomic_load(&(*this).submitted);
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_file_sink_error("Mutex 'mutex' not locked!");
+    }
+    while ((*this).completed < submitted) {
+        if (pthread_cond_wait(&(*this).cond_completed, &(*this).mutex)) {
+            exit_file_sink_error("Condition 'cond_completed' not waited on!");
+        }
+    }
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_file_sink_error("Mutex 'mutex' not unlocked!");
+    }
+}
+
+bool FileSink_usesIoUring(FileSink* this) {
+    return (*this).ring != NULL;
+}
+
+long FileSink_bytesWritten(FileSink* this) {
+    return atomic_load_explicit(&(*this).bytes_written, memory_order_relaxed);
+}
+
+long FileSink_writes(FileSink* this) {
+    return atomic_load_explicit(&(*this).writes, memory_order_relaxed);
+}
+
+int FileSink_error(FileSink* this) {
+    return atomic_load(&(*this).error);
+}
+
+void FileSink_destroy(FileSink* this) {
+    // The writer exits once every buffer submitted before the stop token has been written
+    BlockingQueue_enq((*this).input, STOP);
+    pthread_join((*this).writer, NULL);
+    if ((*this).ring != NULL) {
+        ring_destroy((*this).ring);
+    }
+    close((*this).fd);
+    if ((*this).owns_input) {
+        BlockingQueue_destroy((*this).input);
+    }
+    BlockingQueue_destroy((*this).free_buffers);
+    pthread_mutex_destroy(&(*this).mutex);
+    pthread_cond_destroy(&(*this).cond_completed);
+    free((*this).buffers);
+    free((*this).data);
+    free(this);
+}
@@ -0,0 +1,169 @@
+/*
+ * FileSink.h
+ *
+ * Module interface for a sink stage writing byte buffers to a file: producers fill buffers from a fixed pool and
+ * submit them, and a writer thread drains them from a BlockingQueue in batches, writing each batch with a single
+ * system call (one io_uring submission when the kernel supports it, pwritev otherwise) instead of one write per buffer.
+ *
+ */
+
+#ifndef FILE_SINK_H_
+#define FILE_SINK_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "BlockingQueue.h"
+
+#define FILE_SINK_BATCH 64              // The most buffers written by one system call (well below IOV_MAX)
+#define FILE_SINK_MAX_IN_FLIGHT 4       // The most batches being written at the same time through io_uring
+#define FILE_SINK_MAX_LINGER_US 200     // The longest the writer waits for a batch to fill up
+
+typedef struct FileSinkBuffer FileSinkBuffer;
+typedef struct FileSinkBatch FileSinkBatch;
+typedef struct FileSinkRing FileSinkRing;
+typedef struct FileSink FileSink;
+
+struct FileSinkBuffer {
+    /*
+     * A FileSinkBuffer struct has 4 attributes:
+     *      - data: The bytes to write, filled in by the producer;
+     *      - length: The number of bytes of data to write, set by the producer;
+     *      - capacity: The size of data, which length must not exceed;
+     *      - submitted: Whether the buffer went through FileSink_submit, so that FileSink_flush waits for it.
+     */
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool submitted;
+};
+
+struct FileSinkBatch {
+    /*
+     * A FileSinkBatch struct has 6 attributes, and holds one batch of buffers until it has been written:
+     *      - buffers and iov: The batch's buffers, and the I/O vector pointing at their data;
+     *      - count: The number of buffers in the batch;
+     *      - length: The total number of bytes in the batch;
+     *      - offset: Where in the file the batch goes;
+     *      - busy: Whether the batch is being written.
+     */
+    FileSinkBuffer* buffers[FILE_SINK_BATCH];
+    struct iovec iov[FILE_SINK_BATCH];
+    int count;
+    size_t length;
+    off_t offset;
+    bool busy;
+};
+
+struct FileSink {
+    /*
+     * A FileSink struct has 18 attributes:
+     *      - fd and offset: The file written to, and where the next batch goes in it;
+     *      - buffers and data: Every buffer of the pool, and the memory holding their data;
+     *      - free_buffers: The buffers producers can fill, which every buffer goes back to once it has been written;
+     *      - input and owns_input: The buffers submitted by the producers, in order, and drained by the writer, and
+     *        whether the sink created that queue (and so destroys it) or was given it by the caller;
+     *      - batches and in_flight: The batches being assembled or written, and the number being written;
+     *      - ring: The io_uring submitting the batches, or NULL if they are written with pwritev;
+     *      - writer: The thread draining input and writing the batches;
+     *      - bytes_written and writes: The number of bytes written so far, and of system calls writing them;
+     *      - error: The errno of the first failed write, or 0;
+     *      - submitted and completed: The number of buffers submitted through FileSink_submit so far, and of those
+     *        written (or dropped), leaving out the buffers enqueued straight to the input;
+     *      - mutex and cond_completed: Protect completed, and signal when more buffers have been written.
+     *
+     * Each batch is written at its own offset, reserved when it is submitted, so batches in flight together land
+     * in submission order whichever finishes first. As there are only as many buffers as the pool holds, producers
+     * that get ahead of the file wait in FileSink_acquire until the writer hands buffers back.
+     */
+    int fd;
+    off_t offset;
+    FileSinkBuffer* buffers;
+    char* data;
+    BlockingQueue* free_buffers;
+    BlockingQueue* input;
+    bool owns_input;
+    FileSinkBatch batches[FILE_SINK_MAX_IN_FLIGHT];
+    int in_flight;
+    FileSinkRing* ring;
+    pthread_t writer;
+    atomic_long bytes_written;
+    atomic_long writes;
+    atomic_int error;
+    atomic_long submitted;
+    long completed;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_completed;
+};
+
+/*
+ * Creates a new FileSink appending to the file at path (which is created if needed), with a pool of buffer_count
+ * buffers of buffer_size bytes each. If use_io_uring is true, the batches are written through io_uring when the
+ * kernel supports it, and with pwritev otherwise.
+ * Returns a pointer to a new FileSink on success and NULL on failure (including when the file cannot be opened).
+ */
+FileSink* new_FileSink(const char* path, int buffer_count, size_t buffer_size, bool use_io_uring);
+
+/*
+ * Creates a new FileSink like new_FileSink, whose writer drains the given input instead of a queue of its own, so that
+ * the sink can be fed directly, e.g. as the sink of a Pipeline whose last stage returns FileSinkBuffers. Every element
+ * enqueued to input must be a buffer acquired from this sink. Elements enqueued without FileSink_submit are written
+ * all the same, but FileSink_flush doesn't wait for them. The input must block producers when it is full, is owned by
+ * the caller, and isn't destroyed with the sink. If input is NULL, the sink creates its own, as new_FileSink does.
+ * Returns a pointer to a new FileSink on success and NULL on failure.
+ */
+FileSink* new_FileSinkWithInput(const char* path, int buffer_count, size_t buffer_size, bool use_io_uring,
+                                BlockingQueue* input);
+
+/*
+ * Takes an empty buffer from the pool, for the calling producer to fill.
+ * If every buffer is in use, the function will block the calling thread until the writer hands one back.
+ */
+FileSinkBuffer* FileSink_acquire(FileSink* this);
+
+/*
+ * Submits a filled buffer to be written after every buffer submitted before it. The buffer goes back to the pool
+ * once it has been written, and must not be used by the producer after this call.
+ * Returns false when buffer is NULL or its length exceeds its capacity, and true on success.
+ */
+bool FileSink_submit(FileSink* this, FileSinkBuffer* buffer);
+
+/*
+ * Waits until every buffer submitted through FileSink_submit before this call has been written.
+ */
+void FileSink_flush(FileSink* this);
+
+/*
+ * Returns true if this FileSink writes through io_uring, and false if it writes with pwritev.
+ */
+bool FileSink_usesIoUring(FileSink* this);
+
+/*
+ * Returns the number of bytes written so far.
+ */
+long FileSink_bytesWritten(FileSink* this);
+
+/*
+ * Returns the number of system calls made so far to write the batches.
+ */
+long FileSink_writes(FileSink* this);
+
+/*
+ * Returns the errno of the first write that failed, or 0 if none has. The buffers of a failed write are dropped,
+ * and go back to the pool like any other. So are those of every batch that comes after it, which isn't written
+ * at all: the file ends where the failed write stopped, rather than going on after a hole. Only batches already in
+ * flight through io_uring when the failure is seen may still land after it.
+ */
+int FileSink_error(FileSink* this);
+
+/*
+ * Destroys this FileSink by freeing the memory used by the FileSink, after every submitted buffer has been written,
+ * and closes the file. No buffer may be acquired or submitted once this has been called.
+ */
+void FileSink_destroy(FileSink* this);
+
+#endif /* FILE_SINK_H_ */
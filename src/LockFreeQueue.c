@@ -0,0 +1,373 @@
+/*
+ * LockFreeQueue.c
+ *
+ * Unbounded lock-free linked queue implementation (Michael and Scott), with epoch-based reclamation.
+ *
+ * Every operation claims a record and announces the global epoch in it before touching any node. A node removed
+ * from the queue is retired into its record's list for the current epoch, and only reused once the record has seen
+ * the epoch move on LOCK_FREE_EPOCHS times: the epoch can only move on once every announced operation has seen it,
+ * so by then no operation can still be reading the node. Reused nodes never go back to the system until the queue
+ * is destroyed, which also rules out the ABA problem on head and tail.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "LockFreeQueue.h"
+
+#define INACTIVE 0
+#define FIRST_EPOCH 1
+
+/*
+ * The record this thread used last, tried first so that a thread keeps using the same record (and its free nodes).
+ */
+static _Thread_local int record_hint;
+
+/*
+ * Terminates the code, destroys the lock-free queue and prints out an error message if an error is detected.
+ */
+static void exit_lock_free_error(LockFreeQueue* this, char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    LockFreeQueue_destroy(this); // Destroy the lock-free queue
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+/*
+ * Moves the epoch on if every operation currently running has announced the current one.
+ */
+static void try_advance(LockFreeQueue* this) {
+    unsigned long epoch = atomic_load(&(*this).epoch);
+    int count = atomic_load(&(*this).record_count);
+    for (int i = 0; i < count; i++) {
+        unsigned long announced = atomic_load(&(*this).records[i].epoch);
+        if (announced != INACTIVE && announced != epoch) {
+            return; // Someone may still be reading nodes retired in the previous epoch
+        }
+    }
+    atomic_compare_exchange_strong(&(*this).epoch, &epoch, epoch + ONE);
+}
+
+/*
+ * Hands nodes over to the other records through the shared stack, LOCK_FREE_BATCH at a time,
+ * once the given record has more free nodes than it is likely to need.
+ */
+static void share_free(LockFreeQueue* this, LockFreeRecord* record) {
+    while ((*record).free_count > 2*LOCK_FREE_BATCH) {
+        LockFreeNode* first = (*record).free;
+        LockFreeNode* last = first;
+        for (int i = ONE; i < LOCK_FREE_BATCH; i++) {
+            last = (*last).link;
+        }
+        (*record).free = (*last).link;
+        (*record).free_count -= LOCK_FREE_BATCH;
+
+        // Pushing is safe from ABA: the batch is only linked in if the head didn't change in between
+        LockFreeNode* top = atomic_load_explicit(&(*this).free_stack, memory_order_relaxed);
+        do {
+            (*last).link = top;
+        } while (!atomic_compare_exchange_weak_explicit(&(*this).free_stack, &top, first,
+                memory_order_release, memory_order_relaxed));
+    }
+}
+
+/*
+ * Claims a record and announces the current epoch in it, recycling the nodes the record retired
+ * LOCK_FREE_EPOCHS epochs ago if the epoch has moved on since it was last used.
+ * Returns the claimed record.
+ */
+static LockFreeRecord* enter(LockFreeQueue* this) {
+    LockFreeRecord* record = NULL;
+    for (int tries = 0; record == NULL; tries++) {
+        int i = (record_hint + tries) % LOCK_FREE_MAX_RECORDS;
+        if (tries > ZERO && i == record_hint) {
+            sched_yield(); // Every record is in use: wait for an operation to finish
+        }
+        bool claimed = false;
+        if (!atomic_load_explicit(&(*this).records[i].claimed, memory_order_relaxed)
+                && atomic_compare_exchange_strong_explicit(&(*this).records[i].claimed, &claimed, true,
+                        memory_order_acquire, memory_order_relaxed)) {
+            record = &(*this).records[i];
+            record_hint = i;
+            // Make sure epoch advances look at this record from now on
+            int count = atomic_load(&(*this).record_count);
+            while (count <= i && !atomic_compare_exchange_weak(&(*this).record_count, &count, i + ONE)) {
+                continue;
+            }
+        }
+    }
+
+    /*
+     * Announce the epoch, and make the announcement visible before reading any node. The epoch may move on before
+     * the announcement is visible, so try again until it hasn't: from then on it can only move on once more while
+     * the operation runs, which keeps the nodes it retires in the right epoch's list.
+     */
+    unsigned long epoch;
+    do {
+        epoch = atomic_load(&(*this).epoch);
+        atomic_store(&(*record).epoch, epoch);
+        atomic_thread_fence(memory_order_seq_cst);
+    } while (epoch != atomic_load(&(*this).epoch));
+
+    if (epoch != (*record).last_epoch) {
+        // The nodes in this epoch's list were retired LOCK_FREE_EPOCHS epochs ago or more: nobody can be reading them
+        int slot = epoch % LOCK_FREE_EPOCHS;
+        LockFreeNode* node = (*record).retired[slot];
+        while (node != NULL) {
+            LockFreeNode* next = (*node).link;
+            (*node).link = (*record).free;
+            (*record).free = node;
+            (*record).free_count++;
+            node = next;
+        }
+        (*record).retired[slot] = NULL;
+        (*record).last_epoch = epoch;
+        share_free(this, record);
+    }
+    return record;
+}
+
+/*
+ * Withdraws the record's announcement and gives the record back.
+ */
+static void leave(LockFreeRecord* record) {
+    atomic_store_explicit(&(*record).epoch, INACTIVE, memory_order_release);
+    atomic_store_explicit(&(*record).claimed, false, memory_order_release);
+}
+
+/*
+ * Retires a node that has just been removed from the queue, trying to move the epoch on every LOCK_FREE_BATCH nodes.
+ */
+static void retire(LockFreeQueue* this, LockFreeRecord* record, LockFreeNode* node) {
+    int slot = (*record).last_epoch % LOCK_FREE_EPOCHS;
+    (*node).link = (*record).retired[slot];
+    (*record).retired[slot] = node;
+    if (++(*record).retired_count % LOCK_FREE_BATCH == ZERO) {
+        try_advance(this);
+    }
+}
+
+/*
+ * Returns a node for a new element: a free node of the record's, then one from the shared stack,
+ * and only then a newly allocated one. Returns NULL if allocation fails.
+ */
+static LockFreeNode* take_node(LockFreeQueue* this, LockFreeRecord* record) {
+    if ((*record).free == NULL) {
+        // Take the whole shared stack at once: there is nothing to compare, so no ABA problem either
+        LockFreeNode* node = atomic_exchange_explicit(&(*this).free_stack, NULL, memory_order_acquire);
+        (*record).free = node;
+        for (; node != NULL; node = (*node).link) {
+            (*record).free_count++;
+        }
+    }
+    LockFreeNode* node = (*record).free;
+    if (node != NULL) {
+        (*record).free = (*node).link;
+        (*record).free_count--;
+    }
+    else {
+        node = malloc(sizeof(LockFreeNode));
+        if (node == NULL) {
+            return NULL;
+        }
+        atomic_fetch_add_explicit(&(*this).allocated, ONE, memory_order_relaxed);
+    }
+    (*node).link = NULL;
+    atomic_store_explicit(&(*node).next, NULL, memory_order_relaxed);
+    return node;
+}
+
+/*
+ * Frees every node of the given list, linked through link.
+ */
+static void free_list(LockFreeNode* node) {
+    while (node != NULL) {
+        LockFreeNode* next = (*node).link;
+        free(node);
+        node = next;
+    }
+}
+
+
+LockFreeQueue* new_LockFreeQueue(void) {
+    // Initialise the lock-free queue, aligned so that head and tail really are on separate cache lines
+    LockFreeQueue* this = aligned_alloc(CACHE_LINE_SIZE, sizeof(LockFreeQueue));
+    if (this == NULL) {
+        return NULL;
+    }
+    LockFreeNode* dummy = malloc(sizeof(LockFreeNode));
+    if (dummy == NULL) {
+        free(this);
+        return NULL;
+    }
+    (*dummy).element = NULL;
+    (*dummy).link = NULL;
+    atomic_init(&(*dummy).next, NULL);
+    atomic_init(&(*this).head, dummy);
+    atomic_init(&(*this).tail, dummy);
+    atomic_init(&(*this).epoch, FIRST_EPOCH);
+    atomic_init(&(*this).record_count, ZERO);
+    atomic_init(&(*this).free_stack, NULL);
+    atomic_init(&(*this).allocated, ONE);
+    atomic_init(&(*this).waiters, ZERO);
+    for (int i = 0; i < LOCK_FREE_MAX_RECORDS; i++) {
+        LockFreeRecord* record = &(*this).records[i];
+        atomic_init(&(*record).claimed, false);
+        atomic_init(&(*record).epoch, INACTIVE);
+        (*record).last_epoch = INACTIVE;
+        for (int j = 0; j < LOCK_FREE_EPOCHS; j++) {
+            (*record).retired[j] = NULL;
+        }
+        (*record).retired_count = ZERO;
+        (*record).free = NULL;
+        (*record).free_count = ZERO;
+    }
+
+    // Initialise the mutex and the condition variable used to park consumers, and check that they've been created
+    if (pthread_mutex_init(&(*this).mutex, NULL)) {
+        exit_lock_free_error(this, "Mutex 'mutex' not created!");
+    }
+    if (pthread_cond_init(&(*this).cond_deq, NULL)) {
+        exit_lock_free_error(this, "Condition 'cond_deq' not created!");
+    }
+    return this;
+}
+
+bool LockFreeQueue_enq(LockFreeQueue* this, void* element) {
+    if (element == NULL) {
+        return false;
+    }
+    LockFreeRecord* record = enter(this);
+    LockFreeNode* node = take_node(this, record);
+    if (node == NULL) {
+        leave(record);
+        return false;
+    }
+    (*node).element = element;
+
+    for (;;) {
+        LockFreeNode* tail = atomic_load_explicit(&(*this).tail, memory_order_acquire);
+        LockFreeNode* next = atomic_load_explicit(&(*tail).next, memory_order_acquire);
+        if (tail != atomic_load_explicit(&(*this).tail, memory_order_acquire)) {
+            continue; // The tail moved while its successor was being read
+        }
+        if (next != NULL) {
+            // The tail is lagging behind: help the other producer move it on, and try again
+            atomic_compare_exchange_weak(&(*this).tail, &tail, next);
+            continue;
+        }
+        // Link the node after the last one; this is the point at which the element is enqueued
+        if (atomic_compare_exchange_weak(&(*tail).next, &next, node)) {
+            atomic_compare_exchange_strong(&(*this).tail, &tail, node);
+            break;
+        }
+    }
+    leave(record);
+
+    // Wake a parked consumer, if any: the link above and this load are both sequentially consistent, so either the
+    // consumer's re-check after registering sees the element, or this sees the consumer (see LockFreeQueue_deqBlocking)
+    if (atomic_load(&(*this).waiters) > ZERO) {
+        if (pthread_mutex_lock(&(*this).mutex)) {
+            exit_lock_free_error(this, "Mutex 'mutex' not locked!");
+        }
+        if (pthread_cond_signal(&(*this).cond_deq)) {
+            exit_lock_free_error(this, "Condition 'cond_deq' not signalled!");
+        }
+        if (pthread_mutex_unlock(&(*this).mutex)) {
+            exit_lock_free_error(this, "Mutex 'mutex' not unlocked!");
+        }
+    }
+    return true;
+}
+
+void* LockFreeQueue_deq(LockFreeQueue* this) {
+    LockFreeRecord* record = enter(this);
+    void* element = NULL;
+    for (;;) {
+        LockFreeNode* head = atomic_load_explicit(&(*this).head, memory_order_acquire);
+        LockFreeNode* tail = atomic_load_explicit(&(*this).tail, memory_order_acquire);
+        LockFreeNode* next = atomic_load_explicit(&(*head).next, memory_order_acquire);
+        if (head != atomic_load_explicit(&(*this).head, memory_order_acquire)) {
+            continue; // The head moved while its successor was being read
+        }
+        if (next == NULL) {
+            break; // Empty
+        }
+        if (head == tail) {
+            // The tail is lagging behind the element being dequeued: help move it on first
+            atomic_compare_exchange_weak(&(*this).tail, &tail, next);
+            continue;
+        }
+        // Read the element before the node can be retired by another consumer, then make next the new dummy node
+        void* candidate = (*next).element;
+        if (atomic_compare_exchange_weak(&(*this).head, &head, next)) {
+            element = candidate; // Only kept once the element is really ours, or an empty retry would return it again
+            retire(this, record, head);
+            break;
+        }
+    }
+    leave(record);
+    return element;
+}
+
+void* LockFreeQueue_deqBlocking(LockFreeQueue* this) {
+    void* element = LockFreeQueue_deq(this);
+    if (element != NULL) {
+        return element;
+    }
+
+    // Register as a waiter before checking again (the check starts with a full fence, in enter), so that a producer
+    // enqueuing from now on signals
+    atomic_fetch_add(&(*this).waiters, ONE);
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_lock_free_error(this, "Mutex 'mutex' not locked!");
+    }
+    while ((element = LockFreeQueue_deq(this)) == NULL) {
+        if (pthread_cond_wait(&(*this).cond_deq, &(*this).mutex)) {
+            exit_lock_free_error(this, "Condition 'cond_deq' not waited on!");
+        }
+    }
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_lock_free_error(this, "Mutex 'mutex' not unlocked!");
+    }
+    atomic_fetch_sub(&(*this).waiters, ONE);
+    return element;
+}
+
+bool LockFreeQueue_isEmpty(LockFreeQueue* this) {
+    LockFreeRecord* record = enter(this);
+    LockFreeNode* head = atomic_load_explicit(&(*this).head, memory_order_acquire);
+    bool empty = atomic_load_explicit(&(*head).next, memory_order_acquire) == NULL;
+    leave(record);
+    return empty;
+}
+
+long LockFreeQueue_allocated(LockFreeQueue* this) {
+    return atomic_load_explicit(&(*this).allocated, memory_order_relaxed);
+}
+
+void LockFreeQueue_destroy(LockFreeQueue* this) {
+    // Destroy the mutex and the condition variable
+    pthread_mutex_destroy(&(*this).mutex);
+    pthread_cond_destroy(&(*this).cond_deq);
+
+    // Every node is in exactly one place: the queue itself, a record's retired or free lists, or the shared stack
+    LockFreeNode* node = atomic_load(&(*this).head);
+    while (node != NULL) {
+        LockFreeNode* next = atomic_load(&(*node).next);
+        free(node);
+        node = next;
+    }
+    for (int i = 0; i < LOCK_FREE_MAX_RECORDS; i++) {
+        for (int j = 0; j < LOCK_FREE_EPOCHS; j++) {
+            free_list((*this).records[i].retired[j]);
+        }
+        free_list((*this).records[i].free);
+    }
+    free_list(atomic_load(&(*this).free_stack));
+    free(this);
+}
@@ -0,0 +1,124 @@
+/*
+ * LockFreeQueue.h
+ *
+ * Module interface for an unbounded lock-free linked queue (Michael and Scott) for any number of producers and
+ * consumers, with epoch-based reclamation and recycling of its nodes, and an optional blocking dequeue.
+ *
+ */
+
+#ifndef LOCK_FREE_QUEUE_H_
+#define LOCK_FREE_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "Queue.h"
+
+#define LOCK_FREE_EPOCHS 3           // Nodes are recycled once the epoch has moved on this many times since their removal
+#define LOCK_FREE_MAX_RECORDS 128    // The maximum number of operations that can run at the same time
+#define LOCK_FREE_BATCH 64           // The number of nodes moved to the shared stack at once, and of removals between epoch advances
+
+typedef struct LockFreeNode LockFreeNode;
+typedef struct LockFreeRecord LockFreeRecord;
+typedef struct LockFreeQueue LockFreeQueue;
+
+struct LockFreeNode {
+    /*
+     * A LockFreeNode struct has 3 attributes:
+     *      - element: The element the node holds (meaningless in the dummy node at the head of the queue);
+     *      - next: The next node in the queue, or NULL at the tail;
+     *      - link: The next node in whichever retired list, free list or shared stack the node is in once removed.
+     */
+    void* element;
+    _Atomic(LockFreeNode*) next;
+    LockFreeNode* link;
+};
+
+struct LockFreeRecord {
+    /*
+     * A LockFreeRecord struct has 7 attributes, and is used by one operation at a time:
+     *      - claimed: Whether an operation is currently using the record;
+     *      - epoch: The epoch the operation using the record started in, or 0 if it isn't using the queue's nodes;
+     *      - last_epoch: The last epoch seen through the record, to recycle its retired nodes once per epoch;
+     *      - retired and retired_count: The nodes removed through the record in each of the last epochs, which other
+     *        operations may still be reading;
+     *      - free and free_count: Nodes that nobody can be reading anymore, ready to be reused.
+     */
+    _Alignas(CACHE_LINE_SIZE) atomic_bool claimed;
+    atomic_ulong epoch;
+    unsigned long last_epoch;
+    LockFreeNode* retired[LOCK_FREE_EPOCHS];
+    int retired_count;
+    LockFreeNode* free;
+    int free_count;
+};
+
+struct LockFreeQueue {
+    /*
+     * A LockFreeQueue struct has 11 attributes:
+     *      - head: The dummy node, whose successor holds the oldest element;
+     *      - tail: The last node, or (briefly) the one before it;
+     *      - epoch: The global epoch, advanced once every operation has seen the current one;
+     *      - record_count: The number of records that have ever been claimed;
+     *      - free_stack: Recycled nodes shared between records, taken all at once so that there is no ABA problem;
+     *      - allocated: The number of nodes ever allocated, which stays flat once recycling keeps up;
+     *      - waiters, mutex and cond_deq: Consumers parked by LockFreeQueue_deqBlocking, and what they wait on;
+     *      - records: The records operations claim to take part in epoch-based reclamation.
+     *
+     * head and tail each get their own cache line, so that consumers and producers don't invalidate each other's.
+     */
+    _Alignas(CACHE_LINE_SIZE) _Atomic(LockFreeNode*) head;
+    _Alignas(CACHE_LINE_SIZE) _Atomic(LockFreeNode*) tail;
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong epoch;
+    atomic_int record_count;
+    _Atomic(LockFreeNode*) free_stack;
+    atomic_long allocated;
+    _Alignas(CACHE_LINE_SIZE) atomic_int waiters;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_deq;
+    LockFreeRecord records[LOCK_FREE_MAX_RECORDS];
+};
+
+/*
+ * Creates a new, empty LockFreeQueue.
+ * Returns a pointer to a new LockFreeQueue on success and NULL on failure.
+ */
+LockFreeQueue* new_LockFreeQueue(void);
+
+/*
+ * Enqueues the given void* element at the back of this LockFreeQueue, without ever blocking.
+ * Returns false when element is NULL or no node could be allocated, and true on success.
+ */
+bool LockFreeQueue_enq(LockFreeQueue* this, void* element);
+
+/*
+ * Dequeues an element from the front of this LockFreeQueue, without ever blocking.
+ * Returns dequeued void* element on success or NULL if the queue is empty.
+ */
+void* LockFreeQueue_deq(LockFreeQueue* this);
+
+/*
+ * Dequeues an element from the front of this LockFreeQueue.
+ * If the queue is empty, the function will park the calling thread until an element is enqueued.
+ * Returns the dequeued void* element.
+ */
+void* LockFreeQueue_deqBlocking(LockFreeQueue* this);
+
+/*
+ * Returns true if this LockFreeQueue is empty, false otherwise.
+ */
+bool LockFreeQueue_isEmpty(LockFreeQueue* this);
+
+/*
+ * Returns the number of nodes allocated so far by this LockFreeQueue.
+ */
+long LockFreeQueue_allocated(LockFreeQueue* this);
+
+/*
+ * Destroys this LockFreeQueue by freeing the memory used by the LockFreeQueue and all of its nodes.
+ * No other operation may be running on the queue.
+ */
+void LockFreeQueue_destroy(LockFreeQueue* this);
+
+#endif /* LOCK_FREE_QUEUE_H_ */
@@ -0,0 +1,307 @@
+/*
+ * PartitionedQueue.c
+ *
+ * Keyed partitioned queue implementation, with exclusive partition ownership and sticky rebalancing.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "PartitionedQueue.h"
+
+#define NONE -1
+
+/*
+ * Terminates the code, destroys the partitioned queue and prints out an error message if an error is detected.
+ */
+static void exit_partitioned_error(PartitionedQueue* this, char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    PartitionedQueue_destroy(this); // Destroy the partitioned queue
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+/*
+ * Locks the mutex and checks that it has been done.
+ */
+static void lock(PartitionedQueue* this) {
+    if (pthread_mutex_lock(&(*this).mutex)) {
+        exit_partitioned_error(this, "Mutex 'mutex' not locked!");
+    }
+}
+
+/*
+ * Unlocks the mutex and checks that it has been done.
+ */
+static void unlock(PartitionedQueue* this) {
+    if (pthread_mutex_unlock(&(*this).mutex)) {
+        exit_partitioned_error(this, "Mutex 'mutex' not unlocked!");
+    }
+}
+
+/*
+ * Wakes up the owner of the given partition, if it has one, as one of its partitions may now have an element for it.
+ */
+static void signal_owner(PartitionedQueue* this, int partition) {
+    int owner = (*this).owners[partition];
+    if (owner != NONE && pthread_cond_signal(&(*this).consumers[owner].cond)) {
+        exit_partitioned_error(this, "Condition 'cond' not signalled!");
+    }
+}
+
+/*
+ * Ends the processing of the given consumer's current element, with the mutex held, so that its partition can be
+ * served again, possibly to the consumer it has been reassigned to.
+ */
+static void finish_current(PartitionedQueue* this, int consumer) {
+    int partition = (*this).consumers[consumer].current;
+    if (partition == NONE) {
+        return;
+    }
+    (*this).busy[partition] = false;
+    (*this).consumers[consumer].current = NONE;
+    if ((*this).owners[partition] != consumer) {
+        signal_owner(this, partition);
+    }
+}
+
+/*
+ * Reassigns the partitions after a consumer joined or left, with the mutex held.
+ *
+ * Each of the n active consumers is allowed partition_count/n partitions, and the first partition_count%n of them
+ * one more. A consumer keeps the partitions it already owns up to that quota, and only the partitions without an
+ * owner (or whose owner is over quota) are handed to the consumers under quota, so that as few partitions as possible
+ * move. A moved partition that is busy isn't served to its new owner before its old owner is done with its element.
+ */
+static void rebalance(PartitionedQueue* this) {
+    int quota[(*this).partition_count];
+    int rank = ZERO;
+    for (int c = 0; c < (*this).partition_count; c++) {
+        (*this).consumers[c].owned = ZERO;
+        quota[c] = ZERO;
+        if ((*this).consumers[c].active) {
+            quota[c] = (*this).partition_count/(*this).consumer_count
+                    + (rank < (*this).partition_count%(*this).consumer_count ? ONE : ZERO);
+            rank++;
+        }
+    }
+
+    // Keep every partition whose owner is still active and under quota
+    for (int p = 0; p < (*this).partition_count; p++) {
+        int owner = (*this).owners[p];
+        if (owner != NONE && (*this).consumers[owner].owned < quota[owner]) {
+            (*this).consumers[owner].owned++;
+        }
+        else {
+            (*this).owners[p] = NONE;
+        }
+    }
+
+    // Hand the rest out to the consumers under quota
+    int consumer = ZERO;
+    for (int p = 0; p < (*this).partition_count && (*this).consumer_count > ZERO; p++) {
+        if ((*this).owners[p] != NONE) {
+            continue;
+        }
+        while ((*this).consumers[consumer].owned == quota[consumer]) {
+            consumer++;
+        }
+        (*this).owners[p] = consumer;
+        (*this).consumers[consumer].owned++;
+    }
+
+    // Every consumer may have new partitions to look at
+    for (int c = 0; c < (*this).partition_count; c++) {
+        if ((*this).consumers[c].active && pthread_cond_signal(&(*this).consumers[c].cond)) {
+            exit_partitioned_error(this, "Condition 'cond' not signalled!");
+        }
+    }
+}
+
+/*
+ * Returns a partition owned by the given consumer that has an element and isn't busy, starting from its cursor,
+ * or -1 if there is none. Called with the mutex held.
+ */
+static int find_ready(PartitionedQueue* this, int consumer) {
+    int start = (*this).consumers[consumer].cursor;
+    for (int i = 0; i < (*this).partition_count; i++) {
+        int p = (start + i) % (*this).partition_count;
+        if ((*this).owners[p] == consumer && !(*this).busy[p] && !Queue_isEmpty((*this).partitions[p])) {
+            return p;
+        }
+    }
+    return NONE;
+}
+
+
+PartitionedQueue* new_PartitionedQueue(int partition_count, int partition_size) {
+    if (partition_count < ONE || partition_size < ONE) {
+        return NULL;
+    }
+    PartitionedQueue* this = calloc(ONE, sizeof(PartitionedQueue));
+    if (this == NULL) {
+        return NULL;
+    }
+    (*this).partition_count = partition_count;
+    (*this).partitions = calloc(partition_count, sizeof(Queue*));
+    (*this).owners = malloc(sizeof(int)*partition_count);
+    (*this).busy = calloc(partition_count, sizeof(bool));
+    (*this).consumers = calloc(partition_count, sizeof(PartitionedConsumer));
+    (*this).cond_enq = calloc(partition_count, sizeof(pthread_cond_t));
+    (*this).waiting = calloc(partition_count, sizeof(int));
+    if ((*this).partitions == NULL || (*this).owners == NULL || (*this).busy == NULL || (*this).consumers == NULL
+            || (*this).cond_enq == NULL || (*this).waiting == NULL) {
+        free((*this).partitions);
+        free((*this).owners);
+        free((*this).busy);
+        free((*this).consumers);
+        free((*this).cond_enq);
+        free((*this).waiting);
+        free(this);
+        return NULL;
+    }
+
+    // Initialise the mutex and the condition variables, and check that they've been created properly
+    if (pthread_mutex_init(&(*this).mutex, NULL)) {
+        exit_partitioned_error(this, "Mutex 'mutex' not created!");
+    }
+    for (int i = 0; i < partition_count; i++) {
+        if (pthread_cond_init(&(*this).cond_enq[i], NULL)) {
+            exit_partitioned_error(this, "Condition 'cond_enq' not created!");
+        }
+        (*this).owners[i] = NONE;
+        (*this).consumers[i].current = NONE;
+        if (pthread_cond_init(&(*this).consumers[i].cond, NULL)) {
+            exit_partitioned_error(this, "Condition 'cond' not created!");
+        }
+        (*this).partitions[i] = new_Queue(partition_size);
+        if ((*this).partitions[i] == NULL) {
+            PartitionedQueue_destroy(this);
+            return NULL;
+        }
+    }
+    return this;
+}
+
+int PartitionedQueue_partitionOf(PartitionedQueue* this, unsigned long key) {
+    // Mix the key's bits (splitmix64 finaliser), so that sequential keys spread over every partition
+    uint64_t hash = key;
+    hash = (hash ^ (hash >> 30))*0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27))*0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return (int) (hash % (uint64_t) (*this).partition_count);
+}
+
+bool PartitionedQueue_enq(PartitionedQueue* this, unsigned long key, void* element) {
+    if (element == NULL) {
+        return false;
+    }
+    int partition = PartitionedQueue_partitionOf(this, key);
+    lock(this);
+    // Wait for space in the key's partition
+    while (!Queue_enq((*this).partitions[partition], element)) {
+        (*this).waiting[partition]++;
+        if (pthread_cond_wait(&(*this).cond_enq[partition], &(*this).mutex)) {
+            exit_partitioned_error(this, "Condition 'cond_enq' not waited on!");
+        }
+        (*this).waiting[partition]--;
+    }
+    if (!(*this).busy[partition]) {
+        signal_owner(this, partition);
+    }
+    unlock(this);
+    return true;
+}
+
+int PartitionedQueue_join(PartitionedQueue* this) {
+    lock(this);
+    int consumer = NONE;
+    for (int c = 0; c < (*this).partition_count && consumer == NONE; c++) {
+        if (!(*this).consumers[c].active) {
+            consumer = c;
+        }
+    }
+    if (consumer != NONE) {
+        (*this).consumers[consumer].active = true;
+        (*this).consumers[consumer].current = NONE;
+        (*this).consumers[consumer].cursor = ZERO;
+        (*this).consumer_count++;
+        rebalance(this);
+    }
+    unlock(this);
+    return consumer;
+}
+
+void* PartitionedQueue_deq(PartitionedQueue* this, int consumer) {
+    lock(this);
+    finish_current(this, consumer);
+
+    // Wait until one of the consumer's partitions has an element and isn't being processed by its previous owner
+    int partition;
+    while ((partition = find_ready(this, consumer)) == NONE) {
+        if (pthread_cond_wait(&(*this).consumers[consumer].cond, &(*this).mutex)) {
+            exit_partitioned_error(this, "Condition 'cond' not waited on!");
+        }
+    }
+
+    void* element = Queue_deq((*this).partitions[partition]);
+    (*this).busy[partition] = true;
+    (*this).consumers[consumer].current = partition;
+    (*this).consumers[consumer].cursor = (partition + ONE) % (*this).partition_count;
+    // The slot just freed is enough for exactly one of the producers waiting on this partition
+    if ((*this).waiting[partition] > ZERO && pthread_cond_signal(&(*this).cond_enq[partition])) {
+        exit_partitioned_error(this, "Condition 'cond_enq' not signalled!");
+    }
+    unlock(this);
+    return element;
+}
+
+void PartitionedQueue_leave(PartitionedQueue* this, int consumer) {
+    lock(this);
+    if ((*this).consumers[consumer].active) {
+        finish_current(this, consumer);
+        (*this).consumers[consumer].active = false;
+        (*this).consumer_count--;
+        rebalance(this);
+    }
+    unlock(this);
+}
+
+int PartitionedQueue_size(PartitionedQueue* this) {
+    lock(this);
+    int size = ZERO;
+    for (int i = 0; i < (*this).partition_count; i++) {
+        size += Queue_size((*this).partitions[i]);
+    }
+    unlock(this);
+    return size;
+}
+
+bool PartitionedQueue_isEmpty(PartitionedQueue* this) {
+    return PartitionedQueue_size(this) == ZERO;
+}
+
+void PartitionedQueue_destroy(PartitionedQueue* this) {
+    // Destroy the mutex and every condition variable
+    pthread_mutex_destroy(&(*this).mutex);
+    for (int i = 0; i < (*this).partition_count; i++) {
+        pthread_cond_destroy(&(*this).cond_enq[i]);
+        pthread_cond_destroy(&(*this).consumers[i].cond);
+        if ((*this).partitions[i] != NULL) {
+            Queue_destroy((*this).partitions[i]);
+        }
+    }
+
+    // Free the partitions' bookkeeping, then the partitioned queue itself
+    free((*this).partitions);
+    free((*this).owners);
+    free((*this).busy);
+    free((*this).consumers);
+    free((*this).cond_enq);
+    free((*this).waiting);
+    free(this);
+}
@@ -0,0 +1,119 @@
+/*
+ * PartitionedQueue.h
+ *
+ * Module interface for a keyed queue split into partitions, each owned by one consumer at a time,
+ * keeping elements with the same key in order while consumers work on different keys in parallel.
+ *
+ */
+
+#ifndef PARTITIONED_QUEUE_H_
+#define PARTITIONED_QUEUE_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "Queue.h"
+
+typedef struct PartitionedConsumer PartitionedConsumer;
+typedef struct PartitionedQueue PartitionedQueue;
+
+struct PartitionedConsumer {
+    /*
+     * A PartitionedConsumer struct has 5 attributes:
+     *      - active: Whether a consumer has joined with this id and not left yet;
+     *      - owned: The number of partitions currently assigned to the consumer;
+     *      - current: The partition of the element the consumer is processing, or -1 if none;
+     *      - cursor: The partition the consumer's next search starts from, so that it serves its partitions in turn;
+     *      - cond: Signalled when one of the consumer's partitions may have an element for it.
+     */
+    bool active;
+    int owned;
+    int current;
+    int cursor;
+    pthread_cond_t cond;
+};
+
+struct PartitionedQueue {
+    /*
+     * A PartitionedQueue struct has 9 attributes:
+     *      - partition_count: The number of partitions, which is also the maximum number of consumers;
+     *      - partitions: One FIFO Queue per partition;
+     *      - owners: The consumer each partition is assigned to, or -1 if there is none;
+     *      - busy: Whether an element of each partition is being processed;
+     *      - consumers: One PartitionedConsumer per possible consumer id;
+     *      - consumer_count: The number of active consumers;
+     *      - mutex: Protects every other attribute;
+     *      - cond_enq and waiting: One condition per partition, signalled when an element is dequeued from it while
+     *        producers wait for space in it, and the number of producers waiting on each.
+     *
+     * Producers wait on their partition's own condition, so that a dequeue only wakes a producer that can use the
+     * space it made. The mutex stays shared: ownership and rebalancing span every partition.
+     */
+    int partition_count;
+    Queue** partitions;
+    int* owners;
+    bool* busy;
+    PartitionedConsumer* consumers;
+    int consumer_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t* cond_enq;
+    int* waiting;
+};
+
+/*
+ * Creates a new PartitionedQueue of partition_count partitions, each for at most partition_size void* elements.
+ * Returns a pointer to a new PartitionedQueue on success and NULL on failure.
+ */
+PartitionedQueue* new_PartitionedQueue(int partition_count, int partition_size);
+
+/*
+ * Returns the partition that elements with the given key go to.
+ */
+int PartitionedQueue_partitionOf(PartitionedQueue* this, unsigned long key);
+
+/*
+ * Enqueues the given void* element at the back of its key's partition.
+ * If the partition is full, the function will block the calling thread until there is space in it.
+ * Returns false when element is NULL and true on success.
+ */
+bool PartitionedQueue_enq(PartitionedQueue* this, unsigned long key, void* element);
+
+/*
+ * Registers a new consumer, and rebalances the partitions so that every consumer owns the same number
+ * of partitions, give or take one. Partitions only move away from a consumer that has too many.
+ * Returns the new consumer's id, or -1 if every partition already has its own consumer.
+ */
+int PartitionedQueue_join(PartitionedQueue* this);
+
+/*
+ * Dequeues the oldest element of one of the given consumer's partitions, taking the partitions in turn.
+ * If none of them has an element, the function will block until one does.
+ * The element counts as being processed until the consumer calls PartitionedQueue_deq again or leaves:
+ * until then, its partition isn't served to any other consumer, even if it has been reassigned.
+ * Returns the dequeued void* element.
+ */
+void* PartitionedQueue_deq(PartitionedQueue* this, int consumer);
+
+/*
+ * Unregisters the given consumer, which must not be waiting in PartitionedQueue_deq, ending the processing of
+ * its current element, and rebalances its partitions over the remaining consumers.
+ * Elements of partitions left without a consumer stay queued until one joins.
+ */
+void PartitionedQueue_leave(PartitionedQueue* this, int consumer);
+
+/*
+ * Returns the number of elements currently in this PartitionedQueue.
+ */
+int PartitionedQueue_size(PartitionedQueue* this);
+
+/*
+ * Returns true if this PartitionedQueue is empty, false otherwise.
+ */
+bool PartitionedQueue_isEmpty(PartitionedQueue* this);
+
+/*
+ * Destroys this PartitionedQueue by freeing the memory used by the PartitionedQueue.
+ */
+void PartitionedQueue_destroy(PartitionedQueue* this);
+
+#endif /* PARTITIONED_QUEUE_H_ */
@@ -0,0 +1,146 @@
+/*
+ * PerfCounters.c
+ *
+ * Performance counter implementation on top of the perf_event_open system call.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "PerfCounters.h"
+
+#define UNAVAILABLE -1
+
+const char* const PERF_COUNTER_NAMES[PERF_COUNTER_COUNT] = {
+    "cycles",
+    "instructions",
+    "L1d misses",
+    "LLC misses",
+    "HITM",
+    "context switches",
+};
+
+/*
+ * The values read from a counter opened with PERF_FORMAT_TOTAL_TIME_ENABLED and PERF_FORMAT_TOTAL_TIME_RUNNING.
+ */
+struct reading {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+/*
+ * Returns the number of voluntary and involuntary context switches of this process so far.
+ */
+static long rusage_switches() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+/*
+ * Fills in the event type and config of the given counter.
+ * Returns false if there is no event for it on this machine.
+ */
+static bool describe(PerfCounter counter, struct perf_event_attr* attributes) {
+    switch (counter) {
+        case PERF_CYCLES:
+            (*attributes).type = PERF_TYPE_HARDWARE;
+            (*attributes).config = PERF_COUNT_HW_CPU_CYCLES;
+            return true;
+        case PERF_INSTRUCTIONS:
+            (*attributes).type = PERF_TYPE_HARDWARE;
+            (*attributes).config = PERF_COUNT_HW_INSTRUCTIONS;
+            return true;
+        case PERF_L1D_MISSES:
+            (*attributes).type = PERF_TYPE_HW_CACHE;
+            (*attributes).config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            return true;
+        case PERF_LLC_MISSES:
+            (*attributes).type = PERF_TYPE_HARDWARE;
+            (*attributes).config = PERF_COUNT_HW_CACHE_MISSES;
+            return true;
+        case PERF_HITM: {
+            const char* event = getenv("BENCH_HITM_EVENT");
+            if (event == NULL || *event == '\0') {
+                return false;
+            }
+            (*attributes).type = PERF_TYPE_RAW;
+            (*attributes).config = strtoull(event, NULL, 0);
+            return true;
+        }
+        case PERF_CONTEXT_SWITCHES:
+            (*attributes).type = PERF_TYPE_SOFTWARE;
+            (*attributes).config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Opens the given counter for this process and the threads it creates, enabled straight away.
+ * Returns its file descriptor, or -1 if it can't be opened.
+ */
+static int open_counter(PerfCounter counter) {
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    if (!describe(counter, &attributes)) {
+        return UNAVAILABLE;
+    }
+    attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attributes.inherit = 1; // Count the producer and consumer threads too
+    attributes.exclude_hv = 1;
+
+    int fd = (int) syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+    if (fd < 0) {
+        // Unprivileged users may only count user-mode events, which is still most of a queue's work
+        attributes.exclude_kernel = 1;
+        fd = (int) syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+    }
+    return fd < 0 ? UNAVAILABLE : fd;
+}
+
+
+void PerfCounters_start(PerfCounters* this) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        (*this).fds[i] = open_counter(i);
+        (*this).values[i] = UNAVAILABLE;
+    }
+    (*this).switches = rusage_switches();
+}
+
+void PerfCounters_stop(PerfCounters* this) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if ((*this).fds[i] == UNAVAILABLE) {
+            continue;
+        }
+        ioctl((*this).fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        struct reading reading;
+        if (read((*this).fds[i], &reading, sizeof(reading)) == sizeof(reading) && reading.time_running > 0) {
+            // A counter that had to share the hardware with others only ran part of the time: extrapolate
+            (*this).values[i] = (double) reading.value*reading.time_enabled/reading.time_running;
+        }
+        close((*this).fds[i]);
+        (*this).fds[i] = UNAVAILABLE;
+    }
+
+    // Context switches are always available from getrusage, which covers every thread of the process
+    if ((*this).values[PERF_CONTEXT_SWITCHES] < 0) {
+        (*this).values[PERF_CONTEXT_SWITCHES] = rusage_switches() - (*this).switches;
+    }
+}
+
+bool PerfCounters_available(PerfCounters* this, PerfCounter counter) {
+    return (*this).values[counter] >= 0;
+}
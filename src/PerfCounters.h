@@ -0,0 +1,69 @@
+/*
+ * PerfCounters.h
+ *
+ * Module interface for a set of hardware and software performance counters read through perf_event_open,
+ * counting every thread the calling process starts while they are open.
+ *
+ */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <stdbool.h>
+
+/*
+ * The counters, in the order they are reported.
+ * PERF_HITM counts loads served by a modified line in another core's cache (cache-line transfers caused by
+ * true or false sharing). There is no generic event for it, so it is only counted when the BENCH_HITM_EVENT
+ * environment variable gives the raw event code for this processor (e.g. 0x04d2 on Intel Skylake and later).
+ */
+typedef enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_HITM,
+    PERF_CONTEXT_SWITCHES,
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+typedef struct PerfCounters PerfCounters;
+
+struct PerfCounters {
+    /*
+     * A PerfCounters struct has 3 attributes:
+     *      - fds: The perf_event file descriptor of each counter, or -1 if it couldn't be opened;
+     *      - values: Each counter's value when the counters were last stopped, scaled up if it was multiplexed,
+     *        or -1 if it couldn't be counted;
+     *      - switches: The process's context switches when the counters were started, used when there is no
+     *        perf counter for them.
+     */
+    int fds[PERF_COUNTER_COUNT];
+    double values[PERF_COUNTER_COUNT];
+    long switches;
+};
+
+/*
+ * The name of each counter, for reporting.
+ */
+extern const char* const PERF_COUNTER_NAMES[PERF_COUNTER_COUNT];
+
+/*
+ * Opens and starts every counter available to this process, counting the calling thread and every thread it
+ * creates from now on. Counters the processor or the kernel's perf_event_paranoid setting don't allow are left
+ * unavailable; kernel-mode counting is dropped before giving up on a counter.
+ */
+void PerfCounters_start(PerfCounters* this);
+
+/*
+ * Stops the counters and stores their values, then closes them.
+ * Threads created since PerfCounters_start must have been joined for their counts to be included.
+ */
+void PerfCounters_stop(PerfCounters* this);
+
+/*
+ * Returns true if the given counter was counted.
+ */
+bool PerfCounters_available(PerfCounters* this, PerfCounter counter);
+
+#endif /* PERF_COUNTERS_H_ */
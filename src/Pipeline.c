@@ -0,0 +1,337 @@
+/*
+ * Pipeline.c
+ *
+ * Multi-stage pipeline implementation, with per-stage worker pools, metrics and an optional autotuner.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Pipeline.h"
+
+#define MICROSECONDS_PER_MILLISECOND 1000
+#define NANOSECONDS_PER_SECOND 1e9
+
+/*
+ * A worker that dequeues this token exits. Being an element like any other, it is only seen once the elements
+ * queued before it have been processed. Only Pipeline_stop sends them: the autotuner retires workers through their
+ * stage's retiring counter instead, so that it never waits for room in a full input.
+ */
+static char retire_token;
+#define RETIRE ((void*) &retire_token)
+
+/*
+ * Terminates the code and prints out an error message if an error is detected.
+ */
+static void exit_pipeline_error(char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+/*
+ * Locks the mutex protecting a stage's workers, running and throughput, and checks that it has been done.
+ */
+static void lock_stage(PipelineStage* stage) {
+    if (pthread_mutex_lock(&(*stage).mutex)) {
+        exit_pipeline_error("Mutex 'mutex' not locked!");
+    }
+}
+
+/*
+ * Unlocks the mutex protecting a stage's workers, running and throughput, and checks that it has been done.
+ */
+static void unlock_stage(PipelineStage* stage) {
+    if (pthread_mutex_unlock(&(*stage).mutex)) {
+        exit_pipeline_error("Mutex 'mutex' not unlocked!");
+    }
+}
+
+
+/*
+ * Lets Pipeline_stop know that one more worker of the given stage has exited. The stage's mutex must be locked.
+ */
+static void count_exit(PipelineStage* stage) {
+    (*stage).running--;
+    if (pthread_cond_broadcast(&(*stage).cond_running)) {
+        exit_pipeline_error("Condition 'cond_running' not signalled!");
+    }
+}
+
+/*
+ * Returns whether the calling worker should exit, taking one of the retirements the autotuner asked for.
+ * The worker leaves running under the same lock, so that Pipeline_stop never sends it a token.
+ */
+static bool take_retirement(PipelineStage* stage) {
+    if (atomic_load_explicit(&(*stage).retiring, memory_order_relaxed) == ZERO) {
+        return false;
+    }
+    lock_stage(stage);
+    bool retire = atomic_load_explicit(&(*stage).retiring, memory_order_relaxed) > ZERO;
+    if (retire) {
+        atomic_fetch_sub_explicit(&(*stage).retiring, ONE, memory_order_relaxed);
+        count_exit(stage);
+    }
+    unlock_stage(stage);
+    return retire;
+}
+
+static void* worker(void* arg) {
+    PipelineStage* stage = arg;
+    for (;;) {
+        if (take_retirement(stage)) {
+            return NULL;
+        }
+        // Wait for at most one interval, so that an idle worker still sees the retirements the autotuner asks for
+        void* element = BlockingQueue_deqTimed((*stage).input, PIPELINE_MONITOR_INTERVAL_MS*MICROSECONDS_PER_MILLISECOND);
+        if (element == NULL) {
+            continue;
+        }
+        if (element == RETIRE) {
+            break;
+        }
+        void* result = (*stage).function(element, (*stage).context);
+        atomic_fetch_add_explicit(&(*stage).processed, ONE, memory_order_relaxed);
+        // Pass the result on, unless it was dropped or this is the last stage without a sink
+        if (result != NULL && (*stage).output != NULL) {
+            BlockingQueue_enq((*stage).output, result);
+        }
+    }
+
+    lock_stage(stage);
+    count_exit(stage);
+    unlock_stage(stage);
+    return NULL;
+}
+
+/*
+ * Starts one more worker thread for the given stage.
+ */
+static void spawn_worker(PipelineStage* stage) {
+    lock_stage(stage);
+    (*stage).running++;
+    unlock_stage(stage);
+
+    // Workers are detached: Pipeline_stop waits for them through running instead of joining them
+    pthread_t thread;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attributes, worker, stage)) {
+        exit_pipeline_error("Worker thread not created!");
+    }
+    pthread_attr_destroy(&attributes);
+}
+
+/*
+ * Returns how full the given queue is, between 0 and 1, or 0 for no queue.
+ */
+static double fullness(BlockingQueue* queue) {
+    if (queue == NULL) {
+        return ZERO;
+    }
+    return (double) BlockingQueue_size(queue)/BlockingQueue_capacity(queue);
+}
+
+/*
+ * Moves one worker from a stage that keeps up easily to the bottleneck stage, if there is a clear one.
+ *
+ * A stage's pressure is how much fuller its input is than its output. Because of backpressure, every stage upstream
+ * of the bottleneck also ends up with a full input, but its workers are stuck on a full output, so its pressure is
+ * low: the bottleneck is the stage with the highest pressure. The donor must have less than half that pressure,
+ * so that workers don't bounce between similar stages.
+ */
+static void autotune(Pipeline* this, double* pressures) {
+    int bottleneck = -1;
+    for (int i = 0; i < (*this).stage_count; i++) {
+        if (pressures[i] > ZERO && (bottleneck < ZERO || pressures[i] > pressures[bottleneck])) {
+            bottleneck = i;
+        }
+    }
+    if (bottleneck < ZERO) {
+        return; // Every stage keeps up
+    }
+    int donor = -1;
+    for (int i = 0; i < (*this).stage_count; i++) {
+        if (i != bottleneck && (*this).stages[i].workers > ONE && pressures[i]*2 < pressures[bottleneck]
+                && (donor < ZERO || pressures[i] < pressures[donor])) {
+            donor = i;
+        }
+    }
+    if (donor < ZERO) {
+        return; // No stage can spare a worker
+    }
+
+    /*
+     * Retire one of the donor's workers once it is done with its current element, or has waited an interval for one,
+     * and start one for the bottleneck.
+     * The retirement is a counter rather than a token in the donor's input, which may be full: the monitor must never
+     * block on it.
+     */
+    lock_stage(&(*this).stages[donor]);
+    (*this).stages[donor].workers--;
+    atomic_fetch_add_explicit(&(*this).stages[donor].retiring, ONE, memory_order_relaxed);
+    unlock_stage(&(*this).stages[donor]);
+    lock_stage(&(*this).stages[bottleneck]);
+    (*this).stages[bottleneck].workers++;
+    unlock_stage(&(*this).stages[bottleneck]);
+    spawn_worker(&(*this).stages[bottleneck]);
+}
+
+/*
+ * The monitor thread: measures every stage's throughput once per interval, and autotunes if enabled.
+ */
+static void* monitor(void* arg) {
+    Pipeline* this = arg;
+    long last_processed[PIPELINE_MAX_STAGES] = {0};
+    struct timespec last;
+    clock_gettime(CLOCK_MONOTONIC, &last);
+
+    while (!atomic_load(&(*this).stopping)) {
+        usleep(PIPELINE_MONITOR_INTERVAL_MS*MICROSECONDS_PER_MILLISECOND);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec)/NANOSECONDS_PER_SECOND;
+        last = now;
+
+        double pressures[PIPELINE_MAX_STAGES];
+        for (int i = 0; i < (*this).stage_count; i++) {
+            PipelineStage* stage = &(*this).stages[i];
+            long processed = atomic_load_explicit(&(*stage).processed, memory_order_relaxed);
+            lock_stage(stage);
+            (*stage).throughput = (processed - last_processed[i])/elapsed;
+            unlock_stage(stage);
+            last_processed[i] = processed;
+            pressures[i] = fullness((*stage).input) - fullness((*stage).output);
+        }
+        if ((*this).autotune) {
+            autotune(this, pressures);
+        }
+    }
+    return NULL;
+}
+
+
+Pipeline* new_Pipeline(int queue_size, BlockingQueue* sink) {
+    Pipeline* this = calloc(ONE, sizeof(Pipeline));
+    if (this == NULL) {
+        return NULL;
+    }
+    (*this).queue_size = queue_size;
+    (*this).sink = sink;
+    atomic_init(&(*this).stopping, false);
+    return this;
+}
+
+int Pipeline_addStage(Pipeline* this, const char* name, PipelineFunction function, void* context, int workers) {
+    if ((*this).started || (*this).stage_count == PIPELINE_MAX_STAGES || function == NULL || workers < ONE) {
+        return -1;
+    }
+    PipelineStage* stage = &(*this).stages[(*this).stage_count];
+    (*stage).input = new_BlockingQueue((*this).queue_size);
+    if ((*stage).input == NULL) {
+        return -1;
+    }
+    (*stage).name = name;
+    (*stage).function = function;
+    (*stage).context = context;
+    (*stage).workers = workers;
+    (*stage).running = ZERO;
+    atomic_init(&(*stage).retiring, ZERO);
+    atomic_init(&(*stage).processed, ZERO);
+    (*stage).throughput = ZERO;
+    if (pthread_mutex_init(&(*stage).mutex, NULL)) {
+        exit_pipeline_error("Mutex 'mutex' not created!");
+    }
+    if (pthread_cond_init(&(*stage).cond_running, NULL)) {
+        exit_pipeline_error("Condition 'cond_running' not created!");
+    }
+
+    // Chain the new stage after the previous one
+    if ((*this).stage_count > ZERO) {
+        (*this).stages[(*this).stage_count - 1].output = (*stage).input;
+    }
+    (*stage).output = (*this).sink;
+    return (*this).stage_count++;
+}
+
+void Pipeline_start(Pipeline* this, bool autotune) {
+    if ((*this).started) {
+        return;
+    }
+    (*this).started = true;
+    (*this).autotune = autotune;
+    for (int i = 0; i < (*this).stage_count; i++) {
+        for (int j = 0; j < (*this).stages[i].workers; j++) {
+            spawn_worker(&(*this).stages[i]);
+        }
+    }
+    if (pthread_create(&(*this).monitor, NULL, monitor, this)) {
+        exit_pipeline_error("Monitor thread not created!");
+    }
+}
+
+bool Pipeline_submit(Pipeline* this, void* element) {
+    if ((*this).stage_count == ZERO) {
+        return false;
+    }
+    return BlockingQueue_enq((*this).stages[0].input, element);
+}
+
+void Pipeline_stats(Pipeline* this, int stage, PipelineStats* stats) {
+    (*stats).processed = atomic_load_explicit(&(*this).stages[stage].processed, memory_order_relaxed);
+    (*stats).depth = BlockingQueue_size((*this).stages[stage].input);
+    lock_stage(&(*this).stages[stage]);
+    (*stats).workers = (*this).stages[stage].workers;
+    (*stats).running = (*this).stages[stage].running;
+    (*stats).throughput = (*this).stages[stage].throughput;
+    unlock_stage(&(*this).stages[stage]);
+}
+
+void Pipeline_stop(Pipeline* this) {
+    if (!(*this).started || atomic_exchange(&(*this).stopping, true)) {
+        return;
+    }
+    // Stop the monitor first, so that no worker is moved while the stages are being drained
+    pthread_join((*this).monitor, NULL);
+
+    /*
+     * Drain the stages in order: every worker of a stage gets a retire token behind the elements already queued,
+     * and the stage's workers have all exited (so have passed on all their results) before the next stage is drained.
+     * Retirements the autotuner asked for and no worker has taken yet are cancelled, so that each running worker
+     * exits exactly once, through its token.
+     */
+    for (int i = 0; i < (*this).stage_count; i++) {
+        PipelineStage* stage = &(*this).stages[i];
+        lock_stage(stage);
+        int running = (*stage).running;
+        atomic_store_explicit(&(*stage).retiring, ZERO, memory_order_relaxed);
+        unlock_stage(stage);
+        for (int j = 0; j < running; j++) {
+            BlockingQueue_enq((*stage).input, RETIRE);
+        }
+
+        lock_stage(stage);
+        while ((*stage).running > ZERO) {
+            if (pthread_cond_wait(&(*stage).cond_running, &(*stage).mutex)) {
+                exit_pipeline_error("Condition 'cond_running' not waited on!");
+            }
+        }
+        unlock_stage(stage);
+    }
+}
+
+void Pipeline_destroy(Pipeline* this) {
+    Pipeline_stop(this);
+    for (int i = 0; i < (*this).stage_count; i++) {
+        pthread_mutex_destroy(&(*this).stages[i].mutex);
+        pthread_cond_destroy(&(*this).stages[i].cond_running);
+        BlockingQueue_destroy((*this).stages[i].input);
+    }
+    free(this);
+}
@@ -0,0 +1,141 @@
+/*
+ * Pipeline.h
+ *
+ * Module interface for a multi-stage processing pipeline, with a pool of worker threads per stage
+ * and BlockingQueues chaining the stages together.
+ *
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "BlockingQueue.h"
+
+#define PIPELINE_MAX_STAGES 16
+#define PIPELINE_MONITOR_INTERVAL_MS 50
+
+/*
+ * A stage's function processes one element, returning the element to pass on to the next stage
+ * (or to the pipeline's sink after the last stage), or NULL to drop it.
+ */
+typedef void* (*PipelineFunction)(void* element, void* context);
+
+typedef struct PipelineStage PipelineStage;
+typedef struct PipelineStats PipelineStats;
+typedef struct Pipeline Pipeline;
+
+struct PipelineStage {
+    /*
+     * A PipelineStage struct has 12 attributes:
+     *      - name: The stage's name, for reporting;
+     *      - function and context: The function applied to each element, and the context passed to it;
+     *      - input: The BlockingQueue the stage's workers dequeue from;
+     *      - output: The next stage's input, the pipeline's sink, or NULL to drop the last stage's results;
+     *      - workers: The number of worker threads the stage should have;
+     *      - running: The number of worker threads currently running;
+     *      - retiring: The number of worker threads the autotuner has retired, which have yet to exit;
+     *      - mutex and cond_running: Protect workers, running, throughput and changes to retiring, and signal when a
+     *        worker exits;
+     *      - processed: The number of elements processed so far;
+     *      - throughput: The number of elements processed per second over the last monitoring interval.
+     */
+    const char* name;
+    PipelineFunction function;
+    void* context;
+    BlockingQueue* input;
+    BlockingQueue* output;
+    int workers;
+    int running;
+    atomic_int retiring;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_running;
+    atomic_long processed;
+    double throughput;
+};
+
+struct PipelineStats {
+    /*
+     * A PipelineStats struct is a snapshot of one stage's metrics:
+     *      - processed: The number of elements processed so far;
+     *      - depth: The number of elements waiting in the stage's input;
+     *      - workers: The number of worker threads the stage should have;
+     *      - running: The number of worker threads still running, which trails workers until retired ones exit;
+     *      - throughput: The number of elements processed per second over the last monitoring interval.
+     */
+    long processed;
+    int depth;
+    int workers;
+    int running;
+    double throughput;
+};
+
+struct Pipeline {
+    /*
+     * A Pipeline struct has 8 attributes:
+     *      - queue_size: The capacity of each stage's input;
+     *      - stage_count and stages: The stages, in processing order;
+     *      - sink: Where the last stage's results go (NULL to drop them);
+     *      - autotune: Whether the monitor moves workers towards the bottleneck stage;
+     *      - monitor: The thread measuring throughput, and autotuning if enabled;
+     *      - started and stopping: The pipeline's state.
+     */
+    int queue_size;
+    int stage_count;
+    PipelineStage stages[PIPELINE_MAX_STAGES];
+    BlockingQueue* sink;
+    bool autotune;
+    pthread_t monitor;
+    bool started;
+    atomic_bool stopping;
+};
+
+/*
+ * Creates a new Pipeline whose stages have inputs of at most queue_size elements, and whose last stage's results
+ * are enqueued to sink (which may be NULL to drop them).
+ * Returns a pointer to a new Pipeline on success and NULL on failure.
+ */
+Pipeline* new_Pipeline(int queue_size, BlockingQueue* sink);
+
+/*
+ * Appends a stage applying function to each element with the given number of worker threads.
+ * Stages can only be added before the pipeline is started.
+ * Returns the index of the new stage, or -1 on failure.
+ */
+int Pipeline_addStage(Pipeline* this, const char* name, PipelineFunction function, void* context, int workers);
+
+/*
+ * Starts every stage's workers, and the monitor thread.
+ * If autotune is true, the monitor periodically moves a worker from a stage that keeps up to the bottleneck stage
+ * (the one whose input is fullest compared to its output), keeping the total number of workers the same.
+ */
+void Pipeline_start(Pipeline* this, bool autotune);
+
+/*
+ * Submits an element to the first stage.
+ * If the first stage's input is full, the function will block the calling thread until there is space.
+ * Returns false when element is NULL and true on success.
+ */
+bool Pipeline_submit(Pipeline* this, void* element);
+
+/*
+ * Stores a snapshot of the given stage's metrics in stats.
+ */
+void Pipeline_stats(Pipeline* this, int stage, PipelineStats* stats);
+
+/*
+ * Stops the pipeline after every submitted element has gone through all the stages, and waits for the workers to exit.
+ * No element may be submitted once this has been called.
+ */
+void Pipeline_stop(Pipeline* this);
+
+/*
+ * Destroys this Pipeline by freeing the memory used by the Pipeline, stopping it first if needed.
+ * The sink is owned by the caller and isn't destroyed.
+ */
+void Pipeline_destroy(Pipeline* this);
+
+#endif /* PIPELINE_H_ */
@@ -10,69 +10,257 @@
 
 #include "Queue.h"
 
+#define SIZE_TRIES 4
+
 /*
  * The functions below all return default values and don't work.
  * You will need to provide a correct implementation of the Queue module interface as documented in Queue.h.
  */
 
+/*
+ * Return this Queue's array and capacity. Only Queue_swapArray changes them, while neither the producer nor the
+ * consumer is running, so relaxed loads are enough for both sides; lock-free readers check the layout around them.
+ */
+static inline void* _Atomic* array(Queue* this) {
+    return atomic_load_explicit(&(*this).arr, memory_order_relaxed);
+}
+
+static inline int capacity(Queue* this) {
+    return atomic_load_explicit(&(*this).capacity, memory_order_relaxed);
+}
+
 
 Queue *new_Queue(int max_size) {
-    // Create the pointer to the new queue using malloc
-    Queue* this = malloc(sizeof(Queue));
+    return new_QueueWithAllocator(max_size, QueueAllocator_malloc());
+}
+
+Queue* new_QueueWithAllocator(int max_size, QueueAllocator allocator) {
+    // Create the pointer to the new queue, aligned so that the producer and consumer lines really are separate lines
+    Queue* this = aligned_alloc(CACHE_LINE_SIZE, sizeof(Queue));
+    if (this == NULL) {
+        return NULL;
+    }
 
     /*
-     * Initialise all 5 Queue attributes:
-     *      - arr is initialised as an empty array of max_size + 1 void* elements;
+     * Initialise all 8 Queue attributes:
+     *      - arr is initialised as an empty array of max_size + 1 void* elements, taken from the allocator;
      *      - capacity is set to the inputted max_size;
-     *      - size is set to 0;
-     *      - front is set to 0;
-     *      - rear is set to -1.
+     *      - allocator is kept so that arr can be given back to it;
+     *      - layout, rear, front and both caches are set to 0.
      */
-    (*this).arr = malloc(sizeof(void*)*(max_size + 1));
-    (*this).capacity = max_size;
-    (*this).size = ZERO;
-    (*this).front = ZERO;
-    (*this).rear = -ONE;
+    (*this).allocator = allocator;
+    void* _Atomic* arr = Queue_allocateArray(this, max_size);
+    if (arr == NULL) {
+        free(this);
+        return NULL;
+    }
+    atomic_init(&(*this).arr, arr);
+    atomic_init(&(*this).capacity, max_size);
+    atomic_init(&(*this).layout, ZERO);
+    atomic_init(&(*this).rear, ZERO);
+    (*this).front_cache = ZERO;
+    (*this).reserved = ZERO;
+    atomic_init(&(*this).front, ZERO);
+    (*this).rear_cache = ZERO;
 
     // Return the pointer to the new queue
     return this;
 }
 
 bool Queue_enq(Queue* this, void* element) {
-    // Return false if the queue is full, or if the enqueued element is NULL
-    if (Queue_size(this) == (*this).capacity || element == NULL) {
+    // Return false if the enqueued element is NULL
+    if (element == NULL) {
         return false;
     }
-    // Otherwise, enqueue the element to the back of the queue and return true
-    else {
-        (*this).rear = ((*this).rear + 1)%(*this).capacity; // Increase the rear by 1 (mod the capacity of the queue)
-        (*this).arr[(*this).rear] = element; // Enqueue the element to the back of the queue
-        (*this).size++; // Increase the size by 1
-        return true;
+
+    // Only the producer writes rear, so it can be read without synchronisation
+    size_t rear = atomic_load_explicit(&(*this).rear, memory_order_relaxed);
+
+    // The queue looks full from the cached front: re-read the real front, and return false if it is still full
+    size_t max_size = capacity(this);
+    if (rear - (*this).front_cache == max_size) {
+        (*this).front_cache = atomic_load_explicit(&(*this).front, memory_order_acquire);
+        if (rear - (*this).front_cache == max_size) {
+            return false;
+        }
     }
+
+    // Otherwise, enqueue the element to the back of the queue, then publish it to the consumer and return true
+    // (the slot is atomic because a walk may be reading it, but rear's release store is what publishes it)
+    atomic_store_explicit(&array(this)[rear % max_size], element, memory_order_relaxed);
+    atomic_store_explicit(&(*this).rear, rear + 1, memory_order_release);
+    return true;
 }
 
 void* Queue_deq(Queue* this) {
-    // Return NULL if the queue is empty
-    if (Queue_isEmpty(this)) {
+    // Only the consumer writes front, so it can be read without synchronisation
+    size_t front = atomic_load_explicit(&(*this).front, memory_order_relaxed);
+
+    // The queue looks empty from the cached rear: re-read the real rear, and return NULL if it is still empty
+    if (front == (*this).rear_cache) {
+        (*this).rear_cache = atomic_load_explicit(&(*this).rear, memory_order_acquire);
+        if (front == (*this).rear_cache) {
+            return NULL;
+        }
+    }
+
+    // Otherwise, dequeue the element at the front of the queue, then hand its slot back to the producer and return it
+    void* element = atomic_load_explicit(&array(this)[front % capacity(this)], memory_order_relaxed);
+    atomic_store_explicit(&(*this).front, front + 1, memory_order_release);
+    return element;
+}
+
+/*
+ * Returns the number of slots from the given position to the end of this Queue's array.
+ */
+static size_t until_wrap(Queue* this, size_t position) {
+    return capacity(this) - position % capacity(this);
+}
+
+void* _Atomic* Queue_reserve(Queue* this, int n, int* count) {
+    *count = ZERO;
+    (*this).reserved = ZERO;
+    if (n < ONE) {
         return NULL;
     }
-    // Otherwise, dequeue the element at the front of the queue and return it
-    else {
-        void* element = (*this).arr[(*this).front];
-        (*this).front = ((*this).front + 1)%(*this).capacity; // Increase the front by 1 (mod the capacity of the queue)
-        (*this).size--; // Reduce the size by 1
-        return element;
+    size_t rear = atomic_load_explicit(&(*this).rear, memory_order_relaxed);
+
+    // Refresh the cached front if it doesn't show enough free slots, as Queue_enq does when the queue looks full
+    size_t free_slots = capacity(this) - (rear - (*this).front_cache);
+    if (free_slots < (size_t) n) {
+        (*this).front_cache = atomic_load_explicit(&(*this).front, memory_order_acquire);
+        free_slots = capacity(this) - (rear - (*this).front_cache);
+        if (free_slots == ZERO) {
+            return NULL;
+        }
+    }
+
+    // Hand out as many of the requested slots as are free and contiguous
+    size_t span = until_wrap(this, rear);
+    if (span > free_slots) {
+        span = free_slots;
+    }
+    if (span > (size_t) n) {
+        span = n;
+    }
+    *count = (int) span;
+    (*this).reserved = (int) span;
+    return &array(this)[rear % capacity(this)];
+}
+
+bool Queue_commit(Queue* this, int n) {
+    if (n < ZERO || n > (*this).reserved) {
+        return false;
+    }
+    // Publish the elements written in place, as Queue_enq does for a single one
+    size_t rear = atomic_load_explicit(&(*this).rear, memory_order_relaxed);
+    atomic_store_explicit(&(*this).rear, rear + n, memory_order_release);
+    (*this).reserved = ZERO;
+    return true;
+}
+
+void** Queue_peek(Queue* this, int n, int* count) {
+    *count = ZERO;
+    if (n < ONE) {
+        return NULL;
+    }
+    size_t front = atomic_load_explicit(&(*this).front, memory_order_relaxed);
+
+    // Refresh the cached rear if it doesn't show enough elements, as Queue_deq does when the queue looks empty
+    size_t available = (*this).rear_cache - front;
+    if (available < (size_t) n) {
+        (*this).rear_cache = atomic_load_explicit(&(*this).rear, memory_order_acquire);
+        available = (*this).rear_cache - front;
+        if (available == ZERO) {
+            return NULL;
+        }
+    }
+
+    // Give access to as many of the requested elements as are there and contiguous
+    size_t span = until_wrap(this, front);
+    if (span > available) {
+        span = available;
+    }
+    if (span > (size_t) n) {
+        span = n;
+    }
+    *count = (int) span;
+    return (void**) &array(this)[front % capacity(this)];
+}
+
+bool Queue_release(Queue* this, int n) {
+    size_t front = atomic_load_explicit(&(*this).front, memory_order_relaxed);
+    // The last peek refreshed rear_cache, so it shows at least the elements that were peeked
+    if (n < ZERO || front + n > (*this).rear_cache) {
+        return false;
+    }
+    // Hand the slots back to the producer, as Queue_deq does for a single one
+    atomic_store_explicit(&(*this).front, front + n, memory_order_release);
+    return true;
+}
+
+/*
+ * Starts reading the indices of this Queue, seqlock style: returns the current layout, waiting for any clear or
+ * resize in progress (odd layout) to finish.
+ */
+static unsigned int begin_read(Queue* this) {
+    unsigned int layout;
+    while ((layout = atomic_load_explicit(&(*this).layout, memory_order_acquire)) % 2 != ZERO) {
+        continue;
     }
+    return layout;
+}
+
+/*
+ * Finishes reading the indices of this Queue: returns true if no clear or resize started since begin_read
+ * returned the given layout, so that everything read in between is consistent.
+ */
+static bool end_read(Queue* this, unsigned int layout) {
+    // The indices are read with acquire loads, which already keep this load after them
+    return atomic_load_explicit(&(*this).layout, memory_order_acquire) == layout;
+}
+
+/*
+ * Starts changing the indices of this Queue: makes the layout odd until end_write, so that readers try again.
+ * The indices must then be stored with release stores, which keep this change before them.
+ */
+static void begin_write(Queue* this) {
+    atomic_fetch_add_explicit(&(*this).layout, ONE, memory_order_relaxed);
+}
+
+/*
+ * Finishes changing the indices of this Queue, making the layout even again.
+ */
+static void end_write(Queue* this) {
+    atomic_fetch_add_explicit(&(*this).layout, ONE, memory_order_release);
 }
 
 int Queue_size(Queue* this) {
-    return (*this).size; // The number of elements currently in this queue
+    // Read rear on both sides of front: if neither rear nor the layout moved, both indices held when front was read
+    for (int tries = 0; tries < SIZE_TRIES; tries++) {
+        unsigned int layout = begin_read(this);
+        size_t rear = atomic_load_explicit(&(*this).rear, memory_order_acquire);
+        size_t front = atomic_load_explicit(&(*this).front, memory_order_acquire);
+        if (atomic_load_explicit(&(*this).rear, memory_order_acquire) == rear && end_read(this, layout)) {
+            return (int) (rear - front);
+        }
+    }
+
+    // Both sides are too busy to catch a quiet moment: read front before rear, so that rear can only be newer
+    // and the difference is never negative
+    size_t front = atomic_load_explicit(&(*this).front, memory_order_acquire);
+    size_t rear = atomic_load_explicit(&(*this).rear, memory_order_acquire);
+
+    // While both sides are running, the two reads may be far enough apart to overshoot the capacity
+    if (rear - front > (size_t) capacity(this)) {
+        return capacity(this);
+    }
+    return (int) (rear - front); // The number of elements currently in this queue
 }
 
 bool Queue_isEmpty(Queue* this) {
     // The queue is empty if the number of elements currently in it is 0 <=> its size is 0
-    if ((*this).size == ZERO) {
+    if (Queue_size(this) == ZERO) {
         return true; // Return true if the queue is empty
     }
     else {
@@ -80,20 +268,130 @@ bool Queue_isEmpty(Queue* this) {
     }
 }
 
+void* Queue_front(Queue* this) {
+    QueueIterator iterator;
+    void* element;
+    Queue_iterate(this, &iterator);
+    QueueIterator_next(&iterator, &element);
+    return element;
+}
+
+void Queue_iterate(Queue* this, QueueIterator* iterator) {
+    (*iterator).queue = this;
+    (*iterator).layout = begin_read(this);
+    (*iterator).next = atomic_load_explicit(&(*this).front, memory_order_acquire);
+    (*iterator).end = atomic_load_explicit(&(*this).rear, memory_order_acquire); // Publishes every element up to end
+    if ((*iterator).end - (*iterator).next > (size_t) capacity(this)) {
+        (*iterator).next = (*iterator).end; // Raced with a clear: walk nothing, end_read will stop the walk anyway
+    }
+}
+
+bool QueueIterator_next(QueueIterator* iterator, void** element) {
+    Queue* this = (*iterator).queue;
+    *element = NULL;
+    while ((*iterator).next < (*iterator).end && end_read(this, (*iterator).layout)) {
+        // Skip the elements dequeued since the last one returned
+        size_t front = atomic_load_explicit(&(*this).front, memory_order_acquire);
+        if (front > (*iterator).next) {
+            (*iterator).next = front;
+            continue;
+        }
+
+        /*
+         * front works as the slot's sequence number: the producer only reuses the slot once the consumer has moved
+         * front past it, so if front still hasn't moved past it after the read, the read saw the element the walk
+         * expects. Otherwise, go round again to skip it. The array and capacity are read inside the same layout
+         * window, so a swap of the array in the meantime is caught by end_read too.
+         */
+        void* _Atomic* arr = atomic_load(&(*this).arr); // Sequentially consistent, see BlockingQueue_resize
+        int max_size = atomic_load_explicit(&(*this).capacity, memory_order_acquire);
+        if (!end_read(this, (*iterator).layout)) {
+            break; // They may not belong together: don't index one with the other
+        }
+        void* candidate = atomic_load_explicit(&arr[(*iterator).next % max_size], memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&(*this).front, memory_order_relaxed) <= (*iterator).next
+                && end_read(this, (*iterator).layout)) {
+            *element = candidate;
+            (*iterator).next++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool QueueIterator_valid(QueueIterator* iterator) {
+    return end_read((*iterator).queue, (*iterator).layout);
+}
+
 void Queue_clear(Queue* this) {
-    /*
-     * To clear the queue:
-     *      - Reset its size to 0;
-     *      - Reset its front to 0;
-     *      - Reset its rear to -1.
-     */
-    (*this).size = ZERO;
-    (*this).front = ZERO;
-    (*this).rear = -ONE;
+    // To clear the queue, reset its rear, its front and both cached copies to 0, telling lock-free readers about it
+    begin_write(this);
+    atomic_store_explicit(&(*this).rear, ZERO, memory_order_release);
+    (*this).front_cache = ZERO;
+    (*this).reserved = ZERO;
+    atomic_store_explicit(&(*this).front, ZERO, memory_order_release);
+    (*this).rear_cache = ZERO;
+    end_write(this);
+}
+
+bool Queue_resize(Queue* this, int new_capacity) {
+    if (new_capacity < ONE || Queue_size(this) > new_capacity) {
+        return false;
+    }
+    void* _Atomic* arr = Queue_allocateArray(this, new_capacity);
+    if (arr == NULL) {
+        return false;
+    }
+    int arr_capacity = new_capacity;
+    bool swapped = Queue_swapArray(this, &arr, &arr_capacity);
+    Queue_releaseArray(this, arr, arr_capacity); // The old array, or the new one if the elements didn't fit
+    return swapped;
+}
+
+void* _Atomic* Queue_allocateArray(Queue* this, int capacity) {
+    // Each array has one extra slot, as it always had
+    return (*this).allocator.allocate(sizeof(void* _Atomic)*(capacity + 1), (*this).allocator.context);
+}
+
+void Queue_releaseArray(Queue* this, void* _Atomic* arr, int capacity) {
+    (*this).allocator.release(arr, sizeof(void* _Atomic)*(capacity + 1), (*this).allocator.context);
+}
+
+bool Queue_swapArray(Queue* this, void* _Atomic** arr, int* new_capacity) {
+    int size = Queue_size(this);
+    if (*new_capacity < ONE || size > *new_capacity) {
+        return false;
+    }
+    void* _Atomic* old_arr = array(this);
+    int old_capacity = capacity(this);
+
+    // Copy the elements over from front to rear, so that the front element ends up at index 0
+    size_t front = atomic_load_explicit(&(*this).front, memory_order_relaxed);
+    for (int i = 0; i < size; i++) {
+        atomic_store_explicit(&(*arr)[i], atomic_load_explicit(&old_arr[(front + i) % old_capacity],
+                                                               memory_order_relaxed), memory_order_relaxed);
+    }
+    begin_write(this);
+    atomic_store(&(*this).arr, *arr); // Sequentially consistent, so that callers can tell when walks may use it
+    atomic_store_explicit(&(*this).capacity, *new_capacity, memory_order_release);
+
+    // Restart the indices from the new layout
+    atomic_store_explicit(&(*this).front, ZERO, memory_order_release);
+    (*this).rear_cache = ZERO;
+    atomic_store_explicit(&(*this).rear, size, memory_order_release);
+    (*this).front_cache = ZERO;
+    (*this).reserved = ZERO;
+    end_write(this);
+
+    // Hand the old array back to the caller
+    *arr = old_arr;
+    *new_capacity = old_capacity;
+    return true;
 }
 
 void Queue_destroy(Queue* this) {
     // The queue uses memory twice: once for the array to store the elements, and once for itself
-    free((*this).arr); // Free the memory used for the array
+    Queue_releaseArray(this, array(this), capacity(this)); // Give the array back to its allocator
     free(this); // Free the memory used for itself
 }
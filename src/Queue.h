@@ -9,26 +9,66 @@
 #define QUEUE_H_
 #define ZERO 0
 #define ONE 1
+#define CACHE_LINE_SIZE 64
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "QueueAllocator.h"
 
 typedef struct Queue Queue;
+typedef struct QueueIterator QueueIterator;
 
 /* You should define your struct Queue here */
 struct Queue {
     /*
-     * A Queue struct has 5 attributes:
-     *      - arr: The queue, represented as an array of void* elements;
+     * A Queue struct has 9 attributes, laid out so that the producer and the consumer never write to the same cache line.
+     *
+     * Cold attributes, only written when the queue is created, cleared or resized:
+     *      - arr: The queue, represented as an array of void* elements. The slots, like arr and capacity themselves,
+     *        are atomic so that lock-free readers may load them while the producer or a resize stores them;
      *      - capacity: The queue's maximum capacity;
-     *      - size: The number of currently enqueued elements;
-     *      - front: The index of the element at the front of the queue;
-     *      - rear: The index of the element at the back of the queue.
+     *      - allocator: The memory backend that arr was obtained from, and is given back to;
+     *      - layout: A sequence number, odd while Queue_clear or Queue_resize moves the indices, so that lock-free
+     *        readers (Queue_size and the snapshot iterator) can tell that they raced with one and try again.
+     *
+     * Producer-owned cache line:
+     *      - rear: The number of elements ever enqueued, so the next element goes to arr[rear % capacity];
+     *      - front_cache: The producer's stale copy of front, only re-read when the queue looks full;
+     *      - reserved: The number of slots handed out by the last Queue_reserve that have yet to be committed.
+     *
+     * Consumer-owned cache line:
+     *      - front: The number of elements ever dequeued, so the front element is at arr[front % capacity];
+     *      - rear_cache: The consumer's stale copy of rear, only re-read when the queue looks empty.
+     *
+     * The size of the queue is rear - front, so there is no counter that both sides have to modify.
+     */
+    void* _Atomic* _Atomic arr;
+    atomic_int capacity;
+    QueueAllocator allocator;
+    atomic_uint layout;
+
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t rear;
+    size_t front_cache;
+    int reserved;
+
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t front;
+    size_t rear_cache;
+};
+
+struct QueueIterator {
+    /*
+     * A QueueIterator struct has 4 attributes:
+     *      - queue: The Queue being walked;
+     *      - layout: The queue's layout when the walk started, to stop the walk if the queue is cleared or resized;
+     *      - next: The position (counted like rear and front) of the next element to return;
+     *      - end: The value of rear when the walk started, so that the walk ends even if producers keep going.
      */
-    void** arr;
-    int capacity;
-    int size;
-    int front;
-    int rear;
+    Queue* queue;
+    unsigned int layout;
+    size_t next;
+    size_t end;
 };
 
 /*
@@ -37,6 +77,17 @@ struct Queue {
  */
 Queue* new_Queue(int max_size);
 
+/*
+ * Creates a new Queue for at most max_size void* elements, whose array is obtained from the given allocator.
+ * Returns a pointer to a new Queue on success and NULL on failure (including when the allocator is out of memory).
+ */
+Queue* new_QueueWithAllocator(int max_size, QueueAllocator allocator);
+
+/*
+ * A Queue may be used by one producer thread and one consumer thread at the same time without locking.
+ * Any other concurrent use (e.g. several producers) must be serialised by the caller.
+ */
+
 /*
  * Enqueues the given void* element at the back of this Queue.
  * Returns true on success and false on enq failure when element is NULL or queue is full.
@@ -50,10 +101,72 @@ bool Queue_enq(Queue* this, void* element);
 void* Queue_deq(Queue* this);
 
 /*
- * Returns the number of elements currently in this Queue.
+ * Reserves up to n free slots at the back of this Queue, for the producer to write elements into directly.
+ * The slots are contiguous, so the span stops at the end of the array and may be shorter than n even when more
+ * slots are free. Stores the number of reserved slots in count, and returns a pointer to the first one,
+ * or NULL (with count set to 0) if n < 1 or the queue is full.
+ * The slots only become visible to the consumer once they are committed. As a walk (see Queue_iterate) may be reading
+ * them, the producer must write them with relaxed atomic stores, e.g.
+ * atomic_store_explicit(&slots[i], element, memory_order_relaxed), just as Queue_enq does.
+ */
+void* _Atomic* Queue_reserve(Queue* this, int n, int* count);
+
+/*
+ * Publishes the first n slots of the last reservation, which must all hold non-NULL elements, to the consumer,
+ * and ends the reservation.
+ * Returns false, publishing nothing, if n is negative or more than the number of slots reserved.
+ */
+bool Queue_commit(Queue* this, int n);
+
+/*
+ * Gives access to up to n elements at the front of this Queue without dequeuing them, for the consumer to read
+ * them in place. As for Queue_reserve, the span stops at the end of the array.
+ * Stores the number of elements in count, and returns a pointer to the first one,
+ * or NULL (with count set to 0) if n < 1 or the queue is empty.
+ */
+void** Queue_peek(Queue* this, int n, int* count);
+
+/*
+ * Dequeues the first n elements of the last peek, handing their slots back to the producer.
+ * Returns false, dequeuing nothing, if n is negative or more than the number of elements in the queue.
+ */
+bool Queue_release(Queue* this, int n);
+
+/*
+ * Returns the number of elements currently in this Queue. It can be called from any thread without locking,
+ * and returns a size the queue really had at some point during the call whenever it can read rear and front
+ * at the same moment (it tries a few times), and otherwise an estimate between 0 and the capacity.
  */
 int Queue_size(Queue* this);
 
+/*
+ * Returns the element at the front of this Queue without dequeuing it, or NULL if the queue is empty.
+ * It can be called from any thread without locking, under the same conditions as a walk (see Queue_iterate).
+ */
+void* Queue_front(Queue* this);
+
+/*
+ * Starts a walk over the elements currently in this Queue, oldest first, with the given iterator.
+ * The walk can run in any thread without locking and without slowing down the producer or the consumer, and across
+ * a Queue_swapArray as long as the old array isn't released while the walk is running.
+ */
+void Queue_iterate(Queue* this, QueueIterator* iterator);
+
+/*
+ * Stores the next element of the walk in element. Elements dequeued while the walk is running are skipped rather
+ * than read after their slot may have been reused, and elements enqueued after the walk started are left out, so
+ * every element returned really was in the queue, in order.
+ * Returns true on success, and false (with element set to NULL) once the walk is over or if the queue was cleared
+ * or resized, in which case the caller may start a new walk.
+ */
+bool QueueIterator_next(QueueIterator* iterator, void** element);
+
+/*
+ * Returns true if the queue hasn't been cleared or resized since the walk started, so that the walk saw every element
+ * it should have, and false if it was cut short.
+ */
+bool QueueIterator_valid(QueueIterator* iterator);
+
 /*
  * Returns true if this Queue is empty, false otherwise.
  */
@@ -64,6 +177,33 @@ bool Queue_isEmpty(Queue* this);
  */
 void Queue_clear(Queue* this);
 
+/*
+ * Moves the elements of this Queue, in order, into a new array for at most new_capacity elements.
+ * Must not run concurrently with any other operation on this Queue.
+ * Returns true on success and false if the elements don't fit or the new array cannot be allocated.
+ */
+bool Queue_resize(Queue* this, int new_capacity);
+
+/*
+ * Obtains an array for at most capacity elements from this Queue's allocator, for Queue_swapArray.
+ * Returns the array on success and NULL on failure.
+ */
+void* _Atomic* Queue_allocateArray(Queue* this, int capacity);
+
+/*
+ * Gives an array obtained from Queue_allocateArray, or handed back by Queue_swapArray, back to this Queue's allocator.
+ */
+void Queue_releaseArray(Queue* this, void* _Atomic* arr, int capacity);
+
+/*
+ * Moves the elements of this Queue, in order, into the array *arr for at most *capacity elements, and stores the old
+ * array and capacity in *arr and *capacity, for the caller to release once no walk can still be reading them.
+ * Splitting the resize this way lets the caller allocate and release outside whatever stops the producer and the
+ * consumer, which must not run concurrently with it; walks may, and start again from the new array.
+ * Returns false, changing nothing, if the elements don't fit.
+ */
+bool Queue_swapArray(Queue* this, void* _Atomic** arr, int* capacity);
+
 /*
  * Destroys this Queue by freeing the memory used by the Queue.
  */
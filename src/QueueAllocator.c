@@ -0,0 +1,137 @@
+/*
+ * QueueAllocator.c
+ *
+ * Memory backends for Queue arrays: malloc, huge pages, lazily committed mappings and arenas.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "QueueAllocator.h"
+
+#define HUGE_PAGE_SIZE (2UL*1024*1024)
+#define ARENA_ALIGNMENT 64
+
+/*
+ * Rounds bytes up to the next multiple of alignment (a power of two).
+ */
+static size_t round_up(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) & ~(alignment - 1);
+}
+
+
+static void* malloc_allocate(size_t bytes, void* context) {
+    (void) context;
+    return malloc(bytes);
+}
+
+static void malloc_release(void* memory, size_t bytes, void* context) {
+    (void) bytes;
+    (void) context;
+    free(memory);
+}
+
+QueueAllocator QueueAllocator_malloc(void) {
+    QueueAllocator allocator = {malloc_allocate, malloc_release, NULL};
+    return allocator;
+}
+
+
+static void* huge_allocate(size_t bytes, void* context) {
+    (void) context;
+    size_t length = round_up(bytes, HUGE_PAGE_SIZE);
+
+    // Try explicit huge pages first, which only succeeds if the administrator has reserved some
+    void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+        return memory;
+    }
+
+    /*
+     * Otherwise fall back to transparent huge pages:
+     *      - Over-map by one huge page so that a 2MB-aligned start can be found inside the mapping;
+     *      - Unmap the unaligned head and tail;
+     *      - Advise the kernel to back the aligned region with huge pages.
+     */
+    char* raw = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char* aligned = (char*) round_up((uintptr_t) raw, HUGE_PAGE_SIZE);
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
+    }
+    if (aligned + length < raw + length + HUGE_PAGE_SIZE) {
+        munmap(aligned + length, (raw + length + HUGE_PAGE_SIZE) - (aligned + length));
+    }
+    madvise(aligned, length, MADV_HUGEPAGE); // Only advisory: the mapping is usable even if THP is disabled
+    return aligned;
+}
+
+static void huge_release(void* memory, size_t bytes, void* context) {
+    (void) context;
+    munmap(memory, round_up(bytes, HUGE_PAGE_SIZE));
+}
+
+QueueAllocator QueueAllocator_hugePages(void) {
+    QueueAllocator allocator = {huge_allocate, huge_release, NULL};
+    return allocator;
+}
+
+
+static void* lazy_allocate(size_t bytes, void* context) {
+    (void) context;
+    // MAP_NORESERVE skips commit accounting: the range is only reserved, and each page is backed on first touch
+    void* memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+    return memory;
+}
+
+static void lazy_release(void* memory, size_t bytes, void* context) {
+    (void) context;
+    munmap(memory, bytes);
+}
+
+QueueAllocator QueueAllocator_lazy(void) {
+    QueueAllocator allocator = {lazy_allocate, lazy_release, NULL};
+    return allocator;
+}
+
+
+static void* arena_allocate(size_t bytes, void* context) {
+    QueueArena* arena = context;
+    // Keep every array on its own cache line so neighbouring queues don't share one, aligning the address itself
+    // since the caller's block may start anywhere
+    uintptr_t base = (uintptr_t) (*arena).memory;
+    size_t start = round_up(base + (*arena).used, ARENA_ALIGNMENT) - base;
+    if (start > (*arena).size || bytes > (*arena).size - start) {
+        return NULL; // Not enough space left in the arena
+    }
+    (*arena).used = start + bytes;
+    return (*arena).memory + start;
+}
+
+static void arena_release(void* memory, size_t bytes, void* context) {
+    // Arena memory is owned by the caller and reclaimed all at once
+    (void) memory;
+    (void) bytes;
+    (void) context;
+}
+
+QueueAllocator QueueAllocator_arena(QueueArena* arena) {
+    QueueAllocator allocator = {arena_allocate, arena_release, arena};
+    return allocator;
+}
+
+void QueueArena_init(QueueArena* arena, void* memory, size_t size) {
+    (*arena).memory = memory;
+    (*arena).size = size;
+    (*arena).used = 0;
+}
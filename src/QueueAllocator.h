@@ -0,0 +1,69 @@
+/*
+ * QueueAllocator.h
+ *
+ * Module interface for the pluggable memory backends used to store a Queue's array.
+ *
+ */
+
+#ifndef QUEUE_ALLOCATOR_H_
+#define QUEUE_ALLOCATOR_H_
+
+#include <stddef.h>
+
+typedef struct QueueAllocator QueueAllocator;
+typedef struct QueueArena QueueArena;
+
+struct QueueAllocator {
+    /*
+     * A QueueAllocator struct has 3 attributes:
+     *      - allocate: Returns bytes bytes of storage for a queue's array, or NULL on failure;
+     *      - release: Gives back storage of bytes bytes previously returned by allocate;
+     *      - context: Passed unchanged to both functions (e.g. the QueueArena of an arena allocator).
+     */
+    void* (*allocate)(size_t bytes, void* context);
+    void (*release)(void* memory, size_t bytes, void* context);
+    void* context;
+};
+
+struct QueueArena {
+    /*
+     * A QueueArena struct has 3 attributes:
+     *      - memory: The caller-supplied block that queue arrays are carved out of;
+     *      - size: The size of the block in bytes;
+     *      - used: The number of bytes already handed out.
+     */
+    char* memory;
+    size_t size;
+    size_t used;
+};
+
+/*
+ * Returns the default allocator, which uses malloc and free.
+ */
+QueueAllocator QueueAllocator_malloc(void);
+
+/*
+ * Returns an allocator backed by huge pages.
+ * Explicit (hugetlbfs) pages are tried first, falling back to a 2MB-aligned mapping advised
+ * for transparent huge pages when none are reserved.
+ */
+QueueAllocator QueueAllocator_hugePages(void);
+
+/*
+ * Returns an allocator that reserves the whole array up front with mmap but only commits
+ * memory for pages as the ring first touches them.
+ */
+QueueAllocator QueueAllocator_lazy(void);
+
+/*
+ * Returns an allocator that carves arrays out of the given arena.
+ * Arena memory is never given back individually: it belongs to the caller and outlives the queues.
+ */
+QueueAllocator QueueAllocator_arena(QueueArena* arena);
+
+/*
+ * Initialises an arena over the given block of size bytes.
+ */
+void QueueArena_init(QueueArena* arena, void* memory, size_t size);
+
+#endif /* QUEUE_ALLOCATOR_H_ */
@@ -0,0 +1,184 @@
+/*
+ * QueueEngine.c
+ *
+ * Adapters exposing each queue implementation through the QueueEngine interface.
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <sched.h>
+
+#include "QueueEngine.h"
+#include "Queue.h"
+#include "BlockingQueue.h"
+#include "LockFreeQueue.h"
+#include "CombiningQueue.h"
+#include "ReliableQueue.h"
+#include "DelayQueue.h"
+
+#define RELIABLE_VISIBILITY_MS 600000 // Long enough that no lease expires during a run
+
+
+/*
+ * Queue never blocks, so its adapter yields the processor until the operation succeeds.
+ * A Queue only supports one producer and one consumer at a time.
+ */
+
+static void* queue_create(int capacity) {
+    return new_Queue(capacity);
+}
+
+static void queue_enq(void* queue, void* element) {
+    while (!Queue_enq(queue, element)) {
+        sched_yield();
+    }
+}
+
+static void* queue_deq(void* queue) {
+    void* element;
+    while ((element = Queue_deq(queue)) == NULL) {
+        sched_yield();
+    }
+    return element;
+}
+
+static void queue_destroy(void* queue) {
+    Queue_destroy(queue);
+}
+
+
+static void* blocking_create(int capacity) {
+    return new_BlockingQueue(capacity);
+}
+
+static void blocking_enq(void* queue, void* element) {
+    BlockingQueue_enq(queue, element);
+}
+
+static void* blocking_deq(void* queue) {
+    return BlockingQueue_deq(queue);
+}
+
+static void blocking_destroy(void* queue) {
+    BlockingQueue_destroy(queue);
+}
+
+/*
+ * The same BlockingQueue, waking the most recently parked consumer first, so that runs can compare wakeup policies.
+ */
+static void* blocking_lifo_create(int capacity) {
+    BlockingQueue* queue = new_BlockingQueue(capacity);
+    if (queue != NULL) {
+        BlockingQueue_setWakeup(queue, BLOCKING_QUEUE_WAKE_LIFO);
+    }
+    return queue;
+}
+
+
+/*
+ * LockFreeQueue is unbounded, so its adapter ignores the capacity, and parks consumers while it is empty.
+ */
+
+static void* lock_free_create(int capacity) {
+    (void) capacity;
+    return new_LockFreeQueue();
+}
+
+static void lock_free_enq(void* queue, void* element) {
+    LockFreeQueue_enq(queue, element);
+}
+
+static void* lock_free_deq(void* queue) {
+    return LockFreeQueue_deqBlocking(queue);
+}
+
+static void lock_free_destroy(void* queue) {
+    LockFreeQueue_destroy(queue);
+}
+
+
+static void* combining_create(int capacity) {
+    return new_CombiningQueue(capacity);
+}
+
+static void combining_enq(void* queue, void* element) {
+    CombiningQueue_enq(queue, element);
+}
+
+static void* combining_deq(void* queue) {
+    return CombiningQueue_deq(queue);
+}
+
+static void combining_destroy(void* queue) {
+    CombiningQueue_destroy(queue);
+}
+
+
+/*
+ * ReliableQueue leases each element to its consumer, so its adapter acknowledges the element as soon as it is dequeued.
+ * No lease expires during a run, so every element is delivered exactly once, as from the other engines.
+ */
+
+static void* reliable_create(int capacity) {
+    return new_ReliableQueue(capacity, RELIABLE_VISIBILITY_MS);
+}
+
+static void reliable_enq(void* queue, void* element) {
+    ReliableQueue_enq(queue, element);
+}
+
+static void* reliable_deq(void* queue) {
+    ReliableHandle handle;
+    void* element = ReliableQueue_deq(queue, &handle);
+    ReliableQueue_ack(queue, handle);
+    return element;
+}
+
+static void reliable_destroy(void* queue) {
+    ReliableQueue_destroy(queue);
+}
+
+
+/*
+ * DelayQueue orders elements by deadline, so its adapter enqueues them without a delay: they are due straight away,
+ * and come out in the order they arrived. Delays are covered by TestDelayQueue.
+ */
+
+static void* delay_create(int capacity) {
+    return new_DelayQueue(capacity);
+}
+
+static void delay_enq(void* queue, void* element) {
+    DelayQueue_enq(queue, element, ZERO);
+}
+
+static void* delay_deq(void* queue) {
+    return DelayQueue_deq(queue);
+}
+
+static void delay_destroy(void* queue) {
+    DelayQueue_destroy(queue);
+}
+
+
+const QueueEngine QUEUE_ENGINES[] = {
+    {"Queue", ONE, ONE, queue_create, queue_enq, queue_deq, queue_destroy},
+    {"BlockingQueue", ZERO, ZERO, blocking_create, blocking_enq, blocking_deq, blocking_destroy},
+    {"BlockingQueueLifo", ZERO, ZERO, blocking_lifo_create, blocking_enq, blocking_deq, blocking_destroy},
+    {"LockFreeQueue", ZERO, ZERO, lock_free_create, lock_free_enq, lock_free_deq, lock_free_destroy},
+    {"CombiningQueue", ZERO, ZERO, combining_create, combining_enq, combining_deq, combining_destroy},
+    {"ReliableQueue", ZERO, ZERO, reliable_create, reliable_enq, reliable_deq, reliable_destroy},
+    {"DelayQueue", ZERO, ZERO, delay_create, delay_enq, delay_deq, delay_destroy},
+};
+
+const int QUEUE_ENGINE_COUNT = sizeof(QUEUE_ENGINES)/sizeof(QUEUE_ENGINES[0]);
+
+const QueueEngine* QueueEngine_find(const char* name) {
+    for (int i = 0; i < QUEUE_ENGINE_COUNT; i++) {
+        if (strcmp(QUEUE_ENGINES[i].name, name) == 0) {
+            return &QUEUE_ENGINES[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,43 @@
+/*
+ * QueueEngine.h
+ *
+ * Module interface for a uniform view of every queue implementation, used by the soak and benchmark programs.
+ *
+ */
+
+#ifndef QUEUE_ENGINE_H_
+#define QUEUE_ENGINE_H_
+
+typedef struct QueueEngine QueueEngine;
+
+struct QueueEngine {
+    /*
+     * A QueueEngine struct has 7 attributes:
+     *      - name: The name used to select the engine on the command line;
+     *      - max_producers and max_consumers: How many threads may enqueue and dequeue concurrently (0 for no limit);
+     *      - create: Creates a queue of the given capacity, returning NULL on failure;
+     *      - enq: Enqueues a non-NULL element, waiting for space if the queue is full;
+     *      - deq: Dequeues an element, waiting for one if the queue is empty;
+     *      - destroy: Destroys a queue returned by create.
+     */
+    const char* name;
+    int max_producers;
+    int max_consumers;
+    void* (*create)(int capacity);
+    void (*enq)(void* queue, void* element);
+    void* (*deq)(void* queue);
+    void (*destroy)(void* queue);
+};
+
+/*
+ * The engines available to the soak and benchmark programs, in the order they are run by default.
+ */
+extern const QueueEngine QUEUE_ENGINES[];
+extern const int QUEUE_ENGINE_COUNT;
+
+/*
+ * Returns the engine with the given name, or NULL if there is none.
+ */
+const QueueEngine* QueueEngine_find(const char* name);
+
+#endif /* QUEUE_ENGINE_H_ */
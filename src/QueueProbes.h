@@ -0,0 +1,59 @@
+/*
+ * QueueProbes.h
+ *
+ * USDT static tracepoints for the queue modules.
+ *
+ * When <sys/sdt.h> is available (e.g. from systemtap-sdt-dev), each probe compiles to a single nop recorded in the
+ * binary's .note.stapsdt section, which bpftrace or perf can attach to at run time:
+ *      bpftrace -e 'usdt:./SoakQueue:blockingqueue:deq_block { @start[tid] = nsecs; }
+ *                   usdt:./SoakQueue:blockingqueue:deq_wake /@start[tid]/ { @wait = hist(nsecs - @start[tid]); }'
+ * Without it, or when built with -DQUEUE_NO_PROBES, the probes compile to nothing (their arguments aren't evaluated).
+ *
+ * Each probe has an SDT semaphore, which tracers increment while they are attached to it, so that a probe compiled in
+ * but not traced costs a load and a predicted branch: its arguments are only evaluated while it is being traced.
+ *
+ */
+
+#ifndef QUEUE_PROBES_H_
+#define QUEUE_PROBES_H_
+
+#if defined(__has_include) && !defined(QUEUE_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define QUEUE_PROBES_ENABLED 1
+#endif
+#endif
+
+/*
+ * Defines the semaphore of the probe blockingqueue:name, in the .probes section where tracers look for it.
+ * Every probe fired with QUEUE_PROBE needs its semaphore defined once in the program.
+ */
+#ifdef QUEUE_PROBES_ENABLED
+#define QUEUE_PROBE_SEMAPHORE(name) \
+    __extension__ unsigned short blockingqueue_##name##_semaphore __attribute__((unused, section(".probes")))
+#else
+#define QUEUE_PROBE_SEMAPHORE(name) struct queue_probe_##name##_unused
+#endif
+
+/*
+ * Returns whether a tracer is attached to the probe blockingqueue:name, for code that only runs to feed it.
+ */
+#ifdef QUEUE_PROBES_ENABLED
+#define QUEUE_PROBE_ENABLED(name) __builtin_expect(blockingqueue_##name##_semaphore != 0, 0)
+#else
+#define QUEUE_PROBE_ENABLED(name) 0
+#endif
+
+/*
+ * Fires the probe blockingqueue:name with the queue, the element (NULL if there is none yet) and the current size,
+ * if a tracer is attached to it.
+ */
+#ifdef QUEUE_PROBES_ENABLED
+#define QUEUE_PROBE(name, queue, element, size) \
+    do { if (QUEUE_PROBE_ENABLED(name)) DTRACE_PROBE3(blockingqueue, name, queue, element, size); } while (0)
+#else
+#define QUEUE_PROBE(name, queue, element, size) do { (void) sizeof(queue); (void) sizeof(element); (void) sizeof(size); } while (0)
+#endif
+
+#endif /* QUEUE_PROBES_H_ */
@@ -0,0 +1,258 @@
+/*
+ * QueueTrace.c
+ *
+ * Workload trace implementation: in-memory recording, trace files, and the workload derived from a trace.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "QueueTrace.h"
+
+#define ZERO 0
+#define ONE 1
+#define NANOSECONDS_PER_SECOND 1000000000L
+#define TRACE_MAGIC "QTRACE\r\n"
+#define TRACE_VERSION 1
+
+/*
+ * A trace file starts with this header, followed by the records.
+ */
+typedef struct QueueTraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t records;
+    uint64_t dropped;
+} QueueTraceHeader;
+
+/*
+ * The number given to the calling thread in traces, or 0 until it records its first event, and the last number given.
+ */
+static _Thread_local uint32_t thread_number;
+static atomic_uint last_thread_number;
+
+static long monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+
+QueueTrace* new_QueueTrace(size_t capacity) {
+    if (capacity < ONE) {
+        return NULL;
+    }
+    QueueTrace* this = malloc(sizeof(QueueTrace));
+    if (this == NULL) {
+        return NULL;
+    }
+    (*this).records = calloc(capacity, sizeof(QueueTraceRecord));
+    if ((*this).records == NULL) {
+        free(this);
+        return NULL;
+    }
+    (*this).capacity = capacity;
+    atomic_init(&(*this).next, ZERO);
+    (*this).start_ns = monotonic_ns();
+    return this;
+}
+
+void QueueTrace_record(QueueTrace* this, QueueTraceEvent event, int count) {
+    if (count < ONE) {
+        return;
+    }
+    if (thread_number == ZERO) {
+        thread_number = atomic_fetch_add_explicit(&last_thread_number, ONE, memory_order_relaxed) + ONE;
+    }
+    uint64_t time_ns = monotonic_ns() - (*this).start_ns;
+    size_t first = atomic_fetch_add_explicit(&(*this).next, count, memory_order_relaxed);
+    for (size_t i = first; i < first + count && i < (*this).capacity; i++) {
+        (*this).records[i].time_ns = time_ns;
+        (*this).records[i].thread = thread_number;
+        (*this).records[i].event = event;
+    }
+}
+
+size_t QueueTrace_size(QueueTrace* this) {
+    size_t next = atomic_load_explicit(&(*this).next, memory_order_relaxed);
+    return next < (*this).capacity ? next : (*this).capacity;
+}
+
+size_t QueueTrace_dropped(QueueTrace* this) {
+    size_t next = atomic_load_explicit(&(*this).next, memory_order_relaxed);
+    return next > (*this).capacity ? next - (*this).capacity : ZERO;
+}
+
+bool QueueTrace_save(QueueTrace* this, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    QueueTraceHeader header;
+    memset(&header, ZERO, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(QueueTraceRecord);
+    header.records = QueueTrace_size(this);
+    header.dropped = QueueTrace_dropped(this);
+    bool saved = fwrite(&header, sizeof(header), ONE, file) == ONE
+            && fwrite((*this).records, sizeof(QueueTraceRecord), header.records, file) == header.records;
+    return fclose(file) == ZERO && saved;
+}
+
+QueueTrace* QueueTrace_load(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    QueueTraceHeader header;
+    if (fread(&header, sizeof(header), ONE, file) != ONE || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))
+            || header.version != TRACE_VERSION || header.record_size != sizeof(QueueTraceRecord)) {
+        fclose(file);
+        return NULL;
+    }
+    QueueTrace* this = new_QueueTrace(header.records > ZERO ? header.records : ONE);
+    if (this == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    if (fread((*this).records, sizeof(QueueTraceRecord), header.records, file) != header.records) {
+        QueueTrace_destroy(this);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    // The trace was full if events were dropped: keep counting them past its capacity, as when it was recorded
+    if (header.dropped > ZERO) {
+        (*this).capacity = header.records;
+    }
+    atomic_store(&(*this).next, header.records + header.dropped);
+    return this;
+}
+
+/*
+ * Orders records by time, enqueues first when they tie (an element can't leave before it arrives), then by thread,
+ * so that a thread's events recorded at the same time stay together.
+ */
+static int compare_records(const void* a, const void* b) {
+    const QueueTraceRecord* x = a;
+    const QueueTraceRecord* y = b;
+    if ((*x).time_ns != (*y).time_ns) {
+        return (*x).time_ns < (*y).time_ns ? -ONE : ONE;
+    }
+    if ((*x).event != (*y).event) {
+        return (*x).event == QUEUE_TRACE_ENQ ? -ONE : (*y).event == QUEUE_TRACE_ENQ ? ONE : ZERO;
+    }
+    return (*x).thread < (*y).thread ? -ONE : (*x).thread > (*y).thread;
+}
+
+/*
+ * Returns the index of thread in threads, adding it if it isn't there yet.
+ */
+static int thread_index(uint32_t* threads, int* count, uint32_t thread) {
+    for (int i = 0; i < *count; i++) {
+        if (threads[i] == thread) {
+            return i;
+        }
+    }
+    threads[*count] = thread;
+    return (*count)++;
+}
+
+QueueTraceProfile* QueueTrace_profile(QueueTrace* this) {
+    size_t size = QueueTrace_size(this);
+    size_t room = size > ZERO ? size : ONE;
+    QueueTraceProfile* profile = calloc(ONE, sizeof(QueueTraceProfile));
+    QueueTraceRecord* records = malloc(room*sizeof(QueueTraceRecord));
+    uint32_t* producers = malloc(room*sizeof(uint32_t));
+    uint32_t* consumers = malloc(room*sizeof(uint32_t));
+    long* last_deq = malloc(room*sizeof(long));
+    if (profile != NULL) {
+        (*profile).arrival_ns = malloc(room*sizeof(long));
+        (*profile).arrival_producer = malloc(room*sizeof(int));
+        (*profile).service_ns = malloc(room*sizeof(long));
+        (*profile).sojourn_ns = malloc(room*sizeof(long));
+    }
+    if (profile == NULL || records == NULL || producers == NULL || consumers == NULL || last_deq == NULL
+            || (*profile).arrival_ns == NULL || (*profile).arrival_producer == NULL || (*profile).service_ns == NULL
+            || (*profile).sojourn_ns == NULL) {
+        if (profile != NULL) {
+            QueueTraceProfile_destroy(profile);
+        }
+        free(records);
+        free(producers);
+        free(consumers);
+        free(last_deq);
+        return NULL;
+    }
+
+    // A thread that never got to write its record left it zeroed, with no thread: skip it
+    size_t count = ZERO;
+    for (size_t i = 0; i < size; i++) {
+        if ((*this).records[i].thread != ZERO) {
+            records[count++] = (*this).records[i];
+        }
+    }
+    qsort(records, count, sizeof(QueueTraceRecord), compare_records);
+
+    long first_ns = ZERO;
+    long departed = ZERO;
+    for (size_t i = 0; i < count; i++) {
+        QueueTraceRecord record = records[i];
+        long time_ns = record.time_ns;
+        // An overwrite drops the oldest element still in the queue, then counts as an arrival
+        if (record.event == QUEUE_TRACE_OVERWRITE && departed < (*profile).arrivals) {
+            departed++;
+        }
+        if (record.event == QUEUE_TRACE_ENQ || record.event == QUEUE_TRACE_OVERWRITE) {
+            if ((*profile).arrivals == ZERO) {
+                first_ns = time_ns;
+            }
+            (*profile).arrival_producer[(*profile).arrivals] =
+                    thread_index(producers, &(*profile).producers, record.thread);
+            (*profile).arrival_ns[(*profile).arrivals++] = time_ns - first_ns;
+            continue;
+        }
+        // Elements leave in the order they arrived: this is the departure of the oldest one still in the queue,
+        // unless it was already there when the trace started
+        if (departed >= (*profile).arrivals) {
+            continue;
+        }
+        long arrival_ns = (*profile).arrival_ns[departed++] + first_ns;
+        if (record.event != QUEUE_TRACE_DEQ) {
+            continue;
+        }
+        (*profile).sojourn_ns[(*profile).sojourns++] = time_ns - arrival_ns;
+        int known = (*profile).consumers;
+        int consumer = thread_index(consumers, &(*profile).consumers, record.thread);
+        // The element was already there when the consumer took its previous one, so it was busy all along
+        if (consumer < known && arrival_ns <= last_deq[consumer]) {
+            (*profile).service_ns[(*profile).services++] = time_ns - last_deq[consumer];
+        }
+        last_deq[consumer] = time_ns;
+    }
+
+    free(records);
+    free(producers);
+    free(consumers);
+    free(last_deq);
+    return profile;
+}
+
+void QueueTraceProfile_destroy(QueueTraceProfile* this) {
+    free((*this).arrival_ns);
+    free((*this).arrival_producer);
+    free((*this).service_ns);
+    free((*this).sojourn_ns);
+    free(this);
+}
+
+void QueueTrace_destroy(QueueTrace* this) {
+    free((*this).records);
+    free(this);
+}
@@ -0,0 +1,138 @@
+/*
+ * QueueTrace.h
+ *
+ * Module interface for compact binary traces of a queue's workload: when each element was enqueued and dequeued,
+ * and by which thread. A trace is recorded in memory (see BlockingQueue_record), saved to a file, and loaded back
+ * to derive the arrival schedule and service times that ReplayQueue re-drives every queue engine with.
+ *
+ */
+
+#ifndef QUEUE_TRACE_H_
+#define QUEUE_TRACE_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * What a trace record stands for:
+ *      - QUEUE_TRACE_ENQ: An element was enqueued;
+ *      - QUEUE_TRACE_DEQ: An element was dequeued by a consumer;
+ *      - QUEUE_TRACE_DROP: The oldest element was evicted by a producer, because the queue was full, or dropped when
+ *        the queue was cleared;
+ *      - QUEUE_TRACE_OVERWRITE: An element was enqueued in place of the oldest one, which was dropped, because the
+ *        queue was full. Profiles count it as the departure of the oldest element, then the arrival of the new one.
+ */
+typedef enum QueueTraceEvent {
+    QUEUE_TRACE_ENQ,
+    QUEUE_TRACE_DEQ,
+    QUEUE_TRACE_DROP,
+    QUEUE_TRACE_OVERWRITE
+} QueueTraceEvent;
+
+typedef struct QueueTraceRecord QueueTraceRecord;
+typedef struct QueueTrace QueueTrace;
+typedef struct QueueTraceProfile QueueTraceProfile;
+
+struct QueueTraceRecord {
+    /*
+     * A QueueTraceRecord struct is one event, in 16 bytes, stored as is in trace files:
+     *      - time_ns: When the event happened, in nanoseconds since the trace was created;
+     *      - thread: The thread it happened on, numbered from 1 in the order threads first recorded an event;
+     *      - event: The QueueTraceEvent.
+     */
+    uint64_t time_ns;
+    uint32_t thread;
+    uint32_t event;
+};
+
+struct QueueTrace {
+    /*
+     * A QueueTrace struct has 4 attributes:
+     *      - records and capacity: The records, and the most the trace can hold;
+     *      - next: The number of records claimed so far, which may exceed the capacity (the excess is dropped);
+     *      - start_ns: The CLOCK_MONOTONIC time the records' times count from.
+     *
+     * Recording claims slots with a single atomic increment, so that threads recording at the same time never wait
+     * for each other. Records are only in time order per thread.
+     */
+    QueueTraceRecord* records;
+    size_t capacity;
+    atomic_size_t next;
+    long start_ns;
+};
+
+struct QueueTraceProfile {
+    /*
+     * A QueueTraceProfile struct has 9 attributes, describing the workload of a trace:
+     *      - producers and consumers: The number of threads that enqueued and that dequeued elements;
+     *      - arrivals, arrival_ns and arrival_producer: The number of enqueues, when each happened (in nanoseconds
+     *        since the first one, in order) and which producer made it (from 0 to producers - 1);
+     *      - services and service_ns: Samples of the time consumers spent on an element, between two dequeues;
+     *      - sojourns and sojourn_ns: The time each dequeued element spent in the queue.
+     */
+    int producers;
+    int consumers;
+    long arrivals;
+    long* arrival_ns;
+    int* arrival_producer;
+    long services;
+    long* service_ns;
+    long sojourns;
+    long* sojourn_ns;
+};
+
+/*
+ * Creates a new QueueTrace holding at most capacity records.
+ * Returns a pointer to a new QueueTrace on success and NULL on failure.
+ */
+QueueTrace* new_QueueTrace(size_t capacity);
+
+/*
+ * Records count events of the same kind, happening now on the calling thread.
+ * Events beyond the trace's capacity are dropped.
+ */
+void QueueTrace_record(QueueTrace* this, QueueTraceEvent event, int count);
+
+/*
+ * Returns the number of records this trace holds.
+ */
+size_t QueueTrace_size(QueueTrace* this);
+
+/*
+ * Returns the number of events dropped because the trace was full.
+ */
+size_t QueueTrace_dropped(QueueTrace* this);
+
+/*
+ * Saves this trace's records to the file at path, after a small header. Recording must have stopped.
+ * Returns true on success and false on failure.
+ */
+bool QueueTrace_save(QueueTrace* this, const char* path);
+
+/*
+ * Loads a trace saved by QueueTrace_save from the file at path.
+ * Returns a pointer to a new QueueTrace on success and NULL on failure (including when the file isn't a trace).
+ */
+QueueTrace* QueueTrace_load(const char* path);
+
+/*
+ * Derives the workload of this trace, whose recording must have stopped. Elements are matched to their dequeue
+ * in FIFO order, and a consumer's time between two dequeues is only taken as a service time when the second element
+ * was already waiting at the first dequeue, so that time spent waiting for elements doesn't count.
+ * Returns a pointer to a new QueueTraceProfile on success and NULL on failure.
+ */
+QueueTraceProfile* QueueTrace_profile(QueueTrace* this);
+
+/*
+ * Destroys this QueueTraceProfile by freeing the memory used by the QueueTraceProfile.
+ */
+void QueueTraceProfile_destroy(QueueTraceProfile* this);
+
+/*
+ * Destroys this QueueTrace by freeing the memory used by the QueueTrace.
+ */
+void QueueTrace_destroy(QueueTrace* this);
+
+#endif /* QUEUE_TRACE_H_ */
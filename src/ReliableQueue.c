@@ -0,0 +1,271 @@
+/*
+ * ReliableQueue.c
+ *
+ * Fixed-size generic ReliableQueue implementation, with leases for the elements in flight.
+ *
+ * Elements waiting to be delivered sit in a BlockingQueue. Delivering one hands it a free lease, and sets the lease's
+ * timer in a DelayQueue, whose timing wheel makes setting a timer cheap whatever the number of leases. A reaper thread
+ * sleeps on the DelayQueue, and redelivers the element of any lease whose timer goes off before it is acknowledged.
+ * Each lease has its own mutex, so acknowledging an element never waits for another one.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "ReliableQueue.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000L
+
+/*
+ * Terminates the code, destroys the reliable queue and prints out an error message if an error is detected.
+ */
+static void exit_reliable_error(ReliableQueue* this, char* msg) {
+    perror(msg);
+    fprintf(stderr, "errno = %i\n", errno); // Print out the error message
+    ReliableQueue_destroy(this); // Destroy the reliable queue
+    exit(EXIT_FAILURE); // Terminate the code
+}
+
+/*
+ * Returns true if the time a is before the time b.
+ */
+static bool before(const struct timespec* a, const struct timespec* b) {
+    return (*a).tv_sec < (*b).tv_sec || ((*a).tv_sec == (*b).tv_sec && (*a).tv_nsec < (*b).tv_nsec);
+}
+
+/*
+ * Locks the lease the given handle refers to, if it is valid.
+ * Returns the lease, still locked, if the handle's delivery is still in flight, and NULL otherwise.
+ */
+static ReliableLease* lock_lease(ReliableQueue* this, ReliableHandle handle) {
+    if (handle.lease < ZERO || handle.lease >= (*this).capacity) {
+        return NULL;
+    }
+    ReliableLease* lease = &(*this).leases[handle.lease];
+    if (pthread_mutex_lock(&(*lease).mutex)) {
+        exit_reliable_error(this, "Mutex 'mutex' not locked!");
+    }
+    if ((*lease).element == NULL || (*lease).generation != handle.generation) {
+        pthread_mutex_unlock(&(*lease).mutex);
+        return NULL;
+    }
+    return lease;
+}
+
+/*
+ * Takes the element out of the given locked lease, unlocks it and hands it back to the free leases.
+ * Returns the element.
+ */
+static void* end_lease(ReliableQueue* this, ReliableLease* lease) {
+    void* element = (*lease).element;
+    (*lease).element = NULL;
+    if (pthread_mutex_unlock(&(*lease).mutex)) {
+        exit_reliable_error(this, "Mutex 'mutex' not unlocked!");
+    }
+    BlockingQueue_enq((*this).free_leases, lease); // There always is room for every lease
+    return element;
+}
+
+/*
+ * Enqueues the given element again, for another consumer to have a go at it.
+ */
+static void redeliver(ReliableQueue* this, void* element) {
+    atomic_fetch_add(&(*this).redelivered, ONE); // Counted first, so that whoever gets it sees it counted
+    BlockingQueue_enq((*this).ready, element); // Its space was never given back, so this doesn't wait
+}
+
+/*
+ * Called by the reaper when the given lease's timer goes off: redelivers its element if its deadline has passed,
+ * sets the timer again if the lease was handed out again since, and lets the timer go if the lease is free.
+ */
+static void expire(ReliableQueue* this, ReliableLease* lease) {
+    if (pthread_mutex_lock(&(*lease).mutex)) {
+        exit_reliable_error(this, "Mutex 'mutex' not locked!");
+    }
+    if ((*lease).element == NULL) {
+        (*lease).armed = false;
+        pthread_mutex_unlock(&(*lease).mutex);
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (before(&now, &(*lease).deadline)) {
+        struct timespec deadline = (*lease).deadline;
+        pthread_mutex_unlock(&(*lease).mutex);
+        DelayQueue_enqAt((*this).timers, lease, &deadline); // There is at most one timer per lease, so there is room
+        return;
+    }
+    (*lease).armed = false;
+    redeliver(this, end_lease(this, lease));
+}
+
+/*
+ * Function run by the reaper thread, until the queue itself comes out of the timers queue.
+ */
+static void* reaper(void* arg) {
+    ReliableQueue* this = arg;
+    for (;;) {
+        void* due = DelayQueue_deq((*this).timers);
+        if (due == this) {
+            return NULL;
+        }
+        expire(this, due);
+    }
+}
+
+
+ReliableQueue* new_ReliableQueue(int max_size, long visibility_ms) {
+    if (max_size < ONE || visibility_ms < ZERO) {
+        return NULL;
+    }
+    ReliableQueue* this = calloc(ONE, sizeof(ReliableQueue));
+    if (this == NULL) {
+        return NULL;
+    }
+    (*this).capacity = max_size;
+    (*this).visibility_ms = visibility_ms;
+    atomic_init(&(*this).redelivered, ZERO);
+
+    /*
+     * Ready and in-flight elements together never exceed max_size, so each of these needs at most max_size slots,
+     * except for the timers, which also take the queue itself to stop the reaper.
+     */
+    (*this).ready = new_BlockingQueue(max_size);
+    (*this).free_leases = new_BlockingQueue(max_size);
+    (*this).timers = new_DelayQueue(max_size + ONE);
+    (*this).leases = calloc(max_size, sizeof(ReliableLease));
+    if ((*this).ready == NULL || (*this).free_leases == NULL || (*this).timers == NULL || (*this).leases == NULL) {
+        if ((*this).ready != NULL) {
+            BlockingQueue_destroy((*this).ready);
+        }
+        if ((*this).free_leases != NULL) {
+            BlockingQueue_destroy((*this).free_leases);
+        }
+        if ((*this).timers != NULL) {
+            DelayQueue_destroy((*this).timers);
+        }
+        free((*this).leases);
+        free(this);
+        return NULL;
+    }
+    for (int i = 0; i < max_size; i++) {
+        if (pthread_mutex_init(&(*this).leases[i].mutex, NULL)) {
+            exit_reliable_error(this, "Mutex 'mutex' not created!");
+        }
+        BlockingQueue_enq((*this).free_leases, &(*this).leases[i]);
+    }
+
+    // Initialise the semaphore bounding the number of elements, ready or in flight
+    if (sem_init(&(*this).sem_space, ZERO, max_size)) {
+        exit_reliable_error(this, "Semaphore 'sem_space' not created!");
+    }
+
+    // Start the reaper thread, and check that it has been created properly
+    if (pthread_create(&(*this).reaper, NULL, reaper, this)) {
+        exit_reliable_error(this, "Reaper thread not created!");
+    }
+    return this;
+}
+
+bool ReliableQueue_enq(ReliableQueue* this, void* element) {
+    // Return false straight away if the element is NULL, so that no space is claimed for it
+    if (element == NULL) {
+        return false;
+    }
+    // Decrement the sem_space semaphore and check that it has been done
+    if (sem_wait(&(*this).sem_space)) {
+        exit_reliable_error(this, "Semaphore 'sem_space' not decremented!");
+    }
+    return BlockingQueue_enq((*this).ready, element);
+}
+
+void* ReliableQueue_deq(ReliableQueue* this, ReliableHandle* handle) {
+    void* element = BlockingQueue_deq((*this).ready);
+    ReliableLease* lease = BlockingQueue_deq((*this).free_leases); // There always is a free lease for an element
+
+    // Work out the deadline, as DelayQueue_enq does for a delay
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += (*this).visibility_ms/1000;
+    deadline.tv_nsec += ((*this).visibility_ms%1000)*1000000L;
+    if (deadline.tv_nsec >= NANOSECONDS_PER_SECOND) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= NANOSECONDS_PER_SECOND;
+    }
+
+    // Hand the lease out, and set its timer unless an earlier one is still pending (expire will set it again)
+    if (pthread_mutex_lock(&(*lease).mutex)) {
+        exit_reliable_error(this, "Mutex 'mutex' not locked!");
+    }
+    (*lease).generation++;
+    (*lease).element = element;
+    (*lease).deadline = deadline;
+    bool arm = !(*lease).armed;
+    (*lease).armed = true;
+    (*handle).lease = (int) (lease - (*this).leases);
+    (*handle).generation = (*lease).generation;
+    if (pthread_mutex_unlock(&(*lease).mutex)) {
+        exit_reliable_error(this, "Mutex 'mutex' not unlocked!");
+    }
+    if (arm) {
+        DelayQueue_enqAt((*this).timers, lease, &deadline);
+    }
+    return element;
+}
+
+bool ReliableQueue_ack(ReliableQueue* this, ReliableHandle handle) {
+    ReliableLease* lease = lock_lease(this, handle);
+    if (lease == NULL) {
+        return false;
+    }
+    end_lease(this, lease); // Its timer is let go when it goes off
+    // Increment the sem_space semaphore, as the element is gone for good, and check that it has been done
+    if (sem_post(&(*this).sem_space)) {
+        exit_reliable_error(this, "Semaphore 'sem_space' not incremented!");
+    }
+    return true;
+}
+
+bool ReliableQueue_nack(ReliableQueue* this, ReliableHandle handle) {
+    ReliableLease* lease = lock_lease(this, handle);
+    if (lease == NULL) {
+        return false;
+    }
+    redeliver(this, end_lease(this, lease));
+    return true;
+}
+
+int ReliableQueue_size(ReliableQueue* this) {
+    return BlockingQueue_size((*this).ready);
+}
+
+int ReliableQueue_inFlight(ReliableQueue* this) {
+    return (*this).capacity - BlockingQueue_size((*this).free_leases);
+}
+
+long ReliableQueue_redelivered(ReliableQueue* this) {
+    return atomic_load(&(*this).redelivered);
+}
+
+void ReliableQueue_destroy(ReliableQueue* this) {
+    // Stop the reaper, with the queue itself as a timer that is due straight away
+    if ((*this).reaper) {
+        DelayQueue_enq((*this).timers, this, ZERO);
+        pthread_join((*this).reaper, NULL);
+    }
+
+    // Destroy the leases' mutexes, the semaphore and the queues, then free the memory allocated for itself
+    for (int i = 0; i < (*this).capacity; i++) {
+        pthread_mutex_destroy(&(*this).leases[i].mutex);
+    }
+    sem_destroy(&(*this).sem_space);
+    BlockingQueue_destroy((*this).ready);
+    BlockingQueue_destroy((*this).free_leases);
+    DelayQueue_destroy((*this).timers);
+    free((*this).leases);
+    free(this);
+}
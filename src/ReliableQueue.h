@@ -0,0 +1,132 @@
+/*
+ * ReliableQueue.h
+ *
+ * Module interface for a generic fixed-size Reliable Queue with at-least-once delivery: a dequeued element is leased
+ * to its consumer until it is acknowledged, and redelivered if the consumer gives it back or its lease expires.
+ *
+ */
+
+#ifndef RELIABLE_QUEUE_H_
+#define RELIABLE_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "BlockingQueue.h"
+#include "DelayQueue.h"
+
+typedef struct ReliableLease ReliableLease;
+typedef struct ReliableHandle ReliableHandle;
+typedef struct ReliableQueue ReliableQueue;
+
+struct ReliableLease {
+    /*
+     * A ReliableLease struct has 6 attributes, and tracks one element in flight at a time:
+     *      - mutex: The mutex protecting the lease, so that acknowledging one element never waits for another;
+     *      - generation: The number of times the lease has been handed out, so that stale handles are recognised;
+     *      - element: The element in flight, or NULL if the lease is free;
+     *      - deadline: The CLOCK_MONOTONIC time at which the element is redelivered unless it is acknowledged;
+     *      - armed: Whether the lease has a timer pending in the timers queue. There is never more than one: a timer
+     *        that goes off early (the lease was handed out again since it was set) is set again for the new deadline.
+     */
+    pthread_mutex_t mutex;
+    unsigned long generation;
+    void* element;
+    struct timespec deadline;
+    bool armed;
+};
+
+struct ReliableHandle {
+    /*
+     * A ReliableHandle struct identifies one delivery of an element, to acknowledge it or give it back:
+     *      - lease: The index of the lease holding the element;
+     *      - generation: The lease's generation when the element was delivered.
+     */
+    int lease;
+    unsigned long generation;
+};
+
+struct ReliableQueue {
+    /*
+     * A ReliableQueue struct has 9 attributes:
+     *      - capacity: The reliable queue's maximum capacity, counting elements in flight;
+     *      - visibility_ms: How long a consumer has to acknowledge an element before it is redelivered;
+     *      - ready: The elements waiting to be delivered, or redelivered;
+     *      - leases and free_leases: One lease per element that can be in flight, and the ones not in use;
+     *      - timers: The leases' expiry timers, as a DelayQueue (whose timing wheel makes them cheap to set);
+     *      - sem_space: The semaphore used before enqueueing elements, only posted when an element is acknowledged;
+     *      - reaper: The thread redelivering the elements whose lease expired;
+     *      - redelivered: The number of elements redelivered so far, because they were given back or expired.
+     *
+     * As ready and in-flight elements together never exceed the capacity, redelivering an element never waits for space.
+     */
+    int capacity;
+    long visibility_ms;
+    BlockingQueue* ready;
+    ReliableLease* leases;
+    BlockingQueue* free_leases;
+    DelayQueue* timers;
+    sem_t sem_space;
+    pthread_t reaper;
+    atomic_long redelivered;
+};
+
+/*
+ * Creates a new ReliableQueue for at most max_size void* elements, ready or in flight, whose consumers have
+ * visibility_ms milliseconds to acknowledge each element they dequeue.
+ * Returns a pointer to a new ReliableQueue on success and NULL on failure.
+ */
+ReliableQueue* new_ReliableQueue(int max_size, long visibility_ms);
+
+/*
+ * Enqueues the given void* element at the back of this Queue.
+ * If the queue is full, the function will block the calling thread until an element is acknowledged.
+ * Returns false when element is NULL and true on success.
+ */
+bool ReliableQueue_enq(ReliableQueue* this, void* element);
+
+/*
+ * Dequeues an element from the front of this Queue, leasing it to the caller: the element stays in flight until
+ * it is acknowledged, and is enqueued again if that doesn't happen within the visibility timeout.
+ * If the queue is empty, the function will block until an element can be dequeued.
+ * Stores the handle to acknowledge the element with in handle, and returns the dequeued void* element.
+ */
+void* ReliableQueue_deq(ReliableQueue* this, ReliableHandle* handle);
+
+/*
+ * Acknowledges the element delivered with the given handle, which is then gone for good.
+ * Returns false if its lease expired or it was given back first (it may then be delivered again), and true otherwise.
+ */
+bool ReliableQueue_ack(ReliableQueue* this, ReliableHandle handle);
+
+/*
+ * Gives back the element delivered with the given handle, enqueuing it again straight away.
+ * Returns false if its lease expired or it was acknowledged or given back first, and true otherwise.
+ */
+bool ReliableQueue_nack(ReliableQueue* this, ReliableHandle handle);
+
+/*
+ * Returns the number of elements waiting to be delivered in this Queue, not counting the ones in flight.
+ */
+int ReliableQueue_size(ReliableQueue* this);
+
+/*
+ * Returns the number of elements delivered but not yet acknowledged.
+ */
+int ReliableQueue_inFlight(ReliableQueue* this);
+
+/*
+ * Returns the number of elements redelivered so far, because they were given back or their lease expired.
+ */
+long ReliableQueue_redelivered(ReliableQueue* this);
+
+/*
+ * Destroys this Queue by stopping its reaper and freeing the memory used by the Queue.
+ * No other operation may be running on the queue.
+ */
+void ReliableQueue_destroy(ReliableQueue* this);
+
+#endif /* RELIABLE_QUEUE_H_ */
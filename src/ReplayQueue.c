@@ -0,0 +1,246 @@
+/*
+ * ReplayQueue.c
+ *
+ * Replays a recorded workload trace against every queue engine.
+ *
+ * The trace (see QueueTrace and BlockingQueue_record) gives each producer's enqueue times and samples of how long
+ * consumers spent on an element. Producers enqueue on the recorded schedule, falling behind it if the queue holds
+ * them up, and consumers spin for a service time drawn from the recorded samples after each dequeue. Each engine is
+ * reported with the time elements spent between their scheduled arrival and their dequeue, and how far producers
+ * fell behind the schedule, next to the same figures for the recorded run.
+ *
+ * Usage: ./ReplayQueue -f trace [-e engine] [-q capacity] [-s speedup]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "QueueEngine.h"
+#include "QueueTrace.h"
+
+#define DEFAULT_CAPACITY 1024
+#define DEFAULT_SPEEDUP 1.0
+#define NANOSECONDS_PER_SECOND 1000000000L
+#define SPIN_NS 100000 // Waits shorter than this are spun rather than slept, as sleeping overshoots them
+#define SERVICE_SEED 2002
+
+/*
+ * Elements are never dereferenced: each is the index of its arrival plus 2, so that it is distinct from NULL and
+ * POISON, which tells a consumer to stop.
+ */
+#define POISON ((void*) 1)
+
+/*
+ * The settings shared by every run
+ */
+static int capacity = DEFAULT_CAPACITY;
+static double speedup = DEFAULT_SPEEDUP;
+static QueueTraceProfile* profile;
+
+/*
+ * The state of the run in progress
+ */
+static const QueueEngine* engine;
+static void* replay_queue;
+static int run_producers;
+static long start_ns;
+static long* sojourn_ns;               // The time each element spent between its scheduled arrival and its dequeue
+static long* lag_ns;                   // How long after its scheduled arrival each element was enqueued
+
+
+static long now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+/*
+ * Waits until the given CLOCK_MONOTONIC time: sleeps for most of the wait, and spins for the end of it.
+ */
+static void wait_until(long deadline_ns) {
+    long remaining = deadline_ns - now_ns();
+    if (remaining > SPIN_NS) {
+        long wake_ns = deadline_ns - SPIN_NS;
+        struct timespec wake = {wake_ns/NANOSECONDS_PER_SECOND, wake_ns%NANOSECONDS_PER_SECOND};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+    while (now_ns() < deadline_ns) {
+        continue;
+    }
+}
+
+/*
+ * Returns the scheduled time of the given arrival in this run.
+ */
+static long scheduled_ns(long arrival) {
+    return start_ns + (long) ((*profile).arrival_ns[arrival]/speedup);
+}
+
+void* producer(void* arg) {
+    int index = *(int*) arg;
+    // When the engine allows fewer producers than the trace had, each takes over the arrivals of several
+    for (long i = 0; i < (*profile).arrivals; i++) {
+        if ((*profile).arrival_producer[i] % run_producers != index) {
+            continue;
+        }
+        wait_until(scheduled_ns(i));
+        (*engine).enq(replay_queue, (void*) (uintptr_t) (i + 2));
+        lag_ns[i] = now_ns() - scheduled_ns(i);
+    }
+    return NULL;
+}
+
+void* consumer(void* arg) {
+    unsigned int seed = SERVICE_SEED + *(int*) arg;
+    void* element;
+    while ((element = (*engine).deq(replay_queue)) != POISON) {
+        long arrival = (uintptr_t) element - 2;
+        long now = now_ns();
+        sojourn_ns[arrival] = now - scheduled_ns(arrival);
+        if ((*profile).services > 0) {
+            wait_until(now + (long) ((*profile).service_ns[rand_r(&seed) % (*profile).services]/speedup));
+        }
+    }
+    return NULL;
+}
+
+static int compare_longs(const void* a, const void* b) {
+    long x = *(const long*) a;
+    long y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sorts the given values, and prints their median, 99th percentile and maximum in microseconds.
+ */
+static void print_percentiles(const char* name, long* values, long count) {
+    if (count == 0) {
+        printf("  %-10s %12s\n", name, "no samples");
+        return;
+    }
+    qsort(values, count, sizeof(long), compare_longs);
+    printf("  %-10s p50 %10.1f us   p99 %10.1f us   max %10.1f us\n", name,
+           values[count/2]/1e3, values[(long) (count*0.99)]/1e3, values[count - 1]/1e3);
+}
+
+/*
+ * Replays the trace against one engine, printing how long elements waited and producers lagged.
+ * Returns false if the queue couldn't be created.
+ */
+bool replay(const QueueEngine* replayed) {
+    engine = replayed;
+    run_producers = (*profile).producers;
+    int run_consumers = (*profile).consumers > 0 ? (*profile).consumers : 1;
+    if ((*engine).max_producers && run_producers > (*engine).max_producers) {
+        run_producers = (*engine).max_producers;
+    }
+    if ((*engine).max_consumers && run_consumers > (*engine).max_consumers) {
+        run_consumers = (*engine).max_consumers;
+    }
+    replay_queue = (*engine).create(capacity);
+    if (replay_queue == NULL) {
+        printf("%s: could not create queue\n", (*engine).name);
+        return false;
+    }
+    printf("%s: %d producers, %d consumers, capacity %d\n", (*engine).name, run_producers, run_consumers, capacity);
+
+    pthread_t producer_threads[run_producers];
+    pthread_t consumer_threads[run_consumers];
+    int indices[run_producers > run_consumers ? run_producers : run_consumers];
+    for (int i = 0; i < run_producers || i < run_consumers; i++) {
+        indices[i] = i;
+    }
+    start_ns = now_ns();
+    for (int i = 0; i < run_consumers; i++) {
+        pthread_create(&consumer_threads[i], NULL, consumer, &indices[i]);
+    }
+    for (int i = 0; i < run_producers; i++) {
+        pthread_create(&producer_threads[i], NULL, producer, &indices[i]);
+    }
+    for (int i = 0; i < run_producers; i++) {
+        pthread_join(producer_threads[i], NULL);
+    }
+    for (int i = 0; i < run_consumers; i++) {
+        (*engine).enq(replay_queue, POISON);
+    }
+    for (int i = 0; i < run_consumers; i++) {
+        pthread_join(consumer_threads[i], NULL);
+    }
+    double elapsed = (now_ns() - start_ns)/1e9;
+    (*engine).destroy(replay_queue);
+
+    printf("  %-10s %.3f s, %.0f elements/s\n", "elapsed", elapsed, (*profile).arrivals/elapsed);
+    print_percentiles("sojourn", sojourn_ns, (*profile).arrivals);
+    print_percentiles("lag", lag_ns, (*profile).arrivals);
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* engine_name = NULL;
+    const char* trace_path = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "f:e:q:s:")) != -1) {
+        switch (option) {
+            case 'f': trace_path = optarg; break;
+            case 'e': engine_name = optarg; break;
+            case 'q': capacity = atoi(optarg); break;
+            case 's': speedup = atof(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s -f trace [-e engine] [-q capacity] [-s speedup]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (trace_path == NULL || capacity < 1 || speedup <= 0) {
+        fprintf(stderr, "Usage: %s -f trace [-e engine] [-q capacity] [-s speedup]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (engine_name != NULL && QueueEngine_find(engine_name) == NULL) {
+        fprintf(stderr, "Unknown engine '%s'\n", engine_name);
+        return EXIT_FAILURE;
+    }
+    QueueTrace* trace = QueueTrace_load(trace_path);
+    if (trace == NULL) {
+        fprintf(stderr, "Could not load trace '%s'\n", trace_path);
+        return EXIT_FAILURE;
+    }
+    profile = QueueTrace_profile(trace);
+    if (profile == NULL || (*profile).arrivals == 0) {
+        fprintf(stderr, "Trace '%s' has no enqueues\n", trace_path);
+        return EXIT_FAILURE;
+    }
+    printf("Trace: %ld enqueues by %d producers over %.3f s, %d consumers, %ld service samples, %zu events dropped\n",
+           (*profile).arrivals, (*profile).producers, (*profile).arrival_ns[(*profile).arrivals - 1]/1e9,
+           (*profile).consumers, (*profile).services, QueueTrace_dropped(trace));
+    print_percentiles("service", (*profile).service_ns, (*profile).services);
+    print_percentiles("sojourn", (*profile).sojourn_ns, (*profile).sojourns);
+
+    sojourn_ns = malloc((*profile).arrivals*sizeof(long));
+    lag_ns = malloc((*profile).arrivals*sizeof(long));
+    if (sojourn_ns == NULL || lag_ns == NULL) {
+        fprintf(stderr, "Could not allocate the results\n");
+        return EXIT_FAILURE;
+    }
+
+    // Replay the selected engine, or every engine in turn
+    bool created = true;
+    for (int i = 0; i < QUEUE_ENGINE_COUNT; i++) {
+        if (engine_name == NULL || strcmp(engine_name, QUEUE_ENGINES[i].name) == 0) {
+            created = replay(&QUEUE_ENGINES[i]) && created;
+        }
+    }
+
+    free(sojourn_ns);
+    free(lag_ns);
+    QueueTraceProfile_destroy(profile);
+    QueueTrace_destroy(trace);
+    printf("\nReplay complete.\n----------------\n");
+    return created ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,271 @@
+/*
+ * SoakQueue.c
+ *
+ * Long-running concurrency soak test for every queue engine.
+ *
+ * Many producers and consumers hammer one queue at full speed. Each element is tagged with its producer's id
+ * and a per-producer sequence number, which lets the consumers check that:
+ *      - every consumer sees each producer's elements in increasing sequence order (per-producer FIFO);
+ *      - no element is dequeued twice (duplication);
+ *      - every enqueued element is eventually dequeued (loss).
+ * Sustained throughput is reported once per second.
+ *
+ * Usage: ./SoakQueue [-e engine] [-t seconds] [-p producers] [-c consumers] [-n items per producer] [-q capacity]
+ * Build the SoakQueueTsan target to run the same soak under ThreadSanitizer.
+ *
+ * Every engine of QueueEngine.c is soaked, DelayQueue with elements that are due straight away. Two queues have no
+ * engine, as their guarantees don't fit the checks:
+ *      - PartitionedQueue only keeps elements with the same key in order, so the poison elements sent behind
+ *        everything else can reach a consumer before the elements of other partitions, which would then count as
+ *        lost. They also all share one key, and so one partition owned by a single consumer, leaving every other
+ *        consumer waiting forever;
+ *      - CoalescingQueue replaces a pending element with the next one of the same key, so it drops elements by design
+ *        and the loss check can't tell that from a bug, unless every element gets a key of its own, which the
+ *        capacity (its number of keys) can't hold for a long run.
+ * TestPartitionedQueue and TestCoalescingQueue cover them instead.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "QueueEngine.h"
+
+#define DEFAULT_SECONDS 10
+#define DEFAULT_PRODUCERS 4
+#define DEFAULT_CONSUMERS 4
+#define DEFAULT_ITEMS 4000000
+#define DEFAULT_CAPACITY 1024
+#define REPORT_POLL_US 10000
+
+/*
+ * Elements are never dereferenced: the producer id (plus one, so no element is NULL) is stored above
+ * SEQUENCE_BITS and the sequence number below. The all-zero-id value POISON tells a consumer to stop.
+ */
+#define SEQUENCE_BITS 40
+#define SEQUENCE_MASK ((((uintptr_t) 1) << SEQUENCE_BITS) - 1)
+#define POISON ((void*) 1)
+
+/*
+ * The settings shared by every run
+ */
+static int seconds = DEFAULT_SECONDS;
+static int producers = DEFAULT_PRODUCERS;
+static int consumers = DEFAULT_CONSUMERS;
+static long items = DEFAULT_ITEMS;
+static int capacity = DEFAULT_CAPACITY;
+
+/*
+ * The state of the run in progress
+ */
+static const QueueEngine* engine;
+static void* soak_queue;
+static atomic_bool stop;
+static atomic_int producers_done;
+static atomic_long consumed;
+static atomic_long order_errors;
+static atomic_long duplicate_errors;
+static long* produced;                 // The number of elements each producer enqueued
+static atomic_uchar** seen;            // One bit per (producer, sequence number), set when it is dequeued
+
+
+static void* tag(int producer, long sequence) {
+    return (void*) ((((uintptr_t) producer + 1) << SEQUENCE_BITS) | (uintptr_t) sequence);
+}
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec/1e9;
+}
+
+void* producer(void* arg) {
+    int id = (int) (intptr_t) arg;
+    long sequence = 0;
+    // Enqueue as fast as possible until out of sequence numbers or told to stop
+    while (sequence < items && !atomic_load_explicit(&stop, memory_order_relaxed)) {
+        (*engine).enq(soak_queue, tag(id, sequence));
+        sequence++;
+    }
+    produced[id] = sequence;
+    atomic_fetch_add(&producers_done, 1);
+    return NULL;
+}
+
+void* consumer(void* arg) {
+    (void) arg;
+    // The last sequence number this consumer saw from each producer
+    long* last = malloc(sizeof(long)*producers);
+    for (int i = 0; i < producers; i++) {
+        last[i] = -1;
+    }
+
+    for (;;) {
+        void* element = (*engine).deq(soak_queue);
+        if (element == POISON) {
+            break;
+        }
+        uintptr_t value = (uintptr_t) element;
+        int id = (int) (value >> SEQUENCE_BITS) - 1;
+        long sequence = (long) (value & SEQUENCE_MASK);
+
+        // A FIFO queue can never show one consumer an older element of a producer after a newer one
+        if (sequence <= last[id]) {
+            atomic_fetch_add(&order_errors, 1);
+        }
+        last[id] = sequence;
+
+        // Mark the element as seen, and count it as duplicated if it already was
+        unsigned char bit = 1 << (sequence % 8);
+        if (atomic_fetch_or_explicit(&seen[id][sequence/8], bit, memory_order_relaxed) & bit) {
+            atomic_fetch_add(&duplicate_errors, 1);
+        }
+        atomic_fetch_add_explicit(&consumed, 1, memory_order_relaxed);
+    }
+
+    free(last);
+    return NULL;
+}
+
+/*
+ * Soaks one engine, printing its throughput once per second.
+ * Returns the number of errors found.
+ */
+long soak(const QueueEngine* soaked) {
+    engine = soaked;
+    int run_producers = producers;
+    int run_consumers = consumers;
+    if ((*engine).max_producers && run_producers > (*engine).max_producers) {
+        run_producers = (*engine).max_producers;
+    }
+    if ((*engine).max_consumers && run_consumers > (*engine).max_consumers) {
+        run_consumers = (*engine).max_consumers;
+    }
+    printf("%s: %d producers, %d consumers, capacity %d\n", (*engine).name, run_producers, run_consumers, capacity);
+
+    // Reset the state of the run
+    soak_queue = (*engine).create(capacity);
+    if (soak_queue == NULL) {
+        printf("%s: could not create queue\n", (*engine).name);
+        return 1;
+    }
+    atomic_store(&stop, false);
+    atomic_store(&producers_done, 0);
+    atomic_store(&consumed, 0);
+    atomic_store(&order_errors, 0);
+    atomic_store(&duplicate_errors, 0);
+    produced = calloc(run_producers, sizeof(long));
+    seen = malloc(sizeof(atomic_uchar*)*run_producers);
+    for (int i = 0; i < run_producers; i++) {
+        seen[i] = calloc(items/8 + 1, sizeof(atomic_uchar));
+    }
+    producers = run_producers; // The consumers size their bookkeeping by the number of producers
+
+    pthread_t producer_threads[run_producers];
+    pthread_t consumer_threads[run_consumers];
+    for (int i = 0; i < run_consumers; i++) {
+        pthread_create(&consumer_threads[i], NULL, consumer, NULL);
+    }
+    for (int i = 0; i < run_producers; i++) {
+        pthread_create(&producer_threads[i], NULL, producer, (void*) (intptr_t) i);
+    }
+
+    // Report the throughput every second until the time is up or the producers have run out of elements
+    double start = now_seconds();
+    double last_report = start;
+    long last_consumed = 0;
+    int second = 0;
+    while (second < seconds && atomic_load(&producers_done) < run_producers) {
+        usleep(REPORT_POLL_US);
+        double now = now_seconds();
+        if (now - last_report >= 1.0) {
+            long total = atomic_load(&consumed);
+            second++;
+            printf("  %3ds  %10.3f Mops/s\n", second, (total - last_consumed)/(now - last_report)/1e6);
+            fflush(stdout);
+            last_consumed = total;
+            last_report = now;
+        }
+    }
+
+    // Stop the producers, then send one poison element per consumer behind everything they enqueued
+    atomic_store(&stop, true);
+    for (int i = 0; i < run_producers; i++) {
+        pthread_join(producer_threads[i], NULL);
+    }
+    for (int i = 0; i < run_consumers; i++) {
+        (*engine).enq(soak_queue, POISON);
+    }
+    for (int i = 0; i < run_consumers; i++) {
+        pthread_join(consumer_threads[i], NULL);
+    }
+    double elapsed = now_seconds() - start;
+
+    // Every element that was enqueued must have been seen, and nothing beyond that
+    long lost = 0;
+    long total_produced = 0;
+    for (int i = 0; i < run_producers; i++) {
+        total_produced += produced[i];
+        for (long sequence = 0; sequence < produced[i]; sequence++) {
+            if (!(seen[i][sequence/8] & (1 << (sequence % 8)))) {
+                lost++;
+            }
+        }
+        free(seen[i]);
+    }
+    free(seen);
+    free(produced);
+    (*engine).destroy(soak_queue);
+
+    long errors = lost + atomic_load(&order_errors) + atomic_load(&duplicate_errors);
+    printf("%s: %ld elements in %.2fs (%.3f Mops/s), %ld lost, %ld duplicated, %ld out of order: %s\n",
+           (*engine).name, total_produced, elapsed, total_produced/elapsed/1e6,
+           lost, atomic_load(&duplicate_errors), atomic_load(&order_errors), errors ? "FAILED" : "OK");
+    return errors;
+}
+
+int main(int argc, char** argv) {
+    const char* engine_name = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "e:t:p:c:n:q:")) != -1) {
+        switch (option) {
+            case 'e': engine_name = optarg; break;
+            case 't': seconds = atoi(optarg); break;
+            case 'p': producers = atoi(optarg); break;
+            case 'c': consumers = atoi(optarg); break;
+            case 'n': items = atol(optarg); break;
+            case 'q': capacity = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-e engine] [-t seconds] [-p producers] [-c consumers] [-n items] [-q capacity]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (producers < 1 || consumers < 1 || items < 1 || items > (long) SEQUENCE_MASK || capacity < 1) {
+        fprintf(stderr, "Invalid soak settings\n");
+        return EXIT_FAILURE;
+    }
+
+    // Soak the selected engine, or every engine in turn
+    long errors = 0;
+    int requested_producers = producers;
+    for (int i = 0; i < QUEUE_ENGINE_COUNT; i++) {
+        if (engine_name == NULL || strcmp(engine_name, QUEUE_ENGINES[i].name) == 0) {
+            producers = requested_producers;
+            errors += soak(&QUEUE_ENGINES[i]);
+        }
+    }
+    if (engine_name != NULL && QueueEngine_find(engine_name) == NULL) {
+        fprintf(stderr, "Unknown engine '%s'\n", engine_name);
+        return EXIT_FAILURE;
+    }
+
+    printf("\nSoak complete: %s\n----------------\n", errors ? "FAILED" : "all engines OK");
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/*
+ * TestAutoscaler.c
+ *
+ * Very simple unit test file for Autoscaler functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "Autoscaler.h"
+#include "myassert.h"
+
+
+#define DEFAULT_MAX_QUEUE_SIZE 20
+#define MIN_WORKERS 1
+#define MAX_WORKERS 4
+#define WORK_US 2000
+
+/*
+ * The queue the autoscaler's consumers dequeue from, and the autoscaler to use during tests
+ */
+static BlockingQueue *queue;
+static Autoscaler *autoscaler;
+
+/*
+ * The number of elements processed by the test function
+ */
+static atomic_long processed;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Function applied to each element: takes WORK_US microseconds, and counts the element.
+ */
+void work(void* element, void* context) {
+    (void) element;
+    (void) context;
+    usleep(WORK_US);
+    atomic_fetch_add(&processed, 1);
+}
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new_BlockingQueue(DEFAULT_MAX_QUEUE_SIZE);
+    autoscaler = new_Autoscaler(queue, work, NULL, MIN_WORKERS, MAX_WORKERS);
+    atomic_store(&processed, 0);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    Autoscaler_destroy(autoscaler);
+    BlockingQueue_destroy(queue);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * Returns the number of consumer threads the autoscaler currently has.
+ */
+static int workers() {
+    AutoscalerStats stats;
+    Autoscaler_stats(autoscaler, &stats);
+    return stats.workers;
+}
+
+/*
+ * Returns the number of consumer threads still running in the pool.
+ */
+static int running() {
+    AutoscalerStats stats;
+    Autoscaler_stats(autoscaler, &stats);
+    return stats.running;
+}
+
+
+/*
+ * Checks that the Autoscaler constructor returns a non-NULL pointer, and NULL for invalid bounds.
+ */
+int newAutoscalerIsNotNull() {
+    assert(autoscaler != NULL);
+    assert(new_Autoscaler(queue, work, NULL, 0, MAX_WORKERS) == NULL);
+    assert(new_Autoscaler(queue, work, NULL, MAX_WORKERS, MIN_WORKERS) == NULL);
+    assert(new_Autoscaler(queue, NULL, NULL, MIN_WORKERS, MAX_WORKERS) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the pool starts with its minimum number of consumers, and stays there without load.
+ */
+int startsWithMinWorkers() {
+    assert(workers() == 0);
+    Autoscaler_start(autoscaler);
+    assert(workers() == MIN_WORKERS);
+    usleep(AUTOSCALER_INTERVAL_MS*1000*AUTOSCALER_DOWN_INTERVALS*2);
+    assert(workers() == MIN_WORKERS);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that consumers are added while producers keep the queue full, up to the maximum and no further.
+ */
+int scalesUpUnderLoad() {
+    int one = ONE;
+    Autoscaler_start(autoscaler);
+    for (int i = 0; i < 1000; i++) {
+        BlockingQueue_enq(queue, &one); // Blocks while the queue is full
+    }
+    assert(workers() == MAX_WORKERS);
+    AutoscalerStats stats;
+    Autoscaler_stats(autoscaler, &stats);
+    assert(stats.dequeue_rate > 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that once the load goes away, the spare consumers are retired down to the minimum and their threads exit
+ * while the queue stays empty, and that the remaining one still processes elements.
+ */
+int scalesDownWhenIdle() {
+    int one = ONE;
+    Autoscaler_start(autoscaler);
+    for (int i = 0; i < 1000; i++) {
+        BlockingQueue_enq(queue, &one);
+    }
+    assert(workers() > MIN_WORKERS);
+    for (int i = 0; i < 100 && workers() > MIN_WORKERS; i++) {
+        usleep(AUTOSCALER_INTERVAL_MS*1000*AUTOSCALER_DOWN_INTERVALS/2);
+    }
+    assert(workers() == MIN_WORKERS);
+    // Nothing is enqueued meanwhile, so the retired consumers can only exit from waiting on the empty queue
+    for (int i = 0; i < 100 && running() > MIN_WORKERS; i++) {
+        usleep(AUTOSCALER_INTERVAL_MS*1000);
+    }
+    assert(BlockingQueue_isEmpty(queue));
+    assert(running() == MIN_WORKERS);
+    long before = atomic_load(&processed);
+    BlockingQueue_enq(queue, &one);
+    usleep(WORK_US*10);
+    assert(atomic_load(&processed) == before + 1);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that stopping processes every element already queued before the consumers exit.
+ */
+int stopDrainsQueue() {
+    int one = ONE;
+    Autoscaler_start(autoscaler);
+    for (int i = 0; i < 200; i++) {
+        BlockingQueue_enq(queue, &one);
+    }
+    Autoscaler_stop(autoscaler);
+    assert(atomic_load(&processed) == 200);
+    assert(BlockingQueue_isEmpty(queue));
+    assert(workers() == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that stopping a pool on a full queue whose overflow policy rejects or drops elements still delivers every
+ * consumer's retirement, and processes every element the queue kept.
+ */
+int stopUnderEveryPolicy() {
+    int one = ONE;
+    BlockingQueuePolicy policies[] = {
+        BLOCKING_QUEUE_REJECT_NEWEST, BLOCKING_QUEUE_EVICT_OLDEST, BLOCKING_QUEUE_OVERWRITE
+    };
+    for (int p = 0; p < 3; p++) {
+        if (p > 0) {
+            Autoscaler_destroy(autoscaler);
+            autoscaler = new_Autoscaler(queue, work, NULL, MIN_WORKERS, MAX_WORKERS);
+            atomic_store(&processed, 0);
+        }
+        BlockingQueue_setPolicy(queue, policies[p]);
+        Autoscaler_start(autoscaler);
+        long kept = 0;
+        for (int i = 0; i < 200; i++) {
+            void* evicted = NULL;
+            kept += BlockingQueue_enqEvict(queue, &one, &evicted);
+            kept -= evicted != NULL;
+        }
+        assert(BlockingQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+        Autoscaler_stop(autoscaler);
+        assert(atomic_load(&processed) == kept);
+        assert(BlockingQueue_isEmpty(queue));
+        assert(workers() == 0);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the Autoscaler tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newAutoscalerIsNotNull);
+    runTest(startsWithMinWorkers);
+    runTest(scalesUpUnderLoad);
+    runTest(scalesDownWhenIdle);
+    runTest(stopDrainsQueue);
+    runTest(stopUnderEveryPolicy);
+
+    printf("\nAutoscaler Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
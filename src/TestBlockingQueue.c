@@ -9,6 +9,8 @@
 #include <stddef.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <time.h>
+#include <sched.h>
 
 #include "BlockingQueue.h"
 #include "myassert.h"
@@ -364,6 +366,806 @@ int enqAndDeqAfterClearingFromFull() {
     return TEST_SUCCESS;
 }
 
+/*
+ * Fills the queue with the elements of the given array.
+ */
+void fill(int* elements) {
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        BlockingQueue_enq(queue, &elements[i]);
+    }
+}
+
+/*
+ * Checks that the reject-newest policy fails to enqueue to a full queue instead of blocking.
+ */
+int rejectNewestWhenFull() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int one = ONE;
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_REJECT_NEWEST);
+    fill(elements);
+    assert(BlockingQueue_enq(queue, &one) == false);
+    assert(BlockingQueue_dropped(queue) == 1);
+    assert(BlockingQueue_deq(queue) == &elements[0]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the evict-oldest policy hands the oldest element back and keeps the rest in order.
+ */
+int evictOldestWhenFull() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int one = ONE;
+    void* evicted;
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_EVICT_OLDEST);
+    fill(elements);
+    assert(BlockingQueue_enqEvict(queue, &one, &evicted));
+    assert(evicted == &elements[0]);
+    assert(BlockingQueue_dropped(queue) == 1);
+    assert(BlockingQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    for (int i = 1; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        assert(BlockingQueue_deq(queue) == &elements[i]);
+    }
+    assert(BlockingQueue_deq(queue) == &one);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the evict-oldest policy doesn't report an eviction while there is space.
+ */
+int evictOldestWithSpace() {
+    int one = ONE;
+    void* evicted = &one;
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_EVICT_OLDEST);
+    assert(BlockingQueue_enqEvict(queue, &one, &evicted));
+    assert(evicted == NULL);
+    assert(BlockingQueue_dropped(queue) == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the overwrite policy overwrites the oldest elements like a circular log, handing each overwritten one
+ * back, and keeps the rest in order.
+ */
+int overwriteWhenFull() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int extra[3];
+    void* evicted;
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_OVERWRITE);
+    fill(elements);
+    for (int i = 0; i < 3; i++) {
+        assert(BlockingQueue_enqEvict(queue, &extra[i], &evicted));
+        assert(evicted == &elements[i]);
+    }
+    assert(BlockingQueue_dropped(queue) == 3);
+    assert(BlockingQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    for (int i = 3; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        assert(BlockingQueue_deq(queue) == &elements[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        assert(BlockingQueue_deq(queue) == &extra[i]);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the evict-oldest and overwrite policies reject the new element instead of waiting for a consumer
+ * holding the front of the queue.
+ */
+int evictOldestWhilePeekedRejects() {
+    BlockingQueuePolicy policies[] = {BLOCKING_QUEUE_EVICT_OLDEST, BLOCKING_QUEUE_OVERWRITE};
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int one = ONE;
+    int count;
+    void* evicted;
+    fill(elements);
+    for (int i = 0; i < 2; i++) {
+        BlockingQueue_setPolicy(queue, policies[i]);
+        BlockingQueue_peek(queue, 1, &count);
+        assert(BlockingQueue_enqEvict(queue, &one, &evicted) == false);
+        assert(evicted == NULL);
+        assert(BlockingQueue_dropped(queue) == i + 1);
+        assert(BlockingQueue_release(queue, 0));
+    }
+    assert(BlockingQueue_enqEvict(queue, &one, &evicted));
+    assert(evicted == &elements[0]);
+    assert(BlockingQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a thread to hold mutex_deq for 20ms, as a consumer preempted while dequeuing would.
+ */
+void* threadHoldFront(void* arg) {
+    pthread_mutex_lock(&(*queue).mutex_deq);
+    atomic_store((atomic_bool*) arg, true);
+    usleep(20000);
+    pthread_mutex_unlock(&(*queue).mutex_deq);
+    return NULL;
+}
+
+/*
+ * Checks that the evict-oldest and overwrite policies wait for a consumer that is dequeuing, rather than rejecting
+ * the new element, since only a peek may hold the front of the queue for long.
+ */
+int evictOldestWhileDequeuingWaits() {
+    BlockingQueuePolicy policies[] = {BLOCKING_QUEUE_EVICT_OLDEST, BLOCKING_QUEUE_OVERWRITE};
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int one = ONE;
+    void* evicted;
+    pthread_t thr;
+    fill(elements);
+    for (int i = 0; i < 2; i++) {
+        atomic_bool held = false;
+        BlockingQueue_setPolicy(queue, policies[i]);
+        pthread_create(&thr, NULL, threadHoldFront, &held);
+        while (!atomic_load(&held)) {
+            sched_yield();
+        }
+        assert(BlockingQueue_enqEvict(queue, &one, &evicted));
+        assert(evicted == &elements[i]);
+        pthread_join(thr, NULL);
+    }
+    assert(BlockingQueue_dropped(queue) == 2);
+    assert(BlockingQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that enqueueing NULL doesn't use up any space in the queue.
+ */
+int enqNullKeepsSpace() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int one = ONE;
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_REJECT_NEWEST);
+    BlockingQueue_enq(queue, NULL);
+    fill(elements);
+    assert(BlockingQueue_dropped(queue) == 0);
+    assert(BlockingQueue_enq(queue, &one) == false);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Returns the number of milliseconds elapsed since the given time.
+ */
+long elapsedMs(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - (*start).tv_sec)*1000 + (now.tv_nsec - (*start).tv_nsec)/1000000;
+}
+
+/*
+ * Function used by a thread to enqueue an element to the queue after 20ms.
+ */
+void* threadEnqLater(void* arg) {
+    usleep(20000);
+    BlockingQueue_enq(queue, arg);
+    return NULL;
+}
+
+/*
+ * Checks that a timed dequeue returns NULL once its timeout is over on an empty queue, under both the kernel and the
+ * LIFO wakeup policies, and leaves no consumer parked behind.
+ */
+int deqTimedExpires() {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(BlockingQueue_deqTimed(queue, 50000) == NULL);
+    assert(elapsedMs(&start) >= 50);
+    BlockingQueue_setWakeup(queue, BLOCKING_QUEUE_WAKE_LIFO);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(BlockingQueue_deqTimed(queue, 50000) == NULL);
+    assert(elapsedMs(&start) >= 50);
+    assert(BlockingQueue_parked(queue) == ZERO);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a timed dequeue takes an element that arrives before its timeout.
+ */
+int deqTimedTakesArrival() {
+    pthread_t thr;
+    int one = ONE;
+    BlockingQueue_setWakeup(queue, BLOCKING_QUEUE_WAKE_LIFO);
+    pthread_create(&thr, NULL, threadEnqLater, &one);
+    assert(BlockingQueue_deqTimed(queue, 1000000) == &one);
+    pthread_join(thr, NULL);
+    assert(BlockingQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a batch without linger returns every element that is already in the queue, in order.
+ */
+int deqBatchTakesAvailable() {
+    int elements[5];
+    void* batch[10];
+    for (int i = 0; i < 5; i++) {
+        BlockingQueue_enq(queue, &elements[i]);
+    }
+    assert(BlockingQueue_deqBatch(queue, batch, 10, 0) == 5);
+    for (int i = 0; i < 5; i++) {
+        assert(batch[i] == &elements[i]);
+    }
+    assert(BlockingQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a batch stops at its maximum size, leaving the remaining elements in the queue.
+ */
+int deqBatchStopsAtMax() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    void* batch[5];
+    fill(elements);
+    assert(BlockingQueue_deqBatch(queue, batch, 5, 100000) == 5);
+    assert(batch[4] == &elements[4]);
+    assert(BlockingQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE - 5);
+    assert(BlockingQueue_deq(queue) == &elements[5]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a batch lingers for an element that arrives after the first one.
+ */
+int deqBatchLingersForMore() {
+    pthread_t thr;
+    int one = ONE;
+    int zero = ZERO;
+    void* batch[2];
+    BlockingQueue_enq(queue, &one);
+    pthread_create(&thr, NULL, threadEnqLater, &zero);
+    assert(BlockingQueue_deqBatch(queue, batch, 2, 1000000) == 2);
+    pthread_join(thr, NULL);
+    assert(batch[0] == &one && batch[1] == &zero);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a batch that doesn't fill up is returned once the linger is over.
+ */
+int deqBatchLingerExpires() {
+    int one = ONE;
+    void* batch[5];
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    BlockingQueue_enq(queue, &one);
+    assert(BlockingQueue_deqBatch(queue, batch, 5, 50000) == 1);
+    assert(elapsedMs(&start) >= 50);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that an adaptive batch doesn't linger when elements arrive far apart.
+ */
+int deqBatchAdaptiveIdle() {
+    int one = ONE;
+    void* batch[5];
+    struct timespec start;
+    BlockingQueue_enq(queue, &one);
+    BlockingQueue_deqBatchAdaptive(queue, batch, 5, 50000); // The first batch only starts observing the arrivals
+    usleep(100000);
+    BlockingQueue_enq(queue, &one);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(BlockingQueue_deqBatchAdaptive(queue, batch, 5, 50000) == 1);
+    assert(elapsedMs(&start) < 50);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a thread to shrink the queue to half its size.
+ */
+void* threadShrink() {
+    return (void*) BlockingQueue_resize(queue, DEFAULT_MAX_QUEUE_SIZE/2);
+}
+
+/*
+ * Checks that growing a full queue makes room for more elements.
+ */
+int resizeGrowMakesRoom() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int one = ONE;
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_REJECT_NEWEST);
+    fill(elements);
+    assert(BlockingQueue_resize(queue, DEFAULT_MAX_QUEUE_SIZE + 1));
+    assert(BlockingQueue_enq(queue, &one));
+    assert(BlockingQueue_enq(queue, &one) == false);
+    assert(BlockingQueue_deq(queue) == &elements[0]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that shrinking a queue keeps its elements in order and limits its capacity.
+ */
+int resizeShrinkKeepsOrder() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_REJECT_NEWEST);
+    for (int i = 0; i < 5; i++) {
+        BlockingQueue_enq(queue, &elements[i]);
+    }
+    assert(BlockingQueue_resize(queue, 6));
+    assert(BlockingQueue_enq(queue, &elements[5]));
+    assert(BlockingQueue_enq(queue, &elements[6]) == false);
+    for (int i = 0; i < 6; i++) {
+        assert(BlockingQueue_deq(queue) == &elements[i]);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that shrinking a full queue waits for consumers to make room.
+ */
+int resizeShrinkWaitsForRoom() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    pthread_t thr;
+    void* tr;
+    fill(elements);
+    pthread_create(&thr, NULL, threadShrink, NULL); // Has to wait for half the elements to be dequeued
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE/2; i++) {
+        assert(BlockingQueue_deq(queue) == &elements[i]);
+    }
+    pthread_join(thr, &tr);
+    assert((bool) tr);
+    assert(BlockingQueue_capacity(queue) == DEFAULT_MAX_QUEUE_SIZE/2);
+    assert(BlockingQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE/2);
+    assert(BlockingQueue_deq(queue) == &elements[DEFAULT_MAX_QUEUE_SIZE/2]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a thread to enqueue 10000 numbered elements.
+ */
+void* threadEnqNumbered(void* arg) {
+    long* numbers = arg;
+    for (int i = 0; i < 10000; i++) {
+        BlockingQueue_enq(queue, &numbers[i]);
+    }
+    return NULL;
+}
+
+/*
+ * Function used by a thread to resize the queue up and down 10 times.
+ */
+void* threadResizeRepeatedly() {
+    for (int i = 0; i < 10; i++) {
+        BlockingQueue_resize(queue, (i % 2) ? DEFAULT_MAX_QUEUE_SIZE*4 : DEFAULT_MAX_QUEUE_SIZE/4);
+        usleep(1000);
+    }
+    return NULL;
+}
+
+/*
+ * Checks that resizing up and down while a producer and a consumer are running keeps every element in order.
+ */
+int resizeWhileRunning() {
+    static long numbers[10000];
+    pthread_t producer, resizer;
+    for (int i = 0; i < 10000; i++) {
+        numbers[i] = i;
+    }
+    pthread_create(&producer, NULL, threadEnqNumbered, numbers);
+    pthread_create(&resizer, NULL, threadResizeRepeatedly, NULL);
+    int in_order = 0;
+    for (int i = 0; i < 10000; i++) {
+        if (*(long*) BlockingQueue_deq(queue) == i) {
+            in_order++;
+        }
+    }
+    pthread_join(producer, NULL);
+    pthread_join(resizer, NULL);
+    assert(in_order == 10000);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a thread to grow the queue.
+ */
+void* threadGrow() {
+    return (void*) BlockingQueue_resize(queue, DEFAULT_MAX_QUEUE_SIZE*2);
+}
+
+/*
+ * Function used by a thread to take one snapshot of the queue, returning the number of elements it copied.
+ */
+void* threadSnapshot() {
+    void* snapshot[DEFAULT_MAX_QUEUE_SIZE*2];
+    return (void*) (long) BlockingQueue_snapshot(queue, snapshot, DEFAULT_MAX_QUEUE_SIZE*2);
+}
+
+/*
+ * Checks that once a resize waits for the snapshots reading the old array, new snapshots wait for it rather than
+ * register, so that snapshots taken back to back can't keep it waiting forever.
+ */
+int snapshotBacksOffDrainingResize() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    pthread_t resizer, monitor;
+    void* resized;
+    void* copied;
+    fill(elements);
+    atomic_fetch_add(&(*queue).snapshots, 1); // Stands for a snapshot still reading the old array
+    pthread_create(&resizer, NULL, threadGrow, NULL);
+    while (!atomic_load(&(*queue).draining)) {
+        usleep(1000);
+    }
+    pthread_create(&monitor, NULL, threadSnapshot, NULL);
+    usleep(20000); // Makes the program sleep for 20ms, to make sure that the snapshot is properly waiting
+    assert(atomic_load(&(*queue).snapshots) == 1);
+    atomic_fetch_sub(&(*queue).snapshots, 1);
+    pthread_join(resizer, &resized);
+    pthread_join(monitor, &copied);
+    assert(resized == (void*) true);
+    assert((long) copied == DEFAULT_MAX_QUEUE_SIZE);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that committed slots can be dequeued in order, and that unused reserved slots are handed back.
+ */
+int reserveCommitThenDeq() {
+    int elements[3];
+    int count;
+    void* _Atomic* slots = BlockingQueue_reserve(queue, 5, &count);
+    assert(count == 5);
+    for (int i = 0; i < 3; i++) {
+        atomic_store_explicit(&slots[i], &elements[i], memory_order_relaxed);
+    }
+    assert(BlockingQueue_commit(queue, 6) == false);
+    assert(BlockingQueue_commit(queue, 3));
+    assert(BlockingQueue_size(queue) == 3);
+    for (int i = 0; i < 3; i++) {
+        assert(BlockingQueue_deq(queue) == &elements[i]);
+    }
+    // All the space is available again
+    int others[DEFAULT_MAX_QUEUE_SIZE];
+    fill(others);
+    assert(BlockingQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a thread to reserve one slot, store the given element in it and commit it.
+ */
+void* threadReserveCommit(void* arg) {
+    int count;
+    void* _Atomic* slots = BlockingQueue_reserve(queue, 1, &count);
+    atomic_store_explicit(&slots[0], arg, memory_order_relaxed);
+    return (void*) BlockingQueue_commit(queue, count);
+}
+
+/*
+ * Checks that releasing peeked elements frees space for a producer waiting on a reservation,
+ * while elements that weren't released stay at the front.
+ */
+int peekReleaseFreesSpace() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int last = ONE;
+    pthread_t thr;
+    void* tr;
+    int count;
+    fill(elements);
+    pthread_create(&thr, NULL, threadReserveCommit, &last); // Has to wait until an element is released
+    void** peeked = BlockingQueue_peek(queue, 4, &count);
+    assert(count == 4 && peeked[0] == &elements[0] && peeked[3] == &elements[3]);
+    assert(BlockingQueue_release(queue, 1));
+    pthread_join(thr, &tr);
+    assert((bool) tr);
+    assert(BlockingQueue_deq(queue) == &elements[1]);
+    for (int i = 2; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        BlockingQueue_deq(queue);
+    }
+    assert(BlockingQueue_deq(queue) == &last);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a thread to peek at one element and release it.
+ */
+void* threadPeekRelease() {
+    int count;
+    void* element = BlockingQueue_peek(queue, 1, &count)[0];
+    BlockingQueue_release(queue, count);
+    return element;
+}
+
+/*
+ * Checks that peeking at an empty queue waits until an element is enqueued.
+ */
+int peekWaitsForElement() {
+    int one = ONE;
+    pthread_t thr;
+    void* tr;
+    pthread_create(&thr, NULL, threadPeekRelease, NULL);
+    usleep(20000); // Makes the program sleep for 20ms, to make sure that the thread is properly waiting
+    BlockingQueue_enq(queue, &one);
+    pthread_join(thr, &tr);
+    assert(tr == &one);
+    assert(BlockingQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the front element and a snapshot can be read without dequeuing anything.
+ */
+int snapshotLeavesElements() {
+    int elements[5];
+    void* snapshot[10];
+    assert(BlockingQueue_front(queue) == NULL);
+    assert(BlockingQueue_snapshot(queue, snapshot, 10) == 0);
+    for (int i = 0; i < 5; i++) {
+        BlockingQueue_enq(queue, &elements[i]);
+    }
+    assert(BlockingQueue_front(queue) == &elements[0]);
+    assert(BlockingQueue_snapshot(queue, snapshot, 3) == 3);
+    assert(BlockingQueue_snapshot(queue, snapshot, 10) == 5);
+    for (int i = 0; i < 5; i++) {
+        assert(snapshot[i] == &elements[i]);
+    }
+    assert(BlockingQueue_size(queue) == 5);
+    assert(BlockingQueue_deq(queue) == &elements[0]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a snapshot doesn't wait for a resize that is itself waiting for consumers to make room.
+ */
+int snapshotDuringBlockedResize() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    void* snapshot[DEFAULT_MAX_QUEUE_SIZE];
+    pthread_t thr;
+    fill(elements);
+    pthread_create(&thr, NULL, threadShrink, NULL); // Has to wait for half the elements to be dequeued
+    usleep(20000); // Makes the program sleep for 20ms, to make sure that the thread is properly waiting
+    assert(BlockingQueue_snapshot(queue, snapshot, DEFAULT_MAX_QUEUE_SIZE) == DEFAULT_MAX_QUEUE_SIZE);
+    assert(BlockingQueue_front(queue) == &elements[0]);
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE/2; i++) {
+        BlockingQueue_deq(queue);
+    }
+    pthread_join(thr, NULL);
+    assert(BlockingQueue_front(queue) == &elements[DEFAULT_MAX_QUEUE_SIZE/2]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a thread to take 2000 snapshots, returning the number of them that aren't a run of consecutive
+ * numbers, or whose size couldn't be right.
+ */
+void* threadSnapshotRepeatedly() {
+    void* snapshot[DEFAULT_MAX_QUEUE_SIZE*4];
+    long inconsistent = 0;
+    for (int i = 0; i < 2000; i++) {
+        int count = BlockingQueue_snapshot(queue, snapshot, DEFAULT_MAX_QUEUE_SIZE*4);
+        for (int j = 1; j < count; j++) {
+            if (*(long*) snapshot[j] != *(long*) snapshot[j - 1] + 1) {
+                inconsistent++;
+            }
+        }
+        int size = BlockingQueue_size(queue);
+        if (size < 0 || size > DEFAULT_MAX_QUEUE_SIZE*4) {
+            inconsistent++;
+        }
+    }
+    return (void*) inconsistent;
+}
+
+/*
+ * Checks that snapshots taken while a producer, a consumer and a resizer are running only ever show elements
+ * that were in the queue together, in order.
+ */
+int snapshotWhileRunning() {
+    static long numbers[10000];
+    pthread_t producer, resizer, monitor;
+    void* inconsistent;
+    for (int i = 0; i < 10000; i++) {
+        numbers[i] = i;
+    }
+    pthread_create(&producer, NULL, threadEnqNumbered, numbers);
+    pthread_create(&resizer, NULL, threadResizeRepeatedly, NULL);
+    pthread_create(&monitor, NULL, threadSnapshotRepeatedly, NULL);
+    for (int i = 0; i < 10000; i++) {
+        BlockingQueue_deq(queue);
+    }
+    pthread_join(producer, NULL);
+    pthread_join(resizer, NULL);
+    pthread_join(monitor, &inconsistent);
+    assert(inconsistent == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a thread to enqueue 10000 numbered elements through reservations of up to 3 slots, handing the
+ * last slot of each full reservation back unused.
+ */
+void* threadReserveNumbered(void* arg) {
+    long* numbers = arg;
+    int count;
+    for (int i = 0; i < 10000; ) {
+        void* _Atomic* slots = BlockingQueue_reserve(queue, 3, &count);
+        int used = count == 3 ? 2 : count;
+        if (used > 10000 - i) {
+            used = 10000 - i;
+        }
+        for (int j = 0; j < used; j++) {
+            atomic_store_explicit(&slots[j], &numbers[i + j], memory_order_relaxed);
+        }
+        BlockingQueue_commit(queue, used);
+        i += used;
+    }
+    return NULL;
+}
+
+/*
+ * Checks that snapshots taken while a producer fills and commits reservations only ever show committed elements
+ * that were in the queue together, in order.
+ */
+int snapshotWhileReserving() {
+    static long numbers[10000];
+    pthread_t producer, monitor;
+    void* inconsistent;
+    for (int i = 0; i < 10000; i++) {
+        numbers[i] = i;
+    }
+    pthread_create(&producer, NULL, threadReserveNumbered, numbers);
+    pthread_create(&monitor, NULL, threadSnapshotRepeatedly, NULL);
+    for (int i = 0; i < 10000; i++) {
+        assert(*(long*) BlockingQueue_deq(queue) == i);
+    }
+    pthread_join(producer, NULL);
+    pthread_join(monitor, &inconsistent);
+    assert(inconsistent == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Waits until the given number of consumers are parked on the queue's waiter stack.
+ */
+static void wait_parked(int count) {
+    while (BlockingQueue_parked(queue) != count) {
+        usleep(1000);
+    }
+}
+
+/*
+ * Checks that under the LIFO wakeup policy an element wakes the consumer that started waiting most recently.
+ */
+int lifoWakesLatestConsumer() {
+    int one = ONE;
+    int two = 2;
+    pthread_t first, latest;
+    void *tr_first, *tr_latest;
+    BlockingQueue_setWakeup(queue, BLOCKING_QUEUE_WAKE_LIFO);
+    pthread_create(&first, NULL, threadDeq, NULL);
+    wait_parked(1);
+    pthread_create(&latest, NULL, threadDeq, NULL);
+    wait_parked(2);
+    BlockingQueue_enq(queue, &one);
+    pthread_join(latest, &tr_latest);
+    assert(tr_latest == &one);
+    assert(BlockingQueue_parked(queue) == 1);
+    BlockingQueue_enq(queue, &two);
+    pthread_join(first, &tr_first);
+    assert(tr_first == &two);
+    assert(BlockingQueue_parked(queue) == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a consumer thread to dequeue elements until it dequeues the given stop element, returning the
+ * number of other elements it dequeued.
+ */
+void* threadDeqUntil(void* arg) {
+    long count = 0;
+    while (BlockingQueue_deq(queue) != arg) {
+        count++;
+    }
+    return (void*) count;
+}
+
+/*
+ * Checks that under the LIFO wakeup policy and light load, the same consumer handles every element while the others
+ * stay parked.
+ */
+int lifoKeepsOneConsumerHot() {
+    int one = ONE;
+    int stop = ONE;
+    pthread_t consumers[4];
+    void* counts[4];
+    BlockingQueue_setWakeup(queue, BLOCKING_QUEUE_WAKE_LIFO);
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&consumers[i], NULL, threadDeqUntil, &stop);
+    }
+    // Each element is only enqueued once the previous one has been handled, and its consumer is parked again
+    for (int i = 0; i < 100; i++) {
+        wait_parked(4);
+        BlockingQueue_enq(queue, &one);
+    }
+    wait_parked(4);
+    for (int i = 0; i < 4; i++) {
+        BlockingQueue_enq(queue, &stop);
+    }
+    long busiest = 0;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(consumers[i], &counts[i]);
+        busiest = (long) counts[i] > busiest ? (long) counts[i] : busiest;
+    }
+    assert(busiest == 100);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a consumer thread to dequeue 6000 elements in batches of up to 8.
+ */
+void* threadDeqBatches() {
+    void* elements[8];
+    for (int count = 0; count < 6000;) {
+        count += BlockingQueue_deqBatch(queue, elements, 6000 - count < 8 ? 6000 - count : 8, 0);
+    }
+    return NULL;
+}
+
+/*
+ * Checks that under the LOCAL wakeup policy, producers and consumers using every way in and out of the queue keep
+ * running until every element has been dequeued, and leave no consumer parked.
+ */
+int localWakeupWhileRunning() {
+    static long numbers[10000];
+    pthread_t producers[2], consumers[2];
+    int count;
+    BlockingQueue_setWakeup(queue, BLOCKING_QUEUE_WAKE_LOCAL);
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&consumers[i], NULL, threadDeqBatches, NULL);
+        pthread_create(&producers[i], NULL, threadEnqNumbered, numbers);
+    }
+    for (int i = 0; i < 8000; i++) {
+        if (i % 2) {
+            BlockingQueue_deq(queue);
+        }
+        else {
+            BlockingQueue_peek(queue, 1, &count);
+            BlockingQueue_release(queue, count);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(producers[i], NULL);
+        pthread_join(consumers[i], NULL);
+    }
+    assert(BlockingQueue_isEmpty(queue));
+    assert(BlockingQueue_parked(queue) == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Function used by a consumer thread to dequeue a batch of up to 5 elements, lingering for up to a second, returning
+ * the number of elements dequeued.
+ */
+void* threadDeqBatchLinger() {
+    void* batch[5];
+    return (void*) (long) BlockingQueue_deqBatch(queue, batch, 5, 1000000);
+}
+
+/*
+ * Checks that under the LIFO wakeup policy, a batch consumer lingering for more elements parks on the waiter stack
+ * like any other consumer, is woken by the next element, and leaves the stack once its linger is over.
+ */
+int lifoParksLingeringBatch() {
+    int elements[2];
+    void* batch[5];
+    pthread_t consumer;
+    void* tr;
+    BlockingQueue_setWakeup(queue, BLOCKING_QUEUE_WAKE_LIFO);
+    BlockingQueue_enq(queue, &elements[0]);
+    pthread_create(&consumer, NULL, threadDeqBatchLinger, NULL);
+    wait_parked(1); // Lingering for a second element
+    BlockingQueue_enq(queue, &elements[1]);
+    wait_parked(0);
+    pthread_join(consumer, &tr);
+    assert((long) tr == 2);
+
+    BlockingQueue_enq(queue, &elements[0]);
+    assert(BlockingQueue_deqBatch(queue, batch, 5, 50000) == 1);
+    assert(batch[0] == &elements[0]);
+    assert(BlockingQueue_parked(queue) == 0);
+    return TEST_SUCCESS;
+}
+
 /*
  * Main function for the BlockingQueue tests which will run each user-defined test in turn.
  */
@@ -399,6 +1201,36 @@ int main() {
     runTest(enqClearedSize);
     runTest(enqAndDeqAfterClearing);
     runTest(enqAndDeqAfterClearingFromFull);
+    runTest(rejectNewestWhenFull);
+    runTest(evictOldestWhenFull);
+    runTest(evictOldestWithSpace);
+    runTest(overwriteWhenFull);
+    runTest(evictOldestWhilePeekedRejects);
+    runTest(evictOldestWhileDequeuingWaits);
+    runTest(enqNullKeepsSpace);
+    runTest(deqTimedExpires);
+    runTest(deqTimedTakesArrival);
+    runTest(deqBatchTakesAvailable);
+    runTest(deqBatchStopsAtMax);
+    runTest(deqBatchLingersForMore);
+    runTest(deqBatchLingerExpires);
+    runTest(deqBatchAdaptiveIdle);
+    runTest(resizeGrowMakesRoom);
+    runTest(resizeShrinkKeepsOrder);
+    runTest(resizeShrinkWaitsForRoom);
+    runTest(resizeWhileRunning);
+    runTest(snapshotBacksOffDrainingResize);
+    runTest(reserveCommitThenDeq);
+    runTest(peekReleaseFreesSpace);
+    runTest(peekWaitsForElement);
+    runTest(snapshotLeavesElements);
+    runTest(snapshotWhileRunning);
+    runTest(snapshotWhileReserving);
+    runTest(snapshotDuringBlockedResize);
+    runTest(lifoWakesLatestConsumer);
+    runTest(lifoKeepsOneConsumerHot);
+    runTest(localWakeupWhileRunning);
+    runTest(lifoParksLingeringBatch);
 
     printf("\nBlockingQueue Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
 
@@ -0,0 +1,229 @@
+/*
+ * TestBlockingQueueCpp.cpp
+ *
+ * Very simple unit test file for the C++ Queue<T> and BlockingQueue<T> templates.
+ *
+ */
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BlockingQueue.hpp"
+#include "myassert.h"
+
+#define DEFAULT_MAX_QUEUE_SIZE 20
+
+/*
+ * The queue to use during tests
+ */
+static typed::BlockingQueue<int> *queue;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new typed::BlockingQueue<int>(DEFAULT_MAX_QUEUE_SIZE);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    delete queue;
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * An element type counting how many of its values are alive, to check that every element is destroyed exactly once.
+ */
+struct Counted {
+    static inline int alive = 0;
+    int value;
+    explicit Counted(int value) : value(value) { alive++; }
+    Counted(Counted&& other) : value(other.value) { alive++; }
+    Counted(const Counted&) = delete;
+    ~Counted() { alive--; }
+};
+
+
+/*
+ * Checks that elements are dequeued in the order they were enqueued, and that size follows.
+ */
+int pushPopInOrder() {
+    assert((*queue).empty());
+    for (int i = 0; i < 10; i++) {
+        (*queue).push(i);
+    }
+    assert((*queue).size() == 10);
+    for (int i = 0; i < 10; i++) {
+        assert((*queue).pop() == i);
+    }
+    assert((*queue).empty());
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that try_pop returns nothing from an empty queue, and that try_push fails on a full one.
+ */
+int tryPushAndTryPop() {
+    assert(!(*queue).try_pop().has_value());
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        assert((*queue).try_push(i));
+    }
+    assert(!(*queue).try_push(DEFAULT_MAX_QUEUE_SIZE));
+    std::optional<int> front = (*queue).try_pop();
+    assert(front.has_value() && *front == 0);
+    assert((*queue).try_push(DEFAULT_MAX_QUEUE_SIZE));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that move-only elements go through the queue, and that emplace constructs them in place.
+ */
+int moveOnlyAndEmplace() {
+    typed::BlockingQueue<std::unique_ptr<std::string>> strings(4);
+    strings.push(std::make_unique<std::string>("first"));
+    strings.emplace(new std::string("second"));
+    assert(*strings.pop() == "first");
+    std::optional<std::unique_ptr<std::string>> second = strings.try_pop();
+    assert(second.has_value() && **second == "second");
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that null pointers are elements like any other, unlike in the C BlockingQueue.
+ */
+int nullPointerIsAnElement() {
+    typed::BlockingQueue<int*> pointers(4);
+    pointers.push(nullptr);
+    assert(pointers.size() == 1);
+    std::optional<int*> popped = pointers.try_pop();
+    assert(popped.has_value() && *popped == nullptr);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that every element is destroyed exactly once, whether it is dequeued or still queued when the queue goes,
+ * as the ring wraps around several times.
+ */
+int elementsDestroyedOnce() {
+    {
+        typed::Queue<Counted> counted(3);
+        for (int i = 0; i < 10; i++) {
+            assert(counted.try_emplace(i));
+            if (i >= 1) {
+                std::optional<Counted> popped = counted.try_pop();
+                assert(popped.has_value() && (*popped).value == i - 1);
+            }
+        }
+        assert(Counted::alive == 1);
+        assert(counted.try_emplace(10) && counted.try_emplace(11) && !counted.try_emplace(12));
+    }
+    assert(Counted::alive == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that popping from an empty queue waits until an element is pushed.
+ */
+int popWaitsForPush() {
+    int popped = 0;
+    std::thread consumer([&popped]() { popped = (*queue).pop(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50)); // Makes sure that the thread is properly waiting
+    (*queue).push(42);
+    consumer.join();
+    assert(popped == 42);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that pushing to a full queue waits until an element is popped.
+ */
+int pushWaitsForSpace() {
+    std::atomic<bool> pushed(false);
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        (*queue).push(i);
+    }
+    std::thread producer([&pushed]() { (*queue).push(-1); pushed = true; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50)); // Makes sure that the thread is properly waiting
+    assert(!pushed);
+    assert((*queue).pop() == 0);
+    producer.join();
+    assert(pushed && (*queue).size() == DEFAULT_MAX_QUEUE_SIZE);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that with several producers and consumers, every element is dequeued exactly once.
+ */
+int concurrentProducersAndConsumers() {
+    const int threads = 4;
+    const int per_thread = 20000;
+    std::vector<std::atomic<int>> seen(threads*per_thread);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([t]() {
+            for (int i = 0; i < per_thread; i++) {
+                (*queue).push(t*per_thread + i);
+            }
+        });
+        workers.emplace_back([&seen]() {
+            for (int i = 0; i < per_thread; i++) {
+                seen[(*queue).pop()]++;
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (std::atomic<int>& count : seen) {
+        assert(count == 1);
+    }
+    assert((*queue).empty());
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the C++ BlockingQueue tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(pushPopInOrder);
+    runTest(tryPushAndTryPop);
+    runTest(moveOnlyAndEmplace);
+    runTest(nullPointerIsAnElement);
+    runTest(elementsDestroyedOnce);
+    runTest(popWaitsForPush);
+    runTest(pushWaitsForSpace);
+    runTest(concurrentProducersAndConsumers);
+
+    printf("\nBlockingQueueCpp Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
@@ -0,0 +1,244 @@
+/*
+ * TestCoalescingQueue.c
+ *
+ * Very simple unit test file for CoalescingQueue functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "CoalescingQueue.h"
+#include "myassert.h"
+
+
+#define DEFAULT_MAX_KEYS 20
+
+/*
+ * The queue to use during tests
+ */
+static CoalescingQueue *queue;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new_CoalescingQueue(DEFAULT_MAX_KEYS);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    CoalescingQueue_destroy(queue);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * Function used by a thread to enqueue the given element under a new key.
+ */
+void* threadEnqNewKey(void* arg) {
+    return (void*) CoalescingQueue_enq(queue, DEFAULT_MAX_KEYS, arg, NULL);
+}
+
+/*
+ * Function used by a thread to dequeue an element from the queue.
+ */
+void* threadDeq() {
+    return CoalescingQueue_deq(queue, NULL);
+}
+
+
+/*
+ * Checks that the CoalescingQueue constructor returns a non-NULL pointer, and NULL for an invalid size.
+ */
+int newQueueIsNotNull() {
+    assert(queue != NULL);
+    assert(new_CoalescingQueue(0) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a new queue is empty, and that no NULL element can be enqueued.
+ */
+int newQueueIsEmpty() {
+    assert(CoalescingQueue_isEmpty(queue));
+    assert(CoalescingQueue_size(queue) == 0);
+    assert(CoalescingQueue_enq(queue, 1, NULL, NULL) == false);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that elements of distinct keys are dequeued in FIFO order, along with their keys.
+ */
+int distinctKeysAreFifo() {
+    int elements[5];
+    unsigned long key;
+    for (int i = 0; i < 5; i++) {
+        CoalescingQueue_enq(queue, 100 + i, &elements[i], NULL);
+    }
+    assert(CoalescingQueue_size(queue) == 5);
+    for (int i = 0; i < 5; i++) {
+        assert(CoalescingQueue_deq(queue, &key) == &elements[i]);
+        assert(key == (unsigned long) 100 + i);
+    }
+    assert(CoalescingQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that enqueueing a pending key replaces its element in place and hands back the replaced element.
+ */
+int pendingKeyReplacedInPlace() {
+    int first = 1;
+    int second = 2;
+    int latest = 3;
+    void* replaced;
+    CoalescingQueue_enq(queue, 1, &first, &replaced);
+    assert(replaced == NULL);
+    CoalescingQueue_enq(queue, 2, &second, NULL);
+    CoalescingQueue_enq(queue, 1, &latest, &replaced);
+    assert(replaced == &first);
+    assert(CoalescingQueue_size(queue) == 2);
+    assert(CoalescingQueue_coalesced(queue) == 1);
+    assert(CoalescingQueue_deq(queue, NULL) == &latest); // Key 1 kept its place in front of key 2
+    assert(CoalescingQueue_deq(queue, NULL) == &second);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a key enqueued again after being dequeued goes to the back of the queue.
+ */
+int dequeuedKeyGoesToBack() {
+    int elements[3];
+    CoalescingQueue_enq(queue, 1, &elements[0], NULL);
+    CoalescingQueue_enq(queue, 2, &elements[1], NULL);
+    CoalescingQueue_deq(queue, NULL);
+    CoalescingQueue_enq(queue, 1, &elements[2], NULL);
+    assert(CoalescingQueue_size(queue) == 2);
+    assert(CoalescingQueue_deq(queue, NULL) == &elements[1]);
+    assert(CoalescingQueue_deq(queue, NULL) == &elements[2]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a full queue still coalesces pending keys, but makes a new key wait for space.
+ */
+int fullQueueOnlyBlocksNewKeys() {
+    int elements[DEFAULT_MAX_KEYS];
+    int one = 1;
+    pthread_t thr;
+    void* tr;
+    for (int i = 0; i < DEFAULT_MAX_KEYS; i++) {
+        CoalescingQueue_enq(queue, i, &elements[i], NULL);
+    }
+    assert(CoalescingQueue_enq(queue, 5, &one, NULL)); // Doesn't block
+    pthread_create(&thr, NULL, threadEnqNewKey, &one); // Has to wait for a key to be dequeued
+    usleep(50000); // Makes the program sleep for 50ms, to make sure that the thread is properly waiting
+    assert(CoalescingQueue_size(queue) == DEFAULT_MAX_KEYS);
+    assert(CoalescingQueue_deq(queue, NULL) == &elements[0]);
+    pthread_join(thr, &tr);
+    assert((bool) tr);
+    assert(CoalescingQueue_size(queue) == DEFAULT_MAX_KEYS);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that no element can be dequeued from an empty queue until one is enqueued.
+ */
+int deqFromEmpty() {
+    int one = 1;
+    pthread_t thr;
+    void* tr;
+    pthread_create(&thr, NULL, threadDeq, NULL);
+    usleep(50000); // Makes the program sleep for 50ms, to make sure that the thread is properly waiting
+    CoalescingQueue_enq(queue, 9, &one, NULL);
+    pthread_join(thr, &tr);
+    assert(tr == &one);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks random enqueues and dequeues over more keys than fit against a simple model, so that the index's
+ * probe runs keep colliding, wrapping and being shifted back.
+ */
+int randomAgainstModel() {
+    static long elements[100000];
+    unsigned long model_keys[DEFAULT_MAX_KEYS];
+    void* model_values[DEFAULT_MAX_KEYS];
+    int model_size = 0;
+    srand(2002);
+    for (int i = 0; i < 100000; i++) {
+        unsigned long key = rand() % (DEFAULT_MAX_KEYS*2);
+        int position = -1;
+        for (int j = 0; j < model_size; j++) {
+            if (model_keys[j] == key) {
+                position = j;
+            }
+        }
+        if (rand() % 2 && (position >= 0 || model_size < DEFAULT_MAX_KEYS)) {
+            CoalescingQueue_enq(queue, key, &elements[i], NULL);
+            if (position < 0) {
+                position = model_size++;
+                model_keys[position] = key;
+            }
+            model_values[position] = &elements[i];
+        }
+        else if (model_size > 0) {
+            unsigned long dequeued;
+            assert(CoalescingQueue_deq(queue, &dequeued) == model_values[0]);
+            assert(dequeued == model_keys[0]);
+            model_size--;
+            for (int j = 0; j < model_size; j++) {
+                model_keys[j] = model_keys[j + 1];
+                model_values[j] = model_values[j + 1];
+            }
+        }
+        assert(CoalescingQueue_size(queue) == model_size);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the CoalescingQueue tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newQueueIsNotNull);
+    runTest(newQueueIsEmpty);
+    runTest(distinctKeysAreFifo);
+    runTest(pendingKeyReplacedInPlace);
+    runTest(dequeuedKeyGoesToBack);
+    runTest(fullQueueOnlyBlocksNewKeys);
+    runTest(deqFromEmpty);
+    runTest(randomAgainstModel);
+
+    printf("\nCoalescingQueue Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
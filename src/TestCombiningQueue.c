@@ -0,0 +1,277 @@
+/*
+ * TestCombiningQueue.c
+ *
+ * Very simple unit test file for CombiningQueue functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "CombiningQueue.h"
+#include "myassert.h"
+
+
+#define DEFAULT_MAX_QUEUE_SIZE 20
+#define THREAD_COUNT 8
+#define ELEMENTS_PER_THREAD 20000
+
+/*
+ * The queue to use during tests
+ */
+static CombiningQueue *queue;
+
+/*
+ * Whether each element of the concurrent test has been dequeued
+ */
+static atomic_int seen[THREAD_COUNT*ELEMENTS_PER_THREAD];
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new_CombiningQueue(DEFAULT_MAX_QUEUE_SIZE);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    CombiningQueue_destroy(queue);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * A thread enqueueing one element.
+ */
+static void* threadEnqOne(void* arg) {
+    CombiningQueue_enq(queue, arg);
+    return NULL;
+}
+
+/*
+ * A thread dequeueing one element, and storing it in arg.
+ */
+static void* threadDeqOne(void* arg) {
+    *(void**) arg = CombiningQueue_deq(queue);
+    return NULL;
+}
+
+/*
+ * A producer thread enqueueing ELEMENTS_PER_THREAD distinct elements.
+ */
+static void* threadProduce(void* arg) {
+    uintptr_t base = (uintptr_t) arg*ELEMENTS_PER_THREAD;
+    for (uintptr_t i = 0; i < ELEMENTS_PER_THREAD; i++) {
+        CombiningQueue_enq(queue, (void*) (base + i + 1)); // Plus one, so that no element is NULL
+    }
+    return NULL;
+}
+
+/*
+ * A consumer thread dequeueing ELEMENTS_PER_THREAD elements, and marking each as seen.
+ */
+static void* threadConsume(void* arg) {
+    (void) arg;
+    for (int i = 0; i < ELEMENTS_PER_THREAD; i++) {
+        uintptr_t element = (uintptr_t) CombiningQueue_deq(queue);
+        atomic_fetch_add(&seen[element - 1], ONE);
+    }
+    return NULL;
+}
+
+/*
+ * Returns the number of slots holding a pending request.
+ */
+static int pending_requests() {
+    int pending = 0;
+    for (int i = 0; i < COMBINING_QUEUE_SLOTS; i++) {
+        int state = atomic_load(&(*queue).slots[i].state);
+        pending += state == COMBINING_ENQ || state == COMBINING_DEQ;
+    }
+    return pending;
+}
+
+
+/*
+ * Checks that the CombiningQueue constructor returns a non-NULL pointer.
+ */
+int newQueueIsNotNull() {
+    assert(queue != NULL);
+    assert(new_CombiningQueue(0) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a NULL element can't be enqueued.
+ */
+int enqNullFails() {
+    assert(!CombiningQueue_enq(queue, NULL));
+    assert(CombiningQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that elements are dequeued in the order they were enqueued, and that the size follows.
+ */
+int enqDeqInOrder() {
+    int elements[10];
+    for (int i = 0; i < 10; i++) {
+        assert(CombiningQueue_enq(queue, &elements[i]));
+    }
+    assert(CombiningQueue_size(queue) == 10);
+    for (int i = 0; i < 10; i++) {
+        assert(CombiningQueue_deq(queue) == &elements[i]);
+    }
+    assert(CombiningQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that dequeuing from an empty queue waits until an element is enqueued.
+ */
+int deqWaitsForEnq() {
+    int one = ONE;
+    void* dequeued = NULL;
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, threadDeqOne, &dequeued);
+    usleep(50000); // Makes sure that the thread is properly waiting
+    assert(dequeued == NULL);
+    CombiningQueue_enq(queue, &one);
+    pthread_join(consumer, NULL);
+    assert(dequeued == &one);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that enqueueing to a full queue waits until an element is dequeued.
+ */
+int enqWaitsForSpace() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE + 1];
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        CombiningQueue_enq(queue, &elements[i]);
+    }
+    pthread_t producer;
+    pthread_create(&producer, NULL, threadEnqOne, &elements[DEFAULT_MAX_QUEUE_SIZE]);
+    usleep(50000); // Makes sure that the thread is properly waiting
+    assert(CombiningQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    assert(CombiningQueue_deq(queue) == &elements[0]);
+    pthread_join(producer, NULL);
+    assert(CombiningQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that while another thread holds the combiner lock, requests wait in their slots, and that the next combiner
+ * applies all of them in a single pass.
+ */
+int oneCombinerServesEveryone() {
+    int elements[THREAD_COUNT];
+    pthread_t producers[THREAD_COUNT];
+    atomic_store(&(*queue).combiner, true);
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&producers[i], NULL, threadEnqOne, &elements[i]);
+    }
+    while (pending_requests() < THREAD_COUNT) {
+        sched_yield();
+    }
+    assert(CombiningQueue_combined(queue) == 0);
+    atomic_store(&(*queue).combiner, false);
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    assert(CombiningQueue_passes(queue) == 1);
+    assert(CombiningQueue_combined(queue) == THREAD_COUNT);
+    assert(CombiningQueue_size(queue) == THREAD_COUNT);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that more threads than there are slots can use the queue at the same time, sharing slots.
+ */
+int moreThreadsThanSlots() {
+    CombiningQueue_destroy(queue);
+    queue = new_CombiningQueue(COMBINING_QUEUE_SLOTS*2);
+    int elements[COMBINING_QUEUE_SLOTS*2];
+    pthread_t producers[COMBINING_QUEUE_SLOTS*2];
+    for (int i = 0; i < COMBINING_QUEUE_SLOTS*2; i++) {
+        pthread_create(&producers[i], NULL, threadEnqOne, &elements[i]);
+    }
+    for (int i = 0; i < COMBINING_QUEUE_SLOTS*2; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    assert(CombiningQueue_size(queue) == COMBINING_QUEUE_SLOTS*2);
+    assert(CombiningQueue_combined(queue) == COMBINING_QUEUE_SLOTS*2);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that with several producers and consumers, every element is dequeued exactly once.
+ */
+int concurrentProducersAndConsumers() {
+    pthread_t producers[THREAD_COUNT];
+    pthread_t consumers[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT*ELEMENTS_PER_THREAD; i++) {
+        atomic_store(&seen[i], 0);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&consumers[i], NULL, threadConsume, NULL);
+        pthread_create(&producers[i], NULL, threadProduce, (void*) (uintptr_t) i);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(producers[i], NULL);
+        pthread_join(consumers[i], NULL);
+    }
+    for (int i = 0; i < THREAD_COUNT*ELEMENTS_PER_THREAD; i++) {
+        assert(atomic_load(&seen[i]) == 1);
+    }
+    assert(CombiningQueue_isEmpty(queue));
+    assert(CombiningQueue_combined(queue) == 2L*THREAD_COUNT*ELEMENTS_PER_THREAD);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the CombiningQueue tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newQueueIsNotNull);
+    runTest(enqNullFails);
+    runTest(enqDeqInOrder);
+    runTest(deqWaitsForEnq);
+    runTest(enqWaitsForSpace);
+    runTest(oneCombinerServesEveryone);
+    runTest(moreThreadsThanSlots);
+    runTest(concurrentProducersAndConsumers);
+
+    printf("\nCombiningQueue Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
@@ -0,0 +1,242 @@
+/*
+ * TestDelayQueue.c
+ *
+ * Very simple unit test file for DelayQueue functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "DelayQueue.h"
+#include "myassert.h"
+
+
+#define DEFAULT_MAX_QUEUE_SIZE 20
+
+/*
+ * The queue to use during tests
+ */
+static DelayQueue *queue;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new_DelayQueue(DEFAULT_MAX_QUEUE_SIZE);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    DelayQueue_destroy(queue);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * Returns the number of milliseconds elapsed since the given time.
+ */
+long elapsedMs(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - (*start).tv_sec)*1000 + (now.tv_nsec - (*start).tv_nsec)/1000000;
+}
+
+/*
+ * Function used by a thread to dequeue an element from the queue.
+ */
+void* threadDeq() {
+    return DelayQueue_deq(queue);
+}
+
+
+/*
+ * Checks that the DelayQueue constructor returns a non-NULL pointer.
+ */
+int newQueueIsNotNull() {
+    assert(queue != NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a new queue is empty.
+ */
+int newQueueIsEmpty() {
+    assert(DelayQueue_isEmpty(queue));
+    assert(DelayQueue_size(queue) == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that no NULL element can be enqueued.
+ */
+int enqNullElement() {
+    assert(DelayQueue_enq(queue, NULL, 0) == false);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that an element without a delay can be dequeued straight away.
+ */
+int enqWithoutDelayIsReady() {
+    int one = 1;
+    assert(DelayQueue_enq(queue, &one, 0));
+    assert(DelayQueue_tryDeq(queue) == &one);
+    assert(DelayQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that an element can't be dequeued before its delay has expired, but still counts towards the size.
+ */
+int enqNotReadyBeforeDelay() {
+    int one = 1;
+    DelayQueue_enq(queue, &one, 200);
+    assert(DelayQueue_tryDeq(queue) == NULL);
+    assert(DelayQueue_size(queue) == 1);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that dequeuing waits until the element's delay has expired.
+ */
+int deqWaitsForDelay() {
+    int one = 1;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    DelayQueue_enq(queue, &one, 50);
+    assert(DelayQueue_deq(queue) == &one);
+    assert(elapsedMs(&start) >= 50);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a delay longer than the bottom level of the wheel is cascaded down and still expires on time.
+ */
+int deqWaitsForLongDelay() {
+    int one = 1;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    DelayQueue_enq(queue, &one, 300);
+    assert(DelayQueue_deq(queue) == &one);
+    long elapsed = elapsedMs(&start);
+    assert(elapsed >= 300 && elapsed < 600);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that elements are dequeued in the order of their deadlines, not the order they were enqueued in.
+ */
+int deqInDeadlineOrder() {
+    int first = 1;
+    int second = 2;
+    int third = 3;
+    DelayQueue_enq(queue, &third, 90);
+    DelayQueue_enq(queue, &first, 10);
+    DelayQueue_enq(queue, &second, 70);
+    assert(DelayQueue_deq(queue) == &first);
+    assert(DelayQueue_deq(queue) == &second);
+    assert(DelayQueue_deq(queue) == &third);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that elements with the same deadline are dequeued in FIFO order.
+ */
+int sameDeadlineIsFifo() {
+    int elements[5];
+    struct timespec ready_at;
+    clock_gettime(CLOCK_MONOTONIC, &ready_at);
+    for (int i = 0; i < 5; i++) {
+        DelayQueue_enqAt(queue, &elements[i], &ready_at);
+    }
+    for (int i = 0; i < 5; i++) {
+        assert(DelayQueue_deq(queue) == &elements[i]);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a consumer waiting for a late element wakes up for an earlier one enqueued after it started waiting.
+ */
+int deqWakesForEarlierElement() {
+    pthread_t thr;
+    void *tr;
+    int late = 1;
+    int early = 2;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    DelayQueue_enq(queue, &late, 1000);
+    pthread_create(&thr, NULL, threadDeq, NULL); // The thread should sleep until the late element's deadline
+    usleep(50000); // Makes the program sleep for 50ms, to make sure that the thread is properly waiting
+    DelayQueue_enq(queue, &early, 20); // The thread should wake up and sleep until this deadline instead
+    pthread_join(thr, &tr);
+
+    assert(tr == &early);
+    assert(elapsedMs(&start) < 500);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that no element can be enqueued to a full queue until an element is dequeued.
+ */
+int enqToFull() {
+    int one = 1;
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        DelayQueue_enq(queue, &one, 0);
+    }
+    pthread_t thr;
+    pthread_create(&thr, NULL, threadDeq, NULL); // Frees a slot, letting the enqueue below through
+    assert(DelayQueue_enq(queue, &one, 0));
+    pthread_join(thr, NULL);
+    assert(DelayQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the DelayQueue tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newQueueIsNotNull);
+    runTest(newQueueIsEmpty);
+    runTest(enqNullElement);
+    runTest(enqWithoutDelayIsReady);
+    runTest(enqNotReadyBeforeDelay);
+    runTest(deqWaitsForDelay);
+    runTest(deqWaitsForLongDelay);
+    runTest(deqInDeadlineOrder);
+    runTest(sameDeadlineIsFifo);
+    runTest(deqWakesForEarlierElement);
+    runTest(enqToFull);
+
+    printf("\nDelayQueue Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
@@ -0,0 +1,312 @@
+/*
+ * TestFileSink.c
+ *
+ * Very simple unit test file for FileSink functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "FileSink.h"
+#include "myassert.h"
+
+
+#define TEST_FILE "/tmp/TestFileSink.log"
+#define BUFFER_COUNT 16
+#define BUFFER_SIZE 64
+#define RECORDS 2000
+#define PRODUCERS 4
+#define RECORD_SIZE 16
+
+/*
+ * The sink to use during tests
+ */
+static FileSink *sink;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    unlink(TEST_FILE);
+    sink = new_FileSink(TEST_FILE, BUFFER_COUNT, BUFFER_SIZE, true);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    if (sink != NULL) {
+        FileSink_destroy(sink);
+    }
+    unlink(TEST_FILE);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * Writes one fixed-size record, "<producer> <sequence>", through the given sink.
+ */
+static void write_record(FileSink* target, int producer, int sequence) {
+    FileSinkBuffer* buffer = FileSink_acquire(target);
+    (*buffer).length = snprintf((*buffer).data, (*buffer).capacity, "%3d %11d\n", producer, sequence);
+    FileSink_submit(target, buffer);
+}
+
+/*
+ * Destroys the test's sink, which writes everything submitted to it, and reads the whole test file into contents.
+ * Returns the number of bytes read.
+ */
+static long close_and_read(char* contents, long max) {
+    FileSink_destroy(sink);
+    sink = NULL;
+    FILE* file = fopen(TEST_FILE, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    long length = fread(contents, 1, max, file);
+    fclose(file);
+    return length;
+}
+
+/*
+ * Checks that the file holds count records from each of producers producers, each producer's in order.
+ */
+static int check_records(const char* contents, long length, int producers, int count) {
+    int next[PRODUCERS] = {0};
+    assert(length == (long) producers*count*RECORD_SIZE);
+    for (long i = 0; i < length; i += RECORD_SIZE) {
+        int producer;
+        int sequence;
+        assert(sscanf(contents + i, "%d %d", &producer, &sequence) == 2);
+        assert(producer >= 0 && producer < producers);
+        assert(sequence == next[producer]);
+        next[producer]++;
+    }
+    for (int p = 0; p < producers; p++) {
+        assert(next[p] == count);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * A producer thread writing RECORDS records tagged with its number.
+ */
+static void* threadWriteRecords(void* arg) {
+    int producer = *(int*) arg;
+    for (int i = 0; i < RECORDS; i++) {
+        write_record(sink, producer, i);
+    }
+    return NULL;
+}
+
+
+/*
+ * Checks that the FileSink constructor returns a non-NULL pointer, and NULL for invalid arguments or files.
+ */
+int newFileSinkIsNotNull() {
+    assert(sink != NULL);
+    assert(new_FileSink(TEST_FILE, 0, BUFFER_SIZE, true) == NULL);
+    assert(new_FileSink(TEST_FILE, BUFFER_COUNT, 0, true) == NULL);
+    assert(new_FileSink("/nonexistent/TestFileSink.log", BUFFER_COUNT, BUFFER_SIZE, true) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that buffers are written in the order they were submitted, many more than the pool holds, so that they
+ * must have gone back to the pool once written.
+ */
+int writesBuffersInOrder() {
+    static char contents[RECORDS*RECORD_SIZE];
+    for (int i = 0; i < RECORDS; i++) {
+        write_record(sink, 0, i);
+    }
+    long length = close_and_read(contents, sizeof(contents));
+    return check_records(contents, length, 1, RECORDS);
+}
+
+/*
+ * Checks that buffers submitted together are written by fewer system calls than there are buffers, and that flushing
+ * waits for all of them.
+ */
+int batchesWrites() {
+    FileSinkBuffer* buffers[BUFFER_COUNT];
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        buffers[i] = FileSink_acquire(sink);
+        (*buffers[i]).length = snprintf((*buffers[i]).data, (*buffers[i]).capacity, "%3d %11d\n", 0, i);
+    }
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        assert(FileSink_submit(sink, buffers[i]));
+    }
+    FileSink_flush(sink);
+    assert(FileSink_bytesWritten(sink) == BUFFER_COUNT*RECORD_SIZE);
+    assert(FileSink_writes(sink) < BUFFER_COUNT);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that several producers can write at the same time, and that each one's records keep their order.
+ */
+int concurrentProducers() {
+    static char contents[PRODUCERS*RECORDS*RECORD_SIZE];
+    pthread_t threads[PRODUCERS];
+    int producers[PRODUCERS];
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers[p] = p;
+        pthread_create(&threads[p], NULL, threadWriteRecords, &producers[p]);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_join(threads[p], NULL);
+    }
+    assert(FileSink_error(sink) == 0);
+    long length = close_and_read(contents, sizeof(contents));
+    return check_records(contents, length, PRODUCERS, RECORDS);
+}
+
+/*
+ * Checks that without io_uring, the batches are written with pwritev just the same.
+ */
+int writesWithoutIoUring() {
+    static char contents[RECORDS*RECORD_SIZE];
+    FileSink_destroy(sink);
+    unlink(TEST_FILE);
+    sink = new_FileSink(TEST_FILE, BUFFER_COUNT, BUFFER_SIZE, false);
+    assert(!FileSink_usesIoUring(sink));
+    for (int i = 0; i < RECORDS; i++) {
+        write_record(sink, 0, i);
+    }
+    long length = close_and_read(contents, sizeof(contents));
+    return check_records(contents, length, 1, RECORDS);
+}
+
+/*
+ * Checks that a new sink appends to what the file already holds.
+ */
+int appendsToExistingFile() {
+    static char contents[2*RECORD_SIZE];
+    write_record(sink, 0, 0);
+    FileSink_destroy(sink);
+    sink = new_FileSink(TEST_FILE, BUFFER_COUNT, BUFFER_SIZE, true);
+    write_record(sink, 0, 1);
+    long length = close_and_read(contents, sizeof(contents));
+    return check_records(contents, length, 1, 2);
+}
+
+/*
+ * Checks that a failed write is reported, that its buffers still go back to the pool, and that no batch is written
+ * after it other than those already in flight.
+ */
+int reportsWriteErrors() {
+    FileSink_destroy(sink);
+    sink = new_FileSink("/dev/full", BUFFER_COUNT, BUFFER_SIZE, true);
+    assert(sink != NULL);
+    for (int i = 0; i < BUFFER_COUNT*4; i++) {
+        write_record(sink, 0, i); // Would block forever if the failed buffers were lost
+    }
+    FileSink_flush(sink);
+    assert(FileSink_error(sink) == ENOSPC);
+    assert(FileSink_bytesWritten(sink) == 0);
+    assert(FileSink_writes(sink) <= FILE_SINK_MAX_IN_FLIGHT);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a sink drains an input supplied by the caller, buffers enqueued straight to it included, and leaves
+ * it to the caller once destroyed.
+ */
+int writesFromCallerInput() {
+    static char contents[RECORDS*RECORD_SIZE];
+    BlockingQueue* input = new_BlockingQueue(BUFFER_COUNT);
+    FileSink_destroy(sink);
+    unlink(TEST_FILE);
+    sink = new_FileSinkWithInput(TEST_FILE, BUFFER_COUNT, BUFFER_SIZE, true, input);
+    assert(sink != NULL);
+    for (int i = 0; i < RECORDS; i++) {
+        FileSinkBuffer* buffer = FileSink_acquire(sink);
+        (*buffer).length = snprintf((*buffer).data, (*buffer).capacity, "%3d %11d\n", 0, i);
+        if (i % 2 == 0) {
+            assert(FileSink_submit(sink, buffer));
+        }
+        else {
+            assert(BlockingQueue_enq(input, buffer));
+        }
+    }
+    long length = close_and_read(contents, sizeof(contents));
+    assert(BlockingQueue_isEmpty(input));
+    BlockingQueue_destroy(input);
+    return check_records(contents, length, 1, RECORDS);
+}
+
+/*
+ * Checks that flushing a sink fed straight through its input still waits for the buffers submitted through
+ * FileSink_submit, however many buffers were written without it.
+ */
+int flushIgnoresDirectBuffers() {
+    BlockingQueue* input = new_BlockingQueue(BUFFER_COUNT);
+    FileSink_destroy(sink);
+    unlink(TEST_FILE);
+    sink = new_FileSinkWithInput(TEST_FILE, BUFFER_COUNT, BUFFER_SIZE, true, input);
+    assert(sink != NULL);
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        FileSinkBuffer* buffer = FileSink_acquire(sink);
+        (*buffer).length = snprintf((*buffer).data, (*buffer).capacity, "%3d %11d\n", 0, i);
+        assert(BlockingQueue_enq(input, buffer));
+    }
+    while (FileSink_bytesWritten(sink) < BUFFER_COUNT*RECORD_SIZE) {
+        usleep(1000);
+    }
+    FileSinkBuffer* buffer = FileSink_acquire(sink);
+    (*buffer).length = snprintf((*buffer).data, (*buffer).capacity, "%3d %11d\n", 0, BUFFER_COUNT);
+    assert(FileSink_submit(sink, buffer));
+    FileSink_flush(sink);
+    assert(FileSink_bytesWritten(sink) == (BUFFER_COUNT + 1)*RECORD_SIZE);
+    FileSink_destroy(sink);
+    sink = NULL;
+    BlockingQueue_destroy(input);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the FileSink tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newFileSinkIsNotNull);
+    runTest(writesBuffersInOrder);
+    runTest(batchesWrites);
+    runTest(concurrentProducers);
+    runTest(writesWithoutIoUring);
+    runTest(appendsToExistingFile);
+    runTest(reportsWriteErrors);
+    runTest(writesFromCallerInput);
+    runTest(flushIgnoresDirectBuffers);
+
+    printf("\nFileSink Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
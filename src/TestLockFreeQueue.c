@@ -0,0 +1,239 @@
+/*
+ * TestLockFreeQueue.c
+ *
+ * Very simple unit test file for LockFreeQueue functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "LockFreeQueue.h"
+#include "myassert.h"
+
+
+#define THREAD_COUNT 4
+#define ELEMENTS_PER_THREAD 200000
+
+/*
+ * The queue to use during tests
+ */
+static LockFreeQueue *queue;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new_LockFreeQueue();
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    LockFreeQueue_destroy(queue);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * Elements of the concurrent test: the producer id (plus one) is stored above 32 bits and the sequence number below.
+ */
+static atomic_uchar seen[THREAD_COUNT][ELEMENTS_PER_THREAD];
+static atomic_long errors;
+
+/*
+ * Function used by a producer thread to enqueue ELEMENTS_PER_THREAD numbered elements.
+ */
+void* threadProduce(void* arg) {
+    uintptr_t id = (uintptr_t) arg;
+    for (uintptr_t sequence = 0; sequence < ELEMENTS_PER_THREAD; sequence++) {
+        LockFreeQueue_enq(queue, (void*) (((id + 1) << 32) | sequence));
+    }
+    return NULL;
+}
+
+/*
+ * Function used by a consumer thread to dequeue ELEMENTS_PER_THREAD elements, checking that each producer's
+ * elements come in order and that no element is dequeued twice.
+ */
+void* threadConsume() {
+    long last[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        last[i] = -1;
+    }
+    for (int i = 0; i < ELEMENTS_PER_THREAD; i++) {
+        uintptr_t element = (uintptr_t) LockFreeQueue_deqBlocking(queue);
+        int id = (int) (element >> 32) - 1;
+        long sequence = (long) (element & 0xffffffff);
+        if (sequence <= last[id] || atomic_exchange(&seen[id][sequence], 1)) {
+            atomic_fetch_add(&errors, 1);
+        }
+        last[id] = sequence;
+    }
+    return NULL;
+}
+
+/*
+ * Function used by a thread to dequeue an element, waiting for one if needed.
+ */
+void* threadDeqBlocking() {
+    return LockFreeQueue_deqBlocking(queue);
+}
+
+
+/*
+ * Checks that the LockFreeQueue constructor returns a non-NULL pointer.
+ */
+int newQueueIsNotNull() {
+    assert(queue != NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a new queue is empty, and that dequeuing from it returns NULL straight away.
+ */
+int newQueueIsEmpty() {
+    assert(LockFreeQueue_isEmpty(queue));
+    assert(LockFreeQueue_deq(queue) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that no NULL element can be enqueued.
+ */
+int enqNullElement() {
+    assert(LockFreeQueue_enq(queue, NULL) == false);
+    assert(LockFreeQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that elements are dequeued in the order they were enqueued.
+ */
+int enqAndDeqInOrder() {
+    int elements[10];
+    for (int i = 0; i < 10; i++) {
+        assert(LockFreeQueue_enq(queue, &elements[i]));
+    }
+    assert(!LockFreeQueue_isEmpty(queue));
+    for (int i = 0; i < 10; i++) {
+        assert(LockFreeQueue_deq(queue) == &elements[i]);
+    }
+    assert(LockFreeQueue_deq(queue) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the queue grows well past any fixed size.
+ */
+int growsWithoutBound() {
+    static int elements[100000];
+    for (int i = 0; i < 100000; i++) {
+        assert(LockFreeQueue_enq(queue, &elements[i]));
+    }
+    for (int i = 0; i < 100000; i++) {
+        assert(LockFreeQueue_deq(queue) == &elements[i]);
+    }
+    assert(LockFreeQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that dequeued nodes are recycled: a long run of enqueues and dequeues only ever allocates a few nodes.
+ */
+int nodesAreRecycled() {
+    int one = ONE;
+    for (int i = 0; i < 100000; i++) {
+        LockFreeQueue_enq(queue, &one);
+        LockFreeQueue_deq(queue);
+    }
+    assert(LockFreeQueue_allocated(queue) < 1000);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a consumer parked on an empty queue is woken up by the next enqueue.
+ */
+int deqBlockingWaitsForElement() {
+    int one = ONE;
+    pthread_t thr;
+    void* tr;
+    pthread_create(&thr, NULL, threadDeqBlocking, NULL);
+    usleep(50000); // Makes the program sleep for 50ms, to make sure that the thread is properly waiting
+    LockFreeQueue_enq(queue, &one);
+    pthread_join(thr, &tr);
+    assert(tr == &one);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that with several producers and consumers, no element is lost or duplicated, every consumer sees each
+ * producer's elements in order, and recycling keeps the number of nodes allocated well below the number enqueued.
+ */
+int concurrentProducersAndConsumers() {
+    pthread_t producers[THREAD_COUNT];
+    pthread_t consumers[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        for (int j = 0; j < ELEMENTS_PER_THREAD; j++) {
+            atomic_init(&seen[i][j], 0);
+        }
+    }
+    atomic_init(&errors, 0);
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&consumers[i], NULL, threadConsume, NULL);
+        pthread_create(&producers[i], NULL, threadProduce, (void*) (uintptr_t) i);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(producers[i], NULL);
+        pthread_join(consumers[i], NULL);
+    }
+    assert(atomic_load(&errors) == 0);
+    assert(LockFreeQueue_isEmpty(queue));
+    assert(LockFreeQueue_allocated(queue) < (long) THREAD_COUNT*ELEMENTS_PER_THREAD);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the LockFreeQueue tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newQueueIsNotNull);
+    runTest(newQueueIsEmpty);
+    runTest(enqNullElement);
+    runTest(enqAndDeqInOrder);
+    runTest(growsWithoutBound);
+    runTest(nodesAreRecycled);
+    runTest(deqBlockingWaitsForElement);
+    runTest(concurrentProducersAndConsumers);
+
+    printf("\nLockFreeQueue Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
@@ -0,0 +1,344 @@
+/*
+ * TestPartitionedQueue.c
+ *
+ * Very simple unit test file for PartitionedQueue functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "PartitionedQueue.h"
+#include "myassert.h"
+
+
+#define DEFAULT_PARTITIONS 4
+#define DEFAULT_PARTITION_SIZE 20
+#define KEY_COUNT 32
+#define ELEMENTS_PER_KEY 2000
+
+/*
+ * The queue to use during tests
+ */
+static PartitionedQueue *queue;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new_PartitionedQueue(DEFAULT_PARTITIONS, DEFAULT_PARTITION_SIZE);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    PartitionedQueue_destroy(queue);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * Returns the first key from the given one that goes to the given partition.
+ */
+unsigned long keyFor(int partition, unsigned long from) {
+    while (PartitionedQueue_partitionOf(queue, from) != partition) {
+        from++;
+    }
+    return from;
+}
+
+/*
+ * Elements of the concurrent test: the key is stored above 32 bits and the sequence number (plus one) below.
+ * The key KEY_COUNT marks a poison element, telling a consumer to stop.
+ */
+static atomic_int in_progress[KEY_COUNT];
+static atomic_long next_sequence[KEY_COUNT];
+static atomic_long errors;
+
+/*
+ * Function used by a thread to enqueue ELEMENTS_PER_KEY numbered elements for every key, interleaving the keys.
+ */
+void* threadProduce() {
+    for (long sequence = 0; sequence < ELEMENTS_PER_KEY; sequence++) {
+        for (unsigned long key = 0; key < KEY_COUNT; key++) {
+            PartitionedQueue_enq(queue, key, (void*) ((key << 32) | (uintptr_t) (sequence + 1)));
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function used by a consumer thread to process elements until it gets a poison element, checking that no other
+ * consumer processes the same key at the same time and that each key's elements come in order. Every consumer
+ * leaves and joins again along the way, to make the partitions move while elements are being processed.
+ */
+void* threadConsume() {
+    int consumer = PartitionedQueue_join(queue);
+    for (long i = 0;; i++) {
+        if (i == 1000) {
+            PartitionedQueue_leave(queue, consumer);
+            consumer = PartitionedQueue_join(queue);
+        }
+        uintptr_t element = (uintptr_t) PartitionedQueue_deq(queue, consumer);
+        int key = (int) (element >> 32);
+        if (key == KEY_COUNT) {
+            break;
+        }
+        long sequence = (long) (element & 0xffffffff) - 1;
+        if (atomic_fetch_add(&in_progress[key], 1) != 0) {
+            atomic_fetch_add(&errors, 1); // Another consumer is processing the same key
+        }
+        if (atomic_load(&next_sequence[key]) != sequence) {
+            atomic_fetch_add(&errors, 1); // The key's elements are out of order
+        }
+        atomic_store(&next_sequence[key], sequence + 1);
+        if (sequence % 100 == 0) {
+            usleep(10);
+        }
+        atomic_fetch_sub(&in_progress[key], 1);
+    }
+    PartitionedQueue_leave(queue, consumer);
+    return NULL;
+}
+
+/*
+ * Function used by a thread to enqueue the given key, pointed at by arg, as an element under that key.
+ */
+void* threadEnq(void* arg) {
+    PartitionedQueue_enq(queue, *(unsigned long*) arg, arg);
+    return NULL;
+}
+
+/*
+ * Function used by a thread to dequeue one element as the given consumer.
+ */
+void* threadDeq(void* arg) {
+    return PartitionedQueue_deq(queue, (int) (intptr_t) arg);
+}
+
+
+/*
+ * Checks that the PartitionedQueue constructor returns a non-NULL pointer, and NULL for invalid sizes.
+ */
+int newQueueIsNotNull() {
+    assert(queue != NULL);
+    assert(new_PartitionedQueue(0, DEFAULT_PARTITION_SIZE) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a new queue is empty, and that no NULL element can be enqueued.
+ */
+int newQueueIsEmpty() {
+    assert(PartitionedQueue_isEmpty(queue));
+    assert(PartitionedQueue_enq(queue, 1, NULL) == false);
+    assert(PartitionedQueue_size(queue) == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that there can be no more consumers than partitions, and that a consumer's id is reused once it has left.
+ */
+int joinUpToPartitionCount() {
+    for (int i = 0; i < DEFAULT_PARTITIONS; i++) {
+        assert(PartitionedQueue_join(queue) == i);
+    }
+    assert(PartitionedQueue_join(queue) == -1);
+    PartitionedQueue_leave(queue, 2);
+    assert(PartitionedQueue_join(queue) == 2);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a single consumer gets the elements of one key in the order they were enqueued.
+ */
+int singleKeyIsFifo() {
+    int elements[10];
+    int consumer = PartitionedQueue_join(queue);
+    for (int i = 0; i < 10; i++) {
+        PartitionedQueue_enq(queue, 42, &elements[i]);
+    }
+    assert(PartitionedQueue_size(queue) == 10);
+    for (int i = 0; i < 10; i++) {
+        assert(PartitionedQueue_deq(queue, consumer) == &elements[i]);
+    }
+    assert(PartitionedQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that each consumer only gets the elements of the partitions it owns, and that partitions are split evenly.
+ */
+int consumersSplitPartitions() {
+    int first = PartitionedQueue_join(queue);
+    int second = PartitionedQueue_join(queue);
+    int owned = 0;
+    for (int p = 0; p < DEFAULT_PARTITIONS; p++) {
+        owned += (*queue).owners[p] == first;
+    }
+    assert(owned == DEFAULT_PARTITIONS/2);
+
+    int elements[DEFAULT_PARTITIONS];
+    for (int p = 0; p < DEFAULT_PARTITIONS; p++) {
+        PartitionedQueue_enq(queue, keyFor(p, 0), &elements[p]);
+    }
+    for (int i = 0; i < DEFAULT_PARTITIONS/2; i++) {
+        int* element = PartitionedQueue_deq(queue, first);
+        assert((*queue).owners[element - elements] == first);
+        element = PartitionedQueue_deq(queue, second);
+        assert((*queue).owners[element - elements] == second);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a partition that moves to a new consumer isn't served to it while its old owner is still processing
+ * one of its elements, and is once the old owner leaves.
+ */
+int movedPartitionWaitsForOldOwner() {
+    int elements[2];
+    int first = PartitionedQueue_join(queue);
+    int last = DEFAULT_PARTITIONS - 1; // The partition the second consumer takes over
+    unsigned long key = keyFor(last, 0);
+    PartitionedQueue_enq(queue, key, &elements[0]);
+    PartitionedQueue_enq(queue, key, &elements[1]);
+    assert(PartitionedQueue_deq(queue, first) == &elements[0]); // The first consumer is now processing the key
+
+    int second = PartitionedQueue_join(queue);
+    assert((*queue).owners[last] == second);
+    pthread_t thr;
+    void* tr;
+    pthread_create(&thr, NULL, threadDeq, (void*) (intptr_t) second);
+    usleep(50000); // Makes the program sleep for 50ms, to make sure that the thread is properly waiting
+    assert(PartitionedQueue_size(queue) == 1); // The second element hasn't been taken yet
+    PartitionedQueue_leave(queue, first);
+    pthread_join(thr, &tr);
+    assert(tr == &elements[1]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that elements of partitions left without a consumer wait for the next one to join.
+ */
+int elementsWaitForConsumer() {
+    int one = ONE;
+    int consumer = PartitionedQueue_join(queue);
+    PartitionedQueue_leave(queue, consumer);
+    PartitionedQueue_enq(queue, 7, &one);
+    consumer = PartitionedQueue_join(queue);
+    assert(PartitionedQueue_deq(queue, consumer) == &one);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a producer waiting for space in a full partition is only woken by a dequeue from that partition.
+ */
+int fullPartitionWaitsForItsOwnSpace() {
+    int elements[DEFAULT_PARTITION_SIZE + 1];
+    pthread_t producer;
+    int first = PartitionedQueue_join(queue);
+    int second = PartitionedQueue_join(queue);
+    // One partition of each consumer
+    int full = -1;
+    int other = -1;
+    for (int p = 0; p < DEFAULT_PARTITIONS; p++) {
+        if ((*queue).owners[p] == first) {
+            full = p;
+        }
+        else {
+            other = p;
+        }
+    }
+    assert(full >= 0 && other >= 0 && (*queue).owners[other] == second);
+    unsigned long key = keyFor(full, 0);
+    for (int i = 0; i < DEFAULT_PARTITION_SIZE; i++) {
+        PartitionedQueue_enq(queue, key, &elements[i]);
+    }
+    PartitionedQueue_enq(queue, keyFor(other, 0), &elements[DEFAULT_PARTITION_SIZE]);
+    pthread_create(&producer, NULL, threadEnq, &key); // Waits for space in the full partition
+    usleep(50000); // Makes sure that the thread is properly waiting
+    assert(PartitionedQueue_deq(queue, second) == &elements[DEFAULT_PARTITION_SIZE]);
+    usleep(50000);
+    assert(PartitionedQueue_size(queue) == DEFAULT_PARTITION_SIZE);
+    assert((*queue).waiting[full] == 1);
+    assert(PartitionedQueue_deq(queue, first) == &elements[0]);
+    pthread_join(producer, NULL);
+    assert(PartitionedQueue_size(queue) == DEFAULT_PARTITION_SIZE);
+    assert((*queue).waiting[full] == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that with several consumers joining and leaving, no key is ever processed by two consumers at once
+ * and every key's elements are processed in order.
+ */
+int concurrentConsumersKeepKeyOrder() {
+    pthread_t producer;
+    pthread_t consumers[DEFAULT_PARTITIONS];
+    for (int i = 0; i < KEY_COUNT; i++) {
+        atomic_init(&in_progress[i], 0);
+        atomic_init(&next_sequence[i], 0);
+    }
+    atomic_init(&errors, 0);
+    for (int i = 0; i < DEFAULT_PARTITIONS; i++) {
+        pthread_create(&consumers[i], NULL, threadConsume, NULL);
+    }
+    pthread_create(&producer, NULL, threadProduce, NULL);
+    pthread_join(producer, NULL);
+
+    // One poison element per partition, behind all of its elements: each consumer leaves on the first it gets
+    for (int p = 0; p < DEFAULT_PARTITIONS; p++) {
+        PartitionedQueue_enq(queue, keyFor(p, KEY_COUNT + 1), (void*) ((uintptr_t) KEY_COUNT << 32));
+    }
+    for (int i = 0; i < DEFAULT_PARTITIONS; i++) {
+        pthread_join(consumers[i], NULL);
+    }
+    assert(atomic_load(&errors) == 0);
+    assert(PartitionedQueue_isEmpty(queue));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the PartitionedQueue tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newQueueIsNotNull);
+    runTest(newQueueIsEmpty);
+    runTest(joinUpToPartitionCount);
+    runTest(singleKeyIsFifo);
+    runTest(consumersSplitPartitions);
+    runTest(movedPartitionWaitsForOldOwner);
+    runTest(elementsWaitForConsumer);
+    runTest(fullPartitionWaitsForItsOwnSpace);
+    runTest(concurrentConsumersKeepKeyOrder);
+
+    printf("\nPartitionedQueue Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
@@ -0,0 +1,330 @@
+/*
+ * TestPipeline.c
+ *
+ * Very simple unit test file for Pipeline functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "Pipeline.h"
+#include "myassert.h"
+
+
+#define DEFAULT_QUEUE_SIZE 20
+#define ELEMENT_COUNT 1000
+
+/*
+ * The pipeline to use during tests, and the sink its results go to
+ */
+static Pipeline *pipeline;
+static BlockingQueue *sink;
+
+/*
+ * The elements submitted during tests
+ */
+static long elements[ELEMENT_COUNT];
+
+/*
+ * Whether the gated stage function may return
+ */
+static atomic_bool gate_open;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    sink = new_BlockingQueue(ELEMENT_COUNT);
+    pipeline = new_Pipeline(DEFAULT_QUEUE_SIZE, sink);
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        elements[i] = i;
+    }
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    Pipeline_destroy(pipeline);
+    BlockingQueue_destroy(sink);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+
+/*
+ * Stage function adding one to the long it is given.
+ */
+void* addOne(void* element, void* context) {
+    (void) context;
+    (*(long*) element)++;
+    return element;
+}
+
+/*
+ * Stage function doubling the long it is given.
+ */
+void* twice(void* element, void* context) {
+    (void) context;
+    (*(long*) element) *= 2;
+    return element;
+}
+
+/*
+ * Stage function dropping odd longs.
+ */
+void* dropOdd(void* element, void* context) {
+    (void) context;
+    return (*(long*) element % 2) ? NULL : element;
+}
+
+/*
+ * Stage function counting the elements it sees in its context, and passing them on.
+ */
+void* count(void* element, void* context) {
+    atomic_fetch_add((atomic_long*) context, 1);
+    return element;
+}
+
+/*
+ * Stage function taking 2ms per element.
+ */
+void* slow(void* element, void* context) {
+    (void) context;
+    usleep(2000);
+    return element;
+}
+
+/*
+ * Stage function waiting for the gate to open.
+ */
+void* gated(void* element, void* context) {
+    (void) context;
+    while (!atomic_load(&gate_open)) {
+        usleep(1000);
+    }
+    return element;
+}
+
+/*
+ * Function used by a producer thread to submit the first 200 elements.
+ */
+void* threadSubmit() {
+    for (int i = 0; i < 200; i++) {
+        Pipeline_submit(pipeline, &elements[i]);
+    }
+    return NULL;
+}
+
+
+/*
+ * Checks that the Pipeline constructor returns a non-NULL pointer.
+ */
+int newPipelineIsNotNull() {
+    assert(pipeline != NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that stages are numbered in the order they are added, and that invalid stages are refused.
+ */
+int addStageReturnsIndex() {
+    assert(Pipeline_addStage(pipeline, "first", addOne, NULL, 1) == 0);
+    assert(Pipeline_addStage(pipeline, "second", addOne, NULL, 1) == 1);
+    assert(Pipeline_addStage(pipeline, "none", NULL, NULL, 1) == -1);
+    assert(Pipeline_addStage(pipeline, "idle", addOne, NULL, 0) == -1);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that every submitted element goes through a single stage before stopping.
+ */
+int singleStageProcessesAll() {
+    atomic_long counted = 0;
+    Pipeline_addStage(pipeline, "count", count, &counted, 4);
+    Pipeline_start(pipeline, false);
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        Pipeline_submit(pipeline, &elements[i]);
+    }
+    Pipeline_stop(pipeline);
+    assert(atomic_load(&counted) == ELEMENT_COUNT);
+    assert(BlockingQueue_size(sink) == ELEMENT_COUNT);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that chained stages are applied in order to every element.
+ */
+int chainedStagesInOrder() {
+    Pipeline_addStage(pipeline, "add", addOne, NULL, 2);
+    Pipeline_addStage(pipeline, "double", twice, NULL, 3);
+    Pipeline_start(pipeline, false);
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        Pipeline_submit(pipeline, &elements[i]);
+    }
+    Pipeline_stop(pipeline);
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        assert(elements[i] == (i + 1)*2);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that elements for which a stage returns NULL don't reach the sink.
+ */
+int stageDropsNull() {
+    Pipeline_addStage(pipeline, "filter", dropOdd, NULL, 2);
+    Pipeline_start(pipeline, false);
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        Pipeline_submit(pipeline, &elements[i]);
+    }
+    Pipeline_stop(pipeline);
+    assert(BlockingQueue_size(sink) == ELEMENT_COUNT/2);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that every stage reports the number of elements it processed and its number of workers.
+ */
+int statsCountProcessed() {
+    PipelineStats stats;
+    Pipeline_addStage(pipeline, "filter", dropOdd, NULL, 2);
+    Pipeline_addStage(pipeline, "add", addOne, NULL, 3);
+    Pipeline_start(pipeline, false);
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        Pipeline_submit(pipeline, &elements[i]);
+    }
+    Pipeline_stop(pipeline);
+    Pipeline_stats(pipeline, 0, &stats);
+    assert(stats.processed == ELEMENT_COUNT && stats.workers == 2 && stats.depth == 0);
+    Pipeline_stats(pipeline, 1, &stats);
+    assert(stats.processed == ELEMENT_COUNT/2 && stats.workers == 3);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the autotuner moves workers from a fast stage to a slow one.
+ */
+int autotuneMovesWorkersToBottleneck() {
+    PipelineStats fast;
+    PipelineStats bottleneck;
+    Pipeline_addStage(pipeline, "fast", addOne, NULL, 4);
+    Pipeline_addStage(pipeline, "slow", slow, NULL, 1);
+    Pipeline_start(pipeline, true);
+    for (int i = 0; i < 400; i++) {
+        Pipeline_submit(pipeline, &elements[i]);
+    }
+    Pipeline_stop(pipeline);
+    Pipeline_stats(pipeline, 0, &fast);
+    Pipeline_stats(pipeline, 1, &bottleneck);
+    assert(bottleneck.workers > 1);
+    assert(fast.workers + bottleneck.workers == 5);
+    assert(bottleneck.processed == 400);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the autotuner keeps moving workers while the donor stage's input is full, and that the stage drains
+ * normally once the bottleneck gets going.
+ */
+int autotuneWithFullDonorInput() {
+    PipelineStats fast;
+    PipelineStats bottleneck;
+    pthread_t producer;
+    atomic_store(&gate_open, false);
+    Pipeline_addStage(pipeline, "fast", addOne, NULL, 4);
+    Pipeline_addStage(pipeline, "gated", gated, NULL, 1);
+    Pipeline_start(pipeline, true);
+    pthread_create(&producer, NULL, threadSubmit, NULL); // Fills both inputs, then blocks
+    for (int i = 0; i < 500; i++) {
+        Pipeline_stats(pipeline, 1, &bottleneck);
+        if (bottleneck.workers == 4) {
+            break;
+        }
+        usleep(PIPELINE_MONITOR_INTERVAL_MS*1000);
+    }
+    Pipeline_stats(pipeline, 0, &fast);
+    assert(fast.workers == 1 && bottleneck.workers == 4);
+    atomic_store(&gate_open, true);
+    pthread_join(producer, NULL);
+    Pipeline_stop(pipeline);
+    Pipeline_stats(pipeline, 1, &bottleneck);
+    assert(bottleneck.processed == 200);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the workers the autotuner takes from a donor stage with an empty input exit, instead of staying parked
+ * on it until the pipeline stops.
+ */
+int autotuneRetiresIdleDonor() {
+    PipelineStats fast;
+    PipelineStats bottleneck;
+    atomic_store(&gate_open, false);
+    Pipeline_addStage(pipeline, "fast", addOne, NULL, 4);
+    Pipeline_addStage(pipeline, "gated", gated, NULL, 1);
+    Pipeline_start(pipeline, true);
+    for (int i = 0; i < 10; i++) {
+        Pipeline_submit(pipeline, &elements[i]); // The fast stage passes them all on, then waits on an empty input
+    }
+    for (int i = 0; i < 500; i++) {
+        Pipeline_stats(pipeline, 0, &fast);
+        if (fast.workers == 1 && fast.running == 1) {
+            break;
+        }
+        usleep(PIPELINE_MONITOR_INTERVAL_MS*1000);
+    }
+    Pipeline_stats(pipeline, 1, &bottleneck);
+    assert(fast.depth == 0);
+    assert(fast.workers == 1 && fast.running == 1);
+    assert(bottleneck.workers == 4 && bottleneck.running == 4);
+    atomic_store(&gate_open, true);
+    Pipeline_stop(pipeline);
+    Pipeline_stats(pipeline, 1, &bottleneck);
+    assert(bottleneck.processed == 10 && bottleneck.running == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the Pipeline tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newPipelineIsNotNull);
+    runTest(addStageReturnsIndex);
+    runTest(singleStageProcessesAll);
+    runTest(chainedStagesInOrder);
+    runTest(stageDropsNull);
+    runTest(statsCountProcessed);
+    runTest(autotuneMovesWorkersToBottleneck);
+    runTest(autotuneWithFullDonorInput);
+    runTest(autotuneRetiresIdleDonor);
+
+    printf("\nPipeline Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
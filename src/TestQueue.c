@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "myassert.h"
 #include "Queue.h"
@@ -308,10 +309,284 @@ int enqAndDeqAfterClearing() {
     return TEST_SUCCESS;
 }
 
+/*
+ * Fills a queue created with another memory backend to capacity and drains it again, checking FIFO order.
+ * Returns true if every element came back in order.
+ */
+bool fillAndDrain(Queue* other) {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    // Go round the ring twice so that the rear and front both wrap around
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+            if (!Queue_enq(other, &elements[i])) {
+                return false;
+            }
+        }
+        for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+            if (Queue_deq(other) != &elements[i]) {
+                return false;
+            }
+        }
+    }
+    return Queue_isEmpty(other);
+}
+
+/*
+ * Checks that a queue backed by huge pages (or their transparent fallback) works like the default one.
+ */
+int hugePagesQueueFillAndDrain() {
+    Queue* other = new_QueueWithAllocator(DEFAULT_MAX_QUEUE_SIZE, QueueAllocator_hugePages());
+    assert(other != NULL);
+    bool drained = fillAndDrain(other);
+    Queue_destroy(other);
+    assert(drained);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a queue backed by a lazily committed mapping works like the default one.
+ */
+int lazyQueueFillAndDrain() {
+    Queue* other = new_QueueWithAllocator(DEFAULT_MAX_QUEUE_SIZE, QueueAllocator_lazy());
+    assert(other != NULL);
+    bool drained = fillAndDrain(other);
+    Queue_destroy(other);
+    assert(drained);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a queue can be carved out of a caller-supplied arena.
+ */
+int arenaQueueFillAndDrain() {
+    static char memory[4096];
+    QueueArena arena;
+    QueueArena_init(&arena, memory, sizeof(memory));
+    Queue* other = new_QueueWithAllocator(DEFAULT_MAX_QUEUE_SIZE, QueueAllocator_arena(&arena));
+    assert(other != NULL);
+    assert((char*) (*other).arr >= memory && (char*) (*other).arr < memory + sizeof(memory));
+    bool drained = fillAndDrain(other);
+    Queue_destroy(other);
+    assert(drained);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that arrays carved out of an arena start on a cache line even when the arena's block doesn't.
+ */
+int arenaAlignsArrays() {
+    static _Alignas(CACHE_LINE_SIZE) char memory[4096];
+    QueueArena arena;
+    QueueArena_init(&arena, memory + 1, sizeof(memory) - 1);
+    for (int i = 0; i < 2; i++) {
+        Queue* other = new_QueueWithAllocator(3, QueueAllocator_arena(&arena));
+        assert(other != NULL);
+        assert((uintptr_t) (*other).arr % CACHE_LINE_SIZE == 0);
+        Queue_destroy(other);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that creating a queue fails cleanly when its arena is too small.
+ */
+int arenaTooSmallReturnsNull() {
+    static char memory[64];
+    QueueArena arena;
+    QueueArena_init(&arena, memory, sizeof(memory));
+    assert(new_QueueWithAllocator(DEFAULT_MAX_QUEUE_SIZE, QueueAllocator_arena(&arena)) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the producer-owned and consumer-owned indices are on different cache lines.
+ */
+int frontAndRearOnSeparateLines() {
+    uintptr_t rear_line = (uintptr_t) &(*queue).rear / CACHE_LINE_SIZE;
+    uintptr_t front_line = (uintptr_t) &(*queue).front / CACHE_LINE_SIZE;
+    uintptr_t arr_line = (uintptr_t) &(*queue).arr / CACHE_LINE_SIZE;
+    assert(rear_line != front_line);
+    assert(rear_line != arr_line && front_line != arr_line);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the size stays correct after the indices have gone round the ring many times.
+ */
+int sizeAfterManyWraps() {
+    int one = ONE;
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE*10 + 3; i++) {
+        Queue_enq(queue, &one);
+        Queue_deq(queue);
+    }
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        Queue_enq(queue, &one);
+    }
+    assert(Queue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    assert(Queue_enq(queue, &one) == false);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that growing a queue whose elements wrap around the end of the array keeps them in order.
+ */
+int resizeGrowKeepsOrder() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE*2];
+    int one = ONE;
+    // Move the front half way round the ring first
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE/2; i++) {
+        Queue_enq(queue, &one);
+        Queue_deq(queue);
+    }
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        Queue_enq(queue, &elements[i]);
+    }
+    assert(Queue_resize(queue, DEFAULT_MAX_QUEUE_SIZE*2));
+    for (int i = DEFAULT_MAX_QUEUE_SIZE; i < DEFAULT_MAX_QUEUE_SIZE*2; i++) {
+        assert(Queue_enq(queue, &elements[i]));
+    }
+    assert(Queue_enq(queue, &one) == false);
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE*2; i++) {
+        assert(Queue_deq(queue) == &elements[i]);
+    }
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a queue can't be shrunk below the number of elements in it, and can down to it.
+ */
+int resizeShrinkToSize() {
+    int one = ONE;
+    for (int i = 0; i < 5; i++) {
+        Queue_enq(queue, &one);
+    }
+    assert(Queue_resize(queue, 4) == false);
+    assert(Queue_resize(queue, 5));
+    assert(Queue_size(queue) == 5);
+    assert(Queue_enq(queue, &one) == false);
+    return TEST_SUCCESS;
+}
+
 /*
  * Main function for the Queue tests which will run each user-defined test in turn.
  */
 
+/*
+ * Checks that reserved slots only become elements once they are committed.
+ */
+int reserveCommitIsVisible() {
+    int one = ONE;
+    int count;
+    void* _Atomic* slots = Queue_reserve(queue, 3, &count);
+    assert(slots != NULL && count == 3);
+    for (int i = 0; i < count; i++) {
+        atomic_store_explicit(&slots[i], &one, memory_order_relaxed);
+    }
+    assert(Queue_isEmpty(queue));
+    assert(Queue_commit(queue, 2));
+    assert(Queue_size(queue) == 2);
+    assert(Queue_deq(queue) == &one);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a reservation stops at the end of the array, and that a full queue has nothing to reserve.
+ */
+int reserveStopsAtWrap() {
+    int one = ONE;
+    int count;
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE - 2; i++) {
+        Queue_enq(queue, &one);
+        Queue_deq(queue);
+    }
+    Queue_reserve(queue, 5, &count);
+    assert(count == 2);
+    assert(Queue_commit(queue, -1) == false);
+    assert(Queue_commit(queue, 3) == false); // More than were reserved, even though more slots are free
+    assert(Queue_commit(queue, 2));
+    assert(Queue_commit(queue, 1) == false); // The reservation has ended
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE - 2; i++) {
+        Queue_enq(queue, &one);
+    }
+    assert(Queue_reserve(queue, 1, &count) == NULL && count == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that peeked elements stay in the queue until they are released.
+ */
+int peekReleaseInPlace() {
+    int elements[4];
+    int count;
+    assert(Queue_peek(queue, 1, &count) == NULL && count == 0);
+    for (int i = 0; i < 4; i++) {
+        Queue_enq(queue, &elements[i]);
+    }
+    void** peeked = Queue_peek(queue, 3, &count);
+    assert(count == 3 && peeked[0] == &elements[0] && peeked[2] == &elements[2]);
+    assert(Queue_size(queue) == 4);
+    assert(Queue_release(queue, 5) == false);
+    assert(Queue_release(queue, 2));
+    assert(Queue_deq(queue) == &elements[2]);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a walk returns the elements in order across the wrap, without dequeuing them, and that the front
+ * element can be read the same way.
+ */
+int iterateWalksContents() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE + 5];
+    QueueIterator iterator;
+    void* element;
+    assert(Queue_front(queue) == NULL);
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE + 5; i++) {
+        Queue_enq(queue, &elements[i]);
+        if (i >= DEFAULT_MAX_QUEUE_SIZE/2) {
+            Queue_deq(queue); // Keeps half of the queue full while going round the array
+        }
+    }
+    int size = Queue_size(queue);
+    int first = DEFAULT_MAX_QUEUE_SIZE + 5 - size;
+    assert(Queue_front(queue) == &elements[first]);
+    Queue_iterate(queue, &iterator);
+    for (int i = 0; i < size; i++) {
+        assert(QueueIterator_next(&iterator, &element));
+        assert(element == &elements[first + i]);
+    }
+    assert(!QueueIterator_next(&iterator, &element) && element == NULL);
+    assert(Queue_size(queue) == size);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a walk skips elements dequeued while it runs, leaves out elements enqueued after it started,
+ * and stops if the queue is cleared.
+ */
+int iterateSkipsDequeued() {
+    int elements[10];
+    QueueIterator iterator;
+    void* element;
+    for (int i = 0; i < 5; i++) {
+        Queue_enq(queue, &elements[i]);
+    }
+    Queue_iterate(queue, &iterator);
+    assert(QueueIterator_next(&iterator, &element) && element == &elements[0]);
+    Queue_deq(queue);
+    Queue_deq(queue);
+    Queue_deq(queue);
+    Queue_enq(queue, &elements[5]);
+    assert(QueueIterator_next(&iterator, &element) && element == &elements[3]);
+    assert(QueueIterator_next(&iterator, &element) && element == &elements[4]);
+    assert(!QueueIterator_next(&iterator, &element));
+
+    Queue_iterate(queue, &iterator);
+    Queue_clear(queue);
+    Queue_enq(queue, &elements[6]);
+    assert(!QueueIterator_next(&iterator, &element));
+    return TEST_SUCCESS;
+}
+
 int main() {
     runTest(newQueueIsNotNull);
     runTest(newQueueSizeZero);
@@ -342,6 +617,20 @@ int main() {
     runTest(enqAfterClearing);
     runTest(enqClearedSize);
     runTest(enqAndDeqAfterClearing);
+    runTest(hugePagesQueueFillAndDrain);
+    runTest(lazyQueueFillAndDrain);
+    runTest(arenaQueueFillAndDrain);
+    runTest(arenaAlignsArrays);
+    runTest(arenaTooSmallReturnsNull);
+    runTest(frontAndRearOnSeparateLines);
+    runTest(sizeAfterManyWraps);
+    runTest(resizeGrowKeepsOrder);
+    runTest(resizeShrinkToSize);
+    runTest(reserveCommitIsVisible);
+    runTest(reserveStopsAtWrap);
+    runTest(peekReleaseInPlace);
+    runTest(iterateWalksContents);
+    runTest(iterateSkipsDequeued);
 
     printf("Queue Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
 
@@ -0,0 +1,313 @@
+/*
+ * TestQueueTrace.c
+ *
+ * Very simple unit test file for QueueTrace functionality, and BlockingQueue's recording mode.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "BlockingQueue.h"
+#include "QueueTrace.h"
+#include "myassert.h"
+
+
+#define DEFAULT_MAX_QUEUE_SIZE 20
+#define DEFAULT_TRACE_SIZE 1000
+#define PRODUCERS 2
+#define PER_PRODUCER 40
+#define ARRIVAL_US 1000
+#define SERVICE_US 2000
+
+/*
+ * The file traces are saved to during tests, unique to this process
+ */
+static char test_file[64];
+
+/*
+ * The queue and trace to use during tests
+ */
+static BlockingQueue *queue;
+static QueueTrace *trace;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new_BlockingQueue(DEFAULT_MAX_QUEUE_SIZE);
+    trace = new_QueueTrace(DEFAULT_TRACE_SIZE);
+    BlockingQueue_record(queue, trace);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    BlockingQueue_destroy(queue);
+    QueueTrace_destroy(trace);
+    unlink(test_file);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * Returns the number of records of the given event in the trace.
+ */
+static int count_events(QueueTrace* counted, QueueTraceEvent event) {
+    int count = 0;
+    for (size_t i = 0; i < QueueTrace_size(counted); i++) {
+        count += (*counted).records[i].event == (uint32_t) event;
+    }
+    return count;
+}
+
+/*
+ * Spins for the given number of microseconds, like a consumer busy with an element.
+ */
+static void spin_us(long us) {
+    struct timespec start;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec)*1000000L + (now.tv_nsec - start.tv_nsec)/1000 < us);
+}
+
+/*
+ * A producer thread enqueueing PER_PRODUCER elements, one every ARRIVAL_US microseconds.
+ */
+static void* threadProduce(void* arg) {
+    (void) arg;
+    int one = ONE;
+    for (int i = 0; i < PER_PRODUCER; i++) {
+        BlockingQueue_enq(queue, &one);
+        usleep(ARRIVAL_US);
+    }
+    return NULL;
+}
+
+/*
+ * A consumer thread dequeueing every element, and spending SERVICE_US microseconds on each.
+ */
+static void* threadConsume(void* arg) {
+    (void) arg;
+    for (int i = 0; i < PRODUCERS*PER_PRODUCER; i++) {
+        BlockingQueue_deq(queue);
+        spin_us(SERVICE_US);
+    }
+    return NULL;
+}
+
+
+/*
+ * Checks that the QueueTrace constructor returns a non-NULL pointer, and NULL for no capacity.
+ */
+int newQueueTraceIsNotNull() {
+    assert(trace != NULL);
+    assert(QueueTrace_size(trace) == 0);
+    assert(new_QueueTrace(0) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that enqueues and dequeues are recorded in order, on the calling thread, until recording stops.
+ */
+int recordsEnqueuesAndDequeues() {
+    int one = ONE;
+    for (int i = 0; i < 10; i++) {
+        BlockingQueue_enq(queue, &one);
+    }
+    for (int i = 0; i < 10; i++) {
+        BlockingQueue_deq(queue);
+    }
+    assert(QueueTrace_size(trace) == 20);
+    assert(count_events(trace, QUEUE_TRACE_ENQ) == 10 && count_events(trace, QUEUE_TRACE_DEQ) == 10);
+    for (size_t i = 1; i < QueueTrace_size(trace); i++) {
+        assert((*trace).records[i].thread == (*trace).records[0].thread);
+        assert((*trace).records[i].time_ns >= (*trace).records[i - 1].time_ns);
+    }
+    BlockingQueue_record(queue, NULL);
+    BlockingQueue_enq(queue, &one);
+    assert(QueueTrace_size(trace) == 20);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that batches, reservations and evictions are recorded element by element.
+ */
+int recordsBatchesAndEvictions() {
+    int one = ONE;
+    void* elements[5];
+    int count;
+    void* _Atomic* slots = BlockingQueue_reserve(queue, 5, &count);
+    for (int i = 0; i < count; i++) {
+        atomic_store_explicit(&slots[i], &one, memory_order_relaxed);
+    }
+    BlockingQueue_commit(queue, count);
+    assert(BlockingQueue_deqBatch(queue, elements, 5, 0) == 5);
+    assert(count_events(trace, QUEUE_TRACE_ENQ) == 5 && count_events(trace, QUEUE_TRACE_DEQ) == 5);
+
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_EVICT_OLDEST);
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE + 3; i++) {
+        BlockingQueue_enq(queue, &one);
+    }
+    assert(count_events(trace, QUEUE_TRACE_DROP) == 3);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that events beyond the capacity are dropped and counted.
+ */
+int dropsBeyondCapacity() {
+    QueueTrace* small = new_QueueTrace(5);
+    for (int i = 0; i < 8; i++) {
+        QueueTrace_record(small, QUEUE_TRACE_ENQ, ONE);
+    }
+    assert(QueueTrace_size(small) == 5);
+    assert(QueueTrace_dropped(small) == 3);
+    QueueTrace_destroy(small);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a saved trace loads back with the same records.
+ */
+int saveAndLoad() {
+    int one = ONE;
+    for (int i = 0; i < 10; i++) {
+        BlockingQueue_enq(queue, &one);
+        BlockingQueue_deq(queue);
+    }
+    assert(QueueTrace_save(trace, test_file));
+    QueueTrace* loaded = QueueTrace_load(test_file);
+    assert(loaded != NULL);
+    assert(QueueTrace_size(loaded) == 20 && QueueTrace_dropped(loaded) == 0);
+    assert(memcmp((*loaded).records, (*trace).records, 20*sizeof(QueueTraceRecord)) == 0);
+    QueueTrace_destroy(loaded);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that loading fails for a missing file, and for a file that isn't a trace.
+ */
+int loadRejectsOtherFiles() {
+    assert(QueueTrace_load("/nonexistent/TestQueueTrace.trace") == NULL);
+    FILE* file = fopen(test_file, "w");
+    fputs("not a trace, but long enough to hold a header", file);
+    fclose(file);
+    assert(QueueTrace_load(test_file) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that the profile finds the producers and consumers, every arrival in time order, and service times close
+ * to what the consumer spent on each element, while the consumer was never short of elements.
+ */
+int profileMatchesWorkload() {
+    pthread_t producers[PRODUCERS];
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, threadConsume, NULL);
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&producers[i], NULL, threadProduce, NULL);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    pthread_join(consumer, NULL);
+
+    QueueTraceProfile* profile = QueueTrace_profile(trace);
+    assert(profile != NULL);
+    assert((*profile).producers == PRODUCERS && (*profile).consumers == 1);
+    assert((*profile).arrivals == PRODUCERS*PER_PRODUCER && (*profile).sojourns == PRODUCERS*PER_PRODUCER);
+    for (long i = 1; i < (*profile).arrivals; i++) {
+        assert((*profile).arrival_ns[i] >= (*profile).arrival_ns[i - 1]);
+    }
+    // Elements arrive twice as fast as they are served, so the consumer is busy for all but the first few
+    assert((*profile).services >= PRODUCERS*PER_PRODUCER/2);
+    for (long i = 0; i < (*profile).services; i++) {
+        assert((*profile).service_ns[i] >= SERVICE_US*1000L);
+    }
+    QueueTraceProfile_destroy(profile);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that an overwrite is recorded as a single event, and that the profile takes it as the departure of the
+ * oldest element and the arrival of the new one.
+ */
+int profileCountsOverwrites() {
+    int one = ONE;
+    BlockingQueue_setPolicy(queue, BLOCKING_QUEUE_OVERWRITE);
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        BlockingQueue_enq(queue, &one);
+    }
+    usleep(20000);
+    for (int i = 0; i < 3; i++) {
+        BlockingQueue_enq(queue, &one);
+    }
+    usleep(20000);
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        BlockingQueue_deq(queue);
+    }
+    assert(count_events(trace, QUEUE_TRACE_OVERWRITE) == 3 && count_events(trace, QUEUE_TRACE_DROP) == 0);
+
+    QueueTraceProfile* profile = QueueTrace_profile(trace);
+    assert(profile != NULL);
+    assert((*profile).arrivals == DEFAULT_MAX_QUEUE_SIZE + 3 && (*profile).sojourns == DEFAULT_MAX_QUEUE_SIZE);
+    // The elements that were overwritten never leave through a dequeue: the first ones dequeued waited 40ms, the
+    // ones that overwrote them 20ms
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE - 3; i++) {
+        assert((*profile).sojourn_ns[i] >= 40000000L);
+    }
+    for (int i = DEFAULT_MAX_QUEUE_SIZE - 3; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        assert((*profile).sojourn_ns[i] >= 20000000L && (*profile).sojourn_ns[i] < 40000000L);
+    }
+    QueueTraceProfile_destroy(profile);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the QueueTrace tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    snprintf(test_file, sizeof(test_file), "/tmp/TestQueueTrace.%d.trace", (int) getpid());
+    runTest(newQueueTraceIsNotNull);
+    runTest(recordsEnqueuesAndDequeues);
+    runTest(recordsBatchesAndEvictions);
+    runTest(dropsBeyondCapacity);
+    runTest(saveAndLoad);
+    runTest(loadRejectsOtherFiles);
+    runTest(profileMatchesWorkload);
+    runTest(profileCountsOverwrites);
+
+    printf("\nQueueTrace Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}
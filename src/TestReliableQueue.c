@@ -0,0 +1,272 @@
+/*
+ * TestReliableQueue.c
+ *
+ * Very simple unit test file for ReliableQueue functionality.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "ReliableQueue.h"
+#include "myassert.h"
+
+
+#define DEFAULT_MAX_QUEUE_SIZE 20
+#define VISIBILITY_MS 50
+#define THREAD_COUNT 4
+#define ELEMENT_COUNT 2000
+
+/*
+ * The queue to use during tests
+ */
+static ReliableQueue *queue;
+
+/*
+ * The number of tests that succeeded
+ */
+static int success_count = 0;
+
+/*
+ * The total number of tests run
+ */
+static int total_count = 0;
+
+
+/*
+ * Setup function to run prior to each test
+ */
+void setup(){
+    queue = new_ReliableQueue(DEFAULT_MAX_QUEUE_SIZE, VISIBILITY_MS);
+    total_count++;
+}
+
+/*
+ * Teardown function to run after each test
+ */
+void teardown(){
+    ReliableQueue_destroy(queue);
+}
+
+/*
+ * This function is called multiple times from main for each user-defined test function
+ */
+void runTest(int (*testFunction)()) {
+    setup();
+
+    if (testFunction()) success_count++;
+
+    teardown();
+}
+
+/*
+ * Function used by a thread to enqueue the given element.
+ */
+void* threadEnq(void* arg) {
+    return (void*) ReliableQueue_enq(queue, arg);
+}
+
+/*
+ * The number of times each element of the concurrent test has been acknowledged, and the number of deliveries left
+ * before the next one a consumer "crashes" on, leaving it unacknowledged.
+ */
+static atomic_int acked[ELEMENT_COUNT];
+static atomic_int acked_total;
+static atomic_int until_crash;
+
+/*
+ * Function used by a consumer thread to acknowledge elements until every one of them has been, giving every 7th
+ * delivery back and abandoning every 13th, as a consumer that dies while processing it would.
+ */
+void* threadConsumeUnreliably() {
+    while (atomic_load(&acked_total) < ELEMENT_COUNT) {
+        ReliableHandle handle;
+        int* element = ReliableQueue_deq(queue, &handle);
+        if (*element < 0) {
+            ReliableQueue_ack(queue, handle);
+            break; // The test's own stop element, once everything has been acknowledged
+        }
+        int delivery = atomic_fetch_add(&until_crash, 1);
+        if (delivery % 13 == 12) {
+            continue; // Abandoned: the lease expires and the element is delivered again
+        }
+        if (delivery % 7 == 6) {
+            ReliableQueue_nack(queue, handle);
+            continue;
+        }
+        if (ReliableQueue_ack(queue, handle)) {
+            atomic_fetch_add(&acked[*element], 1);
+            atomic_fetch_add(&acked_total, 1);
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Checks that the ReliableQueue constructor returns a non-NULL pointer, and NULL for an invalid size.
+ */
+int newQueueIsNotNull() {
+    assert(queue != NULL);
+    assert(new_ReliableQueue(0, VISIBILITY_MS) == NULL);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that a dequeued element stays in flight until it is acknowledged, and that it can only be acknowledged once.
+ */
+int deqThenAck() {
+    int one = ONE;
+    ReliableHandle handle;
+    assert(ReliableQueue_enq(queue, NULL) == false);
+    assert(ReliableQueue_enq(queue, &one));
+    assert(ReliableQueue_size(queue) == 1);
+    assert(ReliableQueue_deq(queue, &handle) == &one);
+    assert(ReliableQueue_size(queue) == 0);
+    assert(ReliableQueue_inFlight(queue) == 1);
+    assert(ReliableQueue_ack(queue, handle));
+    assert(ReliableQueue_inFlight(queue) == 0);
+    assert(ReliableQueue_ack(queue, handle) == false);
+    assert(ReliableQueue_nack(queue, handle) == false);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that an element given back is delivered again straight away, with a new handle.
+ */
+int nackRedelivers() {
+    int one = ONE;
+    int two = 2;
+    ReliableHandle first, second;
+    ReliableQueue_enq(queue, &one);
+    ReliableQueue_enq(queue, &two);
+    assert(ReliableQueue_deq(queue, &first) == &one);
+    assert(ReliableQueue_nack(queue, first));
+    assert(ReliableQueue_deq(queue, &second) == &two);
+    assert(ReliableQueue_deq(queue, &second) == &one);
+    assert(ReliableQueue_ack(queue, first) == false); // The first delivery's handle is stale
+    assert(ReliableQueue_ack(queue, second));
+    assert(ReliableQueue_redelivered(queue) == 1);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that an element that isn't acknowledged within the visibility timeout is delivered again.
+ */
+int expiredLeaseRedelivers() {
+    int one = ONE;
+    ReliableHandle first, second;
+    ReliableQueue_enq(queue, &one);
+    assert(ReliableQueue_deq(queue, &first) == &one);
+    assert(ReliableQueue_deq(queue, &second) == &one); // Blocks until the first lease expires
+    assert(ReliableQueue_redelivered(queue) == 1);
+    assert(ReliableQueue_ack(queue, first) == false);
+    assert(ReliableQueue_ack(queue, second));
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that an acknowledged element isn't delivered again once its timer goes off, even when its lease has been
+ * handed out again in the meantime.
+ */
+int ackedElementNotRedelivered() {
+    int one = ONE;
+    int two = 2;
+    ReliableHandle handle;
+    ReliableQueue_destroy(queue);
+    queue = new_ReliableQueue(1, VISIBILITY_MS); // A single lease, so that it is handed out again
+    ReliableQueue_enq(queue, &one);
+    ReliableQueue_deq(queue, &handle);
+    ReliableQueue_ack(queue, handle);
+    ReliableQueue_enq(queue, &two);
+    usleep(VISIBILITY_MS*1000/2);
+    assert(ReliableQueue_deq(queue, &handle) == &two); // Its first timer is still pending
+    usleep(VISIBILITY_MS*1000*3/4); // Makes the program sleep past the first timer, but not the second
+    assert(ReliableQueue_ack(queue, handle));
+    usleep(VISIBILITY_MS*1000);
+    assert(ReliableQueue_size(queue) == 0);
+    assert(ReliableQueue_redelivered(queue) == 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that elements in flight take up space, so that a full queue only makes room once one is acknowledged.
+ */
+int inFlightElementsTakeSpace() {
+    int elements[DEFAULT_MAX_QUEUE_SIZE];
+    int one = ONE;
+    ReliableHandle handle;
+    pthread_t thr;
+    void* tr;
+    for (int i = 0; i < DEFAULT_MAX_QUEUE_SIZE; i++) {
+        ReliableQueue_enq(queue, &elements[i]);
+    }
+    ReliableQueue_deq(queue, &handle);
+    pthread_create(&thr, NULL, threadEnq, &one); // Has to wait, although an element has been dequeued
+    usleep(20000); // Makes the program sleep for 20ms, to make sure that the thread is properly waiting
+    assert(ReliableQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE - 1);
+    ReliableQueue_ack(queue, handle);
+    pthread_join(thr, &tr);
+    assert((bool) tr);
+    assert(ReliableQueue_size(queue) == DEFAULT_MAX_QUEUE_SIZE);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Checks that with consumers giving elements back and abandoning them, every element is still acknowledged exactly once.
+ */
+int atLeastOnceWithUnreliableConsumers() {
+    static int elements[ELEMENT_COUNT];
+    pthread_t consumers[THREAD_COUNT];
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        elements[i] = i;
+        atomic_init(&acked[i], 0);
+    }
+    atomic_init(&acked_total, 0);
+    atomic_init(&until_crash, 0);
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&consumers[i], NULL, threadConsumeUnreliably, NULL);
+    }
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        ReliableQueue_enq(queue, &elements[i]);
+    }
+    while (atomic_load(&acked_total) < ELEMENT_COUNT) {
+        usleep(1000);
+    }
+
+    // Stop the consumers still waiting for an element
+    int stop = -1;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        ReliableQueue_enq(queue, &stop);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(consumers[i], NULL);
+    }
+    for (int i = 0; i < ELEMENT_COUNT; i++) {
+        assert(atomic_load(&acked[i]) == 1);
+    }
+    assert(ReliableQueue_redelivered(queue) > 0);
+    return TEST_SUCCESS;
+}
+
+/*
+ * Main function for the ReliableQueue tests which will run each user-defined test in turn.
+ */
+
+int main() {
+    runTest(newQueueIsNotNull);
+    runTest(deqThenAck);
+    runTest(nackRedelivers);
+    runTest(expiredLeaseRedelivers);
+    runTest(ackedElementNotRedelivered);
+    runTest(inFlightElementsTakeSpace);
+    runTest(atLeastOnceWithUnreliableConsumers);
+
+    printf("\nReliableQueue Tests complete: %d / %d tests successful.\n----------------\n", success_count, total_count);
+
+}